@@ -0,0 +1,289 @@
+/**
+ * @file matrix_bench.cpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief Micro-benchmarks of the operations of `Matrix`, swept over sizes, element types and thread counts.
+ *        Every case reports its median time per call together with the achieved GB/s and GFLOP/s, as CSV or JSON.
+ *
+ *        Usage: matrix_bench [--format csv|json] [--sizes 64,256,1024] [--threads 1,4] [--types float,double,int]
+ *                            [--filter substring] [--min-time seconds] [--samples n]
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#include "mat.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+#include <string>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+using namespace utils;
+
+namespace
+{
+    struct Options
+    {
+        string format = "csv";
+        vector<size_t> sizes{64, 256, 1024};
+        vector<int> threads{1};
+        vector<string> types{"float", "double", "int"};
+        string filter;
+        double min_time = 0.05; // seconds per sample
+        int samples = 5;
+    };
+
+    struct Result
+    {
+        string op;
+        string type;
+        size_t size;
+        int threads;
+        double ns;     // median time of a single call
+        double bytes;  // memory traffic of a single call
+        double flops;  // arithmetic of a single call
+    };
+
+    template <typename T>
+    inline void do_not_optimize(T const &value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    template <typename T>
+    const char *type_name();
+    template <>
+    const char *type_name<float>() { return "float"; }
+    template <>
+    const char *type_name<double>() { return "double"; }
+    template <>
+    const char *type_name<int>() { return "int"; }
+
+    /**
+     * @brief The median over `samples` samples of the time of one call of `f`, each sample repeating `f` for at least
+     *        `min_time` seconds.
+     *
+     */
+    double time_ns(const Options &opt, const function<void()> &f)
+    {
+        using clock = chrono::steady_clock;
+        f(); // warm up the caches and the lazily initialized kernels
+
+        size_t reps = 1;
+        for (;;)
+        {
+            auto t0 = clock::now();
+            for (size_t i = 0; i < reps; ++i)
+                f();
+            double s = chrono::duration<double>(clock::now() - t0).count();
+            if (s >= opt.min_time / 4 || reps >= (size_t(1) << 30))
+            {
+                reps = max<size_t>(1, size_t(reps * opt.min_time / max(s, 1e-9)));
+                break;
+            }
+            reps *= 4;
+        }
+
+        vector<double> ns;
+        for (int k = 0; k < opt.samples; ++k)
+        {
+            auto t0 = clock::now();
+            for (size_t i = 0; i < reps; ++i)
+                f();
+            ns.push_back(chrono::duration<double, nano>(clock::now() - t0).count() / double(reps));
+        }
+        nth_element(ns.begin(), ns.begin() + ns.size() / 2, ns.end());
+        return ns[ns.size() / 2];
+    }
+
+    template <typename T>
+    void fill(Matrix_base<T, 2> &m)
+    {
+        T *p = m.data();
+        for (size_t i = 0; i < m.size(); ++i)
+            p[i] = T(i % 7 + 1);
+    }
+
+    template <typename T>
+    void bench_type(const Options &opt, size_t n, int threads, vector<Result> &out)
+    {
+        const double elems = double(n) * double(n), bytes = elems * sizeof(T);
+        const char *type = type_name<T>();
+        auto run = [&](const string &op, double traffic, double flops, const function<void()> &f)
+        {
+            if (!opt.filter.empty() && op.find(opt.filter) == string::npos)
+                return;
+            out.push_back(Result{op, type, n, threads, time_ns(opt, f), traffic, flops});
+        };
+
+        Matrix<T, 2> a(n, n), b(n, n);
+        fill(a);
+        fill(b);
+
+        // construction
+        run("construct_extents", bytes, 0, [&]
+            { Matrix<T, 2> m(n, n); do_not_optimize(m.data()); });
+        run("construct_initializer_4x4", 16 * sizeof(T), 0, [&]
+            { Matrix<T, 2> m{{1, 2, 3, 4}, {5, 6, 7, 8}, {9, 10, 11, 12}, {13, 14, 15, 16}}; do_not_optimize(m.data()); });
+        run("copy", 2 * bytes, 0, [&]
+            { Matrix<T, 2> m = a; do_not_optimize(m.data()); });
+
+        // slicing
+        run("row_slicing", 0, 0, [&]
+            { for (size_t i = 0; i < n; ++i) { auto r = a.row(i); do_not_optimize(r.data()); } });
+        run("column_slicing", 0, 0, [&]
+            { for (size_t j = 0; j < n; ++j) { auto c = a.column(j); do_not_optimize(c.data()); } });
+        run("copy_from_row_ref", double(n) * sizeof(T) * 2, 0, [&]
+            { Matrix<T, 1> m(a.row(n / 2)); do_not_optimize(m.data()); });
+        run("copy_from_column_ref", double(n) * sizeof(T) * 2, 0, [&]
+            { Matrix<T, 1> m(a.column(n / 2)); do_not_optimize(m.data()); });
+
+        // traversal
+        run("iterate_matrix", bytes, elems, [&]
+            { T s = 0; for (const T &x : a) s += x; do_not_optimize(s); });
+        run("iterate_column_ref", double(n) * sizeof(T), double(n), [&]
+            { T s = 0; for (const T &x : a.column(n / 2)) s += x; do_not_optimize(s); });
+        run("apply", 2 * bytes, elems, [&]
+            { a.apply([](T &x) { x = x * T(3) / T(3); }); do_not_optimize(a.data()); });
+        run("apply_par", 2 * bytes, elems, [&]
+            { a.apply(execution::par_unseq, [](T &x) { x = x * T(3) / T(3); }); do_not_optimize(a.data()); });
+        run("apply_column_ref", 2 * double(n) * sizeof(T), double(n), [&]
+            { a.column(n / 2).apply([](T &x) { x = x * T(3) / T(3); }); do_not_optimize(a.data()); });
+
+        // scalar operators
+        run("scalar_add", 2 * bytes, elems, [&]
+            { a += T(1); do_not_optimize(a.data()); });
+        run("scalar_mul", 2 * bytes, elems, [&]
+            { a *= T(1); do_not_optimize(a.data()); });
+        run("scalar_add_row_ref", 2 * double(n) * sizeof(T), double(n), [&]
+            { a.row(n / 2) += T(1); do_not_optimize(a.data()); });
+        run("scalar_add_column_ref", 2 * double(n) * sizeof(T), double(n), [&]
+            { a.column(n / 2) += T(1); do_not_optimize(a.data()); });
+
+        // element-wise expressions and the matrix product
+        run("expr_axpy", 3 * bytes, 2 * elems, [&]
+            { Matrix<T, 2> c = a * T(2) + b; do_not_optimize(c.data()); });
+        run("expr_axpy_inplace", 3 * bytes, 2 * elems, [&]
+            { a = a * T(1) + b * T(0); do_not_optimize(a.data()); });
+        if (n <= 1024)
+            run("gemm", 3 * bytes, 2 * elems * double(n), [&]
+                { Matrix<T, 2> c = a * b; do_not_optimize(c.data()); });
+    }
+
+    vector<string> split(const string &s)
+    {
+        vector<string> parts;
+        stringstream ss(s);
+        for (string item; getline(ss, item, ',');)
+            if (!item.empty())
+                parts.push_back(item);
+        return parts;
+    }
+
+    Options parse(int argc, char **argv)
+    {
+        Options opt;
+        for (int i = 1; i < argc; ++i)
+        {
+            string arg = argv[i];
+            if (i + 1 >= argc)
+                throw invalid_argument("missing value for " + arg);
+            string value = argv[++i];
+            if (arg == "--format")
+                opt.format = value;
+            else if (arg == "--sizes")
+            {
+                opt.sizes.clear();
+                for (auto &x : split(value))
+                    opt.sizes.push_back(stoul(x));
+            }
+            else if (arg == "--threads")
+            {
+                opt.threads.clear();
+                for (auto &x : split(value))
+                    opt.threads.push_back(stoi(x));
+            }
+            else if (arg == "--types")
+                opt.types = split(value);
+            else if (arg == "--filter")
+                opt.filter = value;
+            else if (arg == "--min-time")
+                opt.min_time = stod(value);
+            else if (arg == "--samples")
+                opt.samples = max(1, stoi(value));
+            else
+                throw invalid_argument("unknown option " + arg);
+        }
+        if (opt.format != "csv" && opt.format != "json")
+            throw invalid_argument("the format must be csv or json");
+        return opt;
+    }
+
+    void print(const Options &opt, const vector<Result> &results)
+    {
+        auto rate = [](double amount, double ns)
+        { return ns > 0 ? amount / ns : 0; }; // bytes per ns == GB/s
+
+        if (opt.format == "csv")
+        {
+            cout << "op,type,size,threads,ns,gbps,gflops\n";
+            for (auto &r : results)
+                cout << r.op << ',' << r.type << ',' << r.size << ',' << r.threads << ',' << r.ns << ','
+                     << rate(r.bytes, r.ns) << ',' << rate(r.flops, r.ns) << '\n';
+            return;
+        }
+
+        cout << "[\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            auto &r = results[i];
+            cout << "  {\"op\": \"" << r.op << "\", \"type\": \"" << r.type << "\", \"size\": " << r.size
+                 << ", \"threads\": " << r.threads << ", \"ns\": " << r.ns << ", \"gbps\": " << rate(r.bytes, r.ns)
+                 << ", \"gflops\": " << rate(r.flops, r.ns) << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        cout << "]\n";
+    }
+};
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    try
+    {
+        opt = parse(argc, argv);
+    }
+    catch (const exception &e)
+    {
+        cerr << "matrix_bench: " << e.what() << "\n";
+        return 2;
+    }
+
+    vector<Result> results;
+    for (int threads : opt.threads)
+    {
+#ifdef _OPENMP
+        omp_set_num_threads(max(1, threads));
+#endif
+        for (size_t n : opt.sizes)
+            for (auto &type : opt.types)
+            {
+                if (type == "float")
+                    bench_type<float>(opt, n, threads, results);
+                else if (type == "double")
+                    bench_type<double>(opt, n, threads, results);
+                else if (type == "int")
+                    bench_type<int>(opt, n, threads, results);
+                else
+                    cerr << "matrix_bench: skipping unknown type " << type << "\n";
+            }
+    }
+    print(opt, results);
+    return 0;
+}
@@ -23,6 +23,15 @@
 #include <cassert>
 #include <initializer_list>
 #include <cstddef>
+#include <algorithm>
+
+#include "mat_simd.hpp"
+#include "mat_telemetry.hpp"
+#include "mat_alloc.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /**
  * @brief The namespace for this c++ project.
@@ -56,6 +65,15 @@ namespace utils
     template <typename T>
     using Value_type = T; // todo: change this
 
+    template <typename T>
+    struct Type_identity
+    {
+        using type = T;
+    };
+
+    template <typename T>
+    using Non_deduced = typename Type_identity<T>::type; // exclude a parameter from template argument deduction
+
     template <typename T, typename T2>
     using Convertible = std::is_convertible<T, T2>;
 
@@ -99,9 +117,12 @@ namespace utils
     template <typename T, size_t N>
     class Matrix_ref;
 
-    template <typename T, size_t N>
+    template <typename T, size_t N, typename Alloc = Aligned_allocator<T>>
     class Matrix;
 
+    template <typename T, size_t N>
+    using Arena_matrix = Matrix<T, N, Arena_allocator<T>>; // draws from the `Matrix_arena` installed for the scope
+
     struct Slice;
 
     // ------------------------------
@@ -301,7 +322,7 @@ namespace utils
                 dest.start = src.start + n * src.strides[1];
                 if (src.extents.size() > 1)
                 {
-                    dest.extents[0] = dest.extents[0];
+                    dest.extents[0] = src.extents[0];
                     dest.strides[0] = src.strides[0];
                     for (size_t i = 2; i < N; ++i)
                     {
@@ -319,27 +340,49 @@ namespace utils
             return a.extents == b.extents;
         }
 
-        // template <size_t N, typename T, typename... Dims>
-        // size_t do_slice(const Matrix_slice<N> &source, const Matrix_slice<N> &target, const T &s, Dims &...dims)
-        // {
-        //     size_t m = do_slice_dim<sizeof...(Dims) + 1>(source, target, s);
-        //     size_t n = do_slice(source, target, dims...);
-        //     return m + n;
-        // }
+        /**
+         * @brief Check whether the elements described by `s` are stored contiguously in row-major order.
+         *
+         */
+        template <size_t N>
+        bool is_contiguous(Matrix_slice<N> const &s)
+        {
+            size_t expected = 1;
+            for (size_t d = N; d-- > 0;)
+            {
+                if (s.extents[d] != 1 && s.strides[d] != expected)
+                    return false;
+                expected *= s.extents[d];
+            }
+            return true;
+        }
 
-        // template <size_t N>
-        // size_t do_slice(const Matrix_slice<N> &source, const Matrix_slice<N> &target)
-        // {
-        //     return 0;
-        // }
+        /**
+         * @brief The number of elements from the base pointer up to the last element of `s`, i.e. the storage it needs.
+         *
+         */
+        template <size_t N>
+        size_t span(const Matrix_slice<N> &s)
+        {
+            if (s.size == 0)
+                return 0;
+            size_t last = s.start;
+            for (size_t d = 0; d < N; ++d)
+                last += (s.extents[d] - 1) * s.strides[d];
+            return last + 1;
+        }
     };
 
     template <typename T, size_t N>
     using Matrix_initializer = typename Matrix_impl::Matrix_init<T, N>::type;
 
+    /**
+     * @brief A range of indexes `start, start + stride, ...` of one dimension, `length` of them. `Slice()` selects the
+     *        whole dimension and `Slice(s)` the indexes from `s` to its end.
+     *
+     */
     struct Slice
     {
-        // todo: finish direct slice design
         size_t start;
         size_t length;
         size_t stride;
@@ -489,6 +532,508 @@ namespace utils
         }
     };
 
+    namespace Matrix_impl
+    {
+        /**
+         * @brief Narrow dimension `d` of `dest` to the indexes `s` of `src`, and return the offset of its first index.
+         *
+         */
+        template <size_t N>
+        size_t do_slice_dim(const Matrix_slice<N> &src, Matrix_slice<N> &dest, size_t d, Slice s)
+        {
+            const size_t extent = src.extents[d];
+            if (s.start == size_t(-1))
+                s.start = 0;
+            assert(s.stride > 0 && (s.start < extent || (s.start == extent && s.length != size_t(-1))));
+            if (s.length == size_t(-1))
+                s.length = (extent - s.start + s.stride - 1) / s.stride;
+            assert(s.length == 0 || s.start + (s.length - 1) * s.stride < extent);
+            dest.extents[d] = s.length;
+            dest.strides[d] = src.strides[d] * s.stride;
+            return s.start * src.strides[d];
+        }
+
+        /**
+         * @brief Narrow dimension `d` of `dest` to the single index `n` of `src`. The dimension is kept with extent 1,
+         *        so the order of the result does not depend on which arguments are indexes.
+         *
+         */
+        template <size_t N>
+        size_t do_slice_dim(const Matrix_slice<N> &src, Matrix_slice<N> &dest, size_t d, size_t n)
+        {
+            assert(n < src.extents[d]);
+            dest.extents[d] = 1;
+            dest.strides[d] = src.strides[d];
+            return n * src.strides[d];
+        }
+
+        template <size_t N>
+        size_t do_slice(const Matrix_slice<N> &, Matrix_slice<N> &)
+        {
+            return 0;
+        }
+
+        template <size_t N, typename S, typename... Dims>
+        size_t do_slice(const Matrix_slice<N> &src, Matrix_slice<N> &dest, const S &s, const Dims &...dims)
+        {
+            size_t m = do_slice_dim(src, dest, N - sizeof...(Dims) - 1, s);
+            size_t n = do_slice(src, dest, dims...);
+            return m + n;
+        }
+
+        /**
+         * @brief The slice of the elements of `src` selected by one `Slice` or index per dimension. Strides compose,
+         *        so slicing a slice still addresses the original elements.
+         *
+         */
+        template <size_t N, typename... Dims>
+        Matrix_slice<N> sub_slice(const Matrix_slice<N> &src, const Dims &...dims)
+        {
+            static_assert(sizeof...(Dims) == N, "sub_slice: one Slice or index per dimension.");
+            Matrix_slice<N> d;
+            d.start = src.start + do_slice(src, d, std::conditional_t<Same<Dims, Slice>(), Slice, size_t>(dims)...);
+            d.recalc_size();
+            return d;
+        }
+    };
+
+    /**
+     * @brief Execution policy accepted by `apply`. Parallel policies split the elements into chunks of `grain`
+     *        elements that are scheduled across OpenMP threads; matrices smaller than one chunk run sequentially.
+     * @note With a parallel policy the function object is invoked concurrently and must be safe to do so.
+     */
+    struct Execution_policy
+    {
+        enum Kind
+        {
+            sequenced,
+            parallel,
+            parallel_unsequenced // parallel, and the inner loops are vectorized
+        };
+        enum Schedule
+        {
+            static_schedule,
+            guided_schedule
+        };
+
+        Kind kind;
+        Schedule schedule;
+        size_t grain; // number of elements handed to a thread at once
+        int threads;  // 0 for the OpenMP default
+
+        constexpr Execution_policy(Kind k = sequenced, Schedule s = static_schedule, size_t g = size_t(1) << 15, int t = 0)
+            : kind(k), schedule(s), grain(g), threads(t) {}
+
+        constexpr Execution_policy scheduled(Schedule s) const { return Execution_policy(kind, s, grain, threads); }
+        constexpr Execution_policy grained(size_t g) const { return Execution_policy(kind, schedule, g, threads); }
+        constexpr Execution_policy threaded(int t) const { return Execution_policy(kind, schedule, grain, t); }
+    };
+
+    namespace execution
+    {
+        constexpr Execution_policy seq{Execution_policy::sequenced};
+        constexpr Execution_policy par{Execution_policy::parallel};
+        constexpr Execution_policy par_unseq{Execution_policy::parallel_unsequenced};
+    };
+
+    namespace Matrix_impl
+    {
+        /**
+         * @brief Apply `f` to the elements `[first, last)` of contiguous storage.
+         *
+         */
+        template <typename T, typename F>
+        void apply_contiguous(T *p, size_t first, size_t last, bool unseq, F &f)
+        {
+            if (unseq)
+            {
+#pragma omp simd
+                for (size_t i = first; i < last; ++i)
+                    f(p[i]);
+            }
+            else
+                for (size_t i = first; i < last; ++i)
+                    f(p[i]);
+        }
+
+        /**
+         * @brief The traversal plan of a `Matrix_slice`, computed once per operation. Dimensions of extent 1 are
+         *        dropped, and a dimension is merged into its inner neighbour whenever its stride steps over exactly
+         *        one inner row, so that e.g. a row of a `Matrix<T, 3>` becomes a single contiguous run.
+         *
+         */
+        template <size_t N>
+        struct Segments
+        {
+            size_t start = 0;
+            size_t size = 0;
+            size_t dims = 0;                 // number of dimensions left, the innermost one at `dims - 1`
+            std::array<size_t, N> extents{}; // collapsed extents
+            std::array<size_t, N> strides{}; // collapsed strides
+
+            static bool any_fusible(size_t, size_t) { return true; }
+
+            explicit Segments(const Matrix_slice<N> &s) : Segments(s, any_fusible) {}
+
+            /**
+             * @brief The plan of `s` where dimension `d` is only merged into the kept dimension `p` before it if
+             *        `fusible(p, d)` also holds, so that several operands of the same extents can share a grouping.
+             *
+             */
+            template <typename Fusible>
+            Segments(const Matrix_slice<N> &s, Fusible fusible) : start(s.start), size(s.size)
+            {
+                size_t last = 0; // the last kept dimension of `s`
+                for (size_t d = 0; d < N; ++d)
+                {
+                    if (s.extents[d] == 1)
+                        continue;
+                    if (dims > 0 && strides[dims - 1] == s.strides[d] * s.extents[d] && fusible(last, d))
+                    {
+                        extents[dims - 1] *= s.extents[d];
+                        strides[dims - 1] = s.strides[d];
+                    }
+                    else
+                    {
+                        extents[dims] = s.extents[d];
+                        strides[dims] = s.strides[d];
+                        ++dims;
+                    }
+                    last = d;
+                }
+                if (dims == 0) // a single element
+                {
+                    extents[0] = 1, strides[0] = 1;
+                    dims = 1;
+                }
+            }
+
+            /**
+             * @brief The slice of the plan, with the kept dimensions last and extents of 1 before them.
+             *
+             */
+            Matrix_slice<N> collapsed() const
+            {
+                Matrix_slice<N> r;
+                const size_t lead = N - dims;
+                for (size_t d = 0; d < N; ++d)
+                {
+                    r.extents[d] = d < lead ? 1 : extents[d - lead];
+                    r.strides[d] = d < lead ? 0 : strides[d - lead];
+                }
+                r.start = start;
+                r.size = size;
+                return r;
+            }
+
+            size_t run() const { return extents[dims - 1]; }    // length of the innermost runs
+            size_t stride() const { return strides[dims - 1]; } // distance between the elements of a run
+            bool contiguous() const { return dims == 1 && (stride() == 1 || size <= 1); }
+        };
+
+        /**
+         * @brief Visit the elements `[first, last)`, in row-major order, of the region planned by `g` as runs along
+         *        the innermost collapsed dimension, calling `run(q, n, stride)` for each run of `n` elements starting
+         *        at `q`. The offset is advanced incrementally, carrying into the outer dimensions only when a run ends.
+         *
+         */
+        template <size_t N, typename T, typename Run>
+        void for_each_run(const Segments<N> &g, T *base, size_t first, size_t last, Run &&run)
+        {
+            if (first >= last)
+                return;
+
+            const size_t D = g.dims, inner = g.extents[D - 1], stride = g.strides[D - 1];
+            std::array<size_t, N> cursor{};
+            size_t rem = first;
+            for (size_t d = D; d-- > 0;)
+                cursor[d] = rem % g.extents[d], rem /= g.extents[d];
+
+            size_t row = g.start; // offset of the current innermost run
+            for (size_t d = 0; d + 1 < D; ++d)
+                row += cursor[d] * g.strides[d];
+
+            for (size_t n = last - first; n > 0;)
+            {
+                size_t len = std::min(n, inner - cursor[D - 1]);
+                run(base + row + cursor[D - 1] * stride, len, stride);
+                n -= len;
+                cursor[D - 1] = 0;
+                for (size_t d = D - 1; d-- > 0;)
+                {
+                    row += g.strides[d];
+                    if (++cursor[d] < g.extents[d])
+                        break;
+                    row -= g.extents[d] * g.strides[d];
+                    cursor[d] = 0;
+                }
+            }
+        }
+
+        template <size_t N, typename T, typename Run>
+        void for_each_run(const Matrix_slice<N> &s, T *base, size_t first, size_t last, Run &&run)
+        {
+            for_each_run(Segments<N>(s), base, first, last, std::forward<Run>(run));
+        }
+
+        /**
+         * @brief Apply `f` to the elements `[first, last)`, in row-major order, of the region planned by `g`.
+         *
+         */
+        template <size_t N, typename T, typename F>
+        void apply_strided(const Segments<N> &g, T *base, size_t first, size_t last, bool unseq, F &f)
+        {
+            for_each_run(g, base, first, last, [&](T *q, size_t len, size_t stride)
+                         {
+                             if (stride == 1)
+                                 apply_contiguous(q, 0, len, unseq, f);
+                             else
+                                 for (size_t i = 0; i < len; ++i)
+                                     f(q[i * stride]); });
+        }
+
+        /**
+         * @brief Copy the region described by `s` into contiguous storage, converting the elements to `T`.
+         *
+         */
+        template <size_t N, typename U, typename T>
+        void gather(const Matrix_slice<N> &s, const U *base, T *out)
+        {
+            for_each_run(s, base, 0, s.size, [&](const U *q, size_t len, size_t stride)
+                         {
+                             if (stride == 1)
+                                 std::copy(q, q + len, out);
+                             else
+                                 for (size_t i = 0; i < len; ++i)
+                                     out[i] = T(q[i * stride]);
+                             out += len; });
+        }
+
+        /**
+         * @brief Split `[0, size)` into chunks according to `policy` and run `body(first, last)` on each of them.
+         *
+         */
+        template <typename Body>
+        void parallel_chunks(const Execution_policy &policy, size_t size, Body body)
+        {
+#ifdef _OPENMP
+            const size_t grain = std::max(policy.grain, size_t(1));
+            if (policy.kind != Execution_policy::sequenced && size > grain && !omp_in_parallel())
+            {
+                const ptrdiff_t chunks = ptrdiff_t((size + grain - 1) / grain);
+                const int threads = policy.threads > 0 ? policy.threads : omp_get_max_threads();
+                if (policy.schedule == Execution_policy::guided_schedule)
+                {
+#pragma omp parallel for schedule(guided) num_threads(threads)
+                    for (ptrdiff_t c = 0; c < chunks; ++c)
+                    {
+                        const size_t first = size_t(c) * grain, last = std::min(size, first + grain);
+                        MAT_TRACE_SPAN("chunk", last - first);
+                        body(first, last);
+                    }
+                }
+                else
+                {
+#pragma omp parallel for schedule(static) num_threads(threads)
+                    for (ptrdiff_t c = 0; c < chunks; ++c)
+                    {
+                        const size_t first = size_t(c) * grain, last = std::min(size, first + grain);
+                        MAT_TRACE_SPAN("chunk", last - first);
+                        body(first, last);
+                    }
+                }
+                return;
+            }
+#endif
+            body(0, size);
+        }
+
+        /**
+         * @brief `p[i] = op(p[i], val)` over contiguous storage, through the SIMD kernels in `mat_simd.hpp`.
+         *
+         */
+        template <typename Op, typename T>
+        void scalar_op(const Execution_policy &policy, T *p, size_t size, const T &val)
+        {
+            MAT_TELEMETRY_SCOPE(scalar_op, size, size * sizeof(T));
+            parallel_chunks(policy, size, [&](size_t first, size_t last)
+                            { simd_scalar_op<Op>(p + first, last - first, val); });
+        }
+
+        /**
+         * @brief `op(x, val)` over the region described by `s`; runs with a unit stride go through the SIMD kernels.
+         *
+         */
+        template <typename Op, size_t N, typename T>
+        void scalar_op(const Execution_policy &policy, const Matrix_slice<N> &s, T *base, const T &val)
+        {
+            MAT_TELEMETRY_SCOPE(scalar_op, s, sizeof(T));
+            const Segments<N> g(s);
+            parallel_chunks(policy, s.size, [&](size_t first, size_t last)
+                            { for_each_run(g, base, first, last, [&](T *q, size_t len, size_t stride)
+                                           {
+                                               if (stride == 1)
+                                                   simd_scalar_op<Op>(q, len, val);
+                                               else
+                                                   for (size_t i = 0; i < len; ++i)
+                                                       Op::run(q[i * stride], val); }); });
+        }
+    };
+
+    namespace Matrix_impl
+    {
+        /**
+         * @brief Random access iterator over the elements described by a `Matrix_slice`, in row-major order.
+         *        `T` is const-qualified for a const iterator.
+         * @note Incrementing advances the pointer by the innermost stride and only carries into an outer dimension
+         *       when an extent wraps; jumps and distances go through the linear position. The extents and strides
+         *       are copied, so the iterator stays valid after the `Matrix_ref` it came from is destroyed.
+         */
+        template <typename T, size_t N>
+        class Slice_iterator
+        {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = typename std::remove_const<T>::type;
+            using pointer = T *;
+            using reference = T &;
+
+            Slice_iterator() = default;
+
+            Slice_iterator(const Matrix_slice<N> &s, T *data, size_t pos = 0)
+                : extents(s.extents), strides(s.strides), base(data + s.start)
+            {
+                seek(pos);
+            }
+
+            // Conversion from the non-const iterator
+            template <typename U, typename = Enable_if<std::is_same<const U, T>::value, void>>
+            Slice_iterator(const Slice_iterator<U, N> &x)
+                : extents(x.extents), strides(x.strides), cursor(x.cursor), base(x.base), ptr(x.ptr), pos(x.pos) {}
+
+            reference operator*() const { return *ptr; }
+            pointer operator->() const { return ptr; }
+            reference operator[](difference_type n) const { return *(*this + n); }
+
+            Slice_iterator &operator++()
+            {
+                ++pos;
+                for (size_t d = N - 1; d > 0; --d)
+                {
+                    if (++cursor[d] < extents[d])
+                    {
+                        ptr += strides[d];
+                        return *this;
+                    }
+                    ptr -= (extents[d] - 1) * strides[d];
+                    cursor[d] = 0;
+                }
+                ++cursor[0]; // the outermost dimension does not wrap, which yields the end position
+                ptr += strides[0];
+                return *this;
+            }
+
+            Slice_iterator &operator--()
+            {
+                --pos;
+                for (size_t d = N - 1; d > 0; --d)
+                {
+                    if (cursor[d]-- > 0)
+                    {
+                        ptr -= strides[d];
+                        return *this;
+                    }
+                    cursor[d] = extents[d] - 1;
+                    ptr += cursor[d] * strides[d];
+                }
+                --cursor[0];
+                ptr -= strides[0];
+                return *this;
+            }
+
+            Slice_iterator operator++(int)
+            {
+                Slice_iterator tmp = *this;
+                ++(*this);
+                return tmp;
+            }
+
+            Slice_iterator operator--(int)
+            {
+                Slice_iterator tmp = *this;
+                --(*this);
+                return tmp;
+            }
+
+            Slice_iterator &operator+=(difference_type n)
+            {
+                seek(size_t(difference_type(pos) + n));
+                return *this;
+            }
+            Slice_iterator &operator-=(difference_type n) { return *this += -n; }
+
+            friend Slice_iterator operator+(Slice_iterator it, difference_type n) { return it += n; }
+            friend Slice_iterator operator+(difference_type n, Slice_iterator it) { return it += n; }
+            friend Slice_iterator operator-(Slice_iterator it, difference_type n) { return it -= n; }
+            friend difference_type operator-(const Slice_iterator &a, const Slice_iterator &b)
+            {
+                return difference_type(a.pos) - difference_type(b.pos);
+            }
+
+            friend bool operator==(const Slice_iterator &a, const Slice_iterator &b) { return a.pos == b.pos; }
+            friend bool operator!=(const Slice_iterator &a, const Slice_iterator &b) { return a.pos != b.pos; }
+            friend bool operator<(const Slice_iterator &a, const Slice_iterator &b) { return a.pos < b.pos; }
+            friend bool operator>(const Slice_iterator &a, const Slice_iterator &b) { return a.pos > b.pos; }
+            friend bool operator<=(const Slice_iterator &a, const Slice_iterator &b) { return a.pos <= b.pos; }
+            friend bool operator>=(const Slice_iterator &a, const Slice_iterator &b) { return a.pos >= b.pos; }
+
+        private:
+            template <typename U, size_t M>
+            friend class Slice_iterator;
+
+            /**
+             * @brief Move to the linear position `n`, recomputing the cursor from the extents.
+             *
+             */
+            void seek(size_t n)
+            {
+                pos = n;
+                ptr = base;
+                cursor = {};
+                if (n == 0) // also covers the empty slices, whose extents may be zero
+                    return;
+                for (size_t d = N - 1; d > 0; --d)
+                {
+                    cursor[d] = n % extents[d], n /= extents[d];
+                    ptr += cursor[d] * strides[d];
+                }
+                cursor[0] = n;
+                ptr += n * strides[0];
+            }
+
+            std::array<size_t, N> extents{};
+            std::array<size_t, N> strides{};
+            std::array<size_t, N> cursor{}; // the current position in each dimension
+            T *base = nullptr;              // the first element
+            T *ptr = nullptr;               // the current element
+            size_t pos = 0;                 // the linear position, in row-major order
+        };
+
+        struct Expr_tag // base of the nodes of an element-wise expression, see mat_expr.hpp
+        {
+        };
+
+        template <typename E>
+        using Is_expr = std::is_base_of<Expr_tag, E>;
+
+        template <typename E, size_t N, typename T>
+        void eval_into(const E &e, const Matrix_slice<N> &s, T *base);
+
+        template <typename E, size_t N, typename T>
+        bool aliases_destination(const E &e, const Matrix_slice<N> &s, const T *base);
+    };
+
     /**
      * @brief A base for matrices
      *
@@ -528,7 +1073,7 @@ namespace utils
                 return desc.extents[1];
         }
         size_t size() const { return desc.size; }
-        const Matrix_slice<N> descriptor() const { return desc; }
+        const Matrix_slice<N> &descriptor() const { return desc; }
 
         // Arithmetics template <typename F>
     };
@@ -559,6 +1104,17 @@ namespace utils
             Matrix_base<T, N>::desc = s;
         }
 
+        /**
+         * @brief Evaluate an element-wise expression into the referenced elements.
+         *
+         */
+        template <typename E>
+        Enable_if<Matrix_impl::Is_expr<E>::value, Matrix_ref &> operator=(const E &e)
+        {
+            Matrix_impl::eval_into(e, Matrix_base<T, N>::desc, data());
+            return *this;
+        }
+
         // properties
 
         virtual T *data()
@@ -574,6 +1130,7 @@ namespace utils
             assert(n < (Matrix_base<T, N>::rows()));
             Matrix_slice<N - 1> row;
             Matrix_impl::slice_dim<0>(n, Matrix_base<T, N>::desc, row);
+            MAT_TELEMETRY_SCOPE(slice, row, sizeof(T));
             // std::cerr << "(Matrix ref row: " << Matrix_base<T, N>::desc.start << ")";
             return Matrix_ref<T, N - 1>(row, data());
         }
@@ -583,6 +1140,7 @@ namespace utils
             assert(n < (Matrix_base<T, N>::columns()));
             Matrix_slice<N - 1> column;
             Matrix_impl::slice_dim<1>(n, Matrix_base<T, N>::desc, column);
+            MAT_TELEMETRY_SCOPE(slice, column, sizeof(T));
             return Matrix_ref<T, N - 1>(column, data());
         }
 
@@ -595,242 +1153,82 @@ namespace utils
             return *(data() + Matrix_base<T, N>::desc(dims...));
         }
 
-        // todo: implement iterators
-        // iterator
         /**
-         * @brief Matrix_ref_iterator that provide access to member elements that can be read/written.
-         * @note The end of this iterator is determined by its degree, with the cursor at the end having its maximum degree exceeded one more.
+         * @brief A view of the elements selected by one `Slice` or index per dimension, e.g. `m(Slice(0, 10, 2), 3)`.
+         *        Indexed dimensions are kept with extent 1.
          *
          */
-        class Matrix_ref_iterator
+        template <typename... Dims>
+        Enable_if<Matrix_impl::Requesting_slice<Dims...>(), Matrix_ref<T, N>> operator()(const Dims &...dims)
         {
-        public:
-            using iterator_category = std::forward_iterator_tag; // Tag can impact the performance when used with STL algorithms
-            using difference_type = std::ptrdiff_t;
-            using value_type = T;
-            using pointer = T *;
-            using reference = T &;
-
-            Matrix_ref_iterator() = default;
-            Matrix_ref_iterator(Matrix_ref_iterator &&) = default;
-            Matrix_ref_iterator &operator=(Matrix_ref_iterator &&) = default;
-            Matrix_ref_iterator(Matrix_ref_iterator const &) = default;
-            Matrix_ref_iterator &operator=(Matrix_ref_iterator const &) = default;
-            ~Matrix_ref_iterator() = default;
-
-            // Initialize
-            Matrix_ref_iterator(const Matrix_slice<N> &slice, pointer start, std::array<size_t, N> cursor = {})
-                : slice(slice), start(start + slice.start), ptr(start + slice.start), cursor(cursor) {} // Initialize with steps
-
-            virtual reference operator*() const { return *ptr; }
-            virtual pointer operator->() { return ptr; }
-
-            // Prefix increment
-            virtual Matrix_ref_iterator &operator++()
-            {
-                // adjusting cursor
-                size_t step = N - 1;
-                bool overflow = false;
-                while (step >= 0)
-                {
-                    if (++cursor[step] >= slice.extents[step])
-                    {
-                        if (step == 0)
-                        {
-                            overflow = true;
-                            break;
-                        }
-                        else
-                        {
-                            cursor[step] = 0;
-                            --step;
-                        }
-                    }
-                    else
-                        break;
-                }
+            Matrix_slice<N> d = Matrix_impl::sub_slice(Matrix_base<T, N>::desc, dims...);
+            MAT_TELEMETRY_SCOPE(slice, d, sizeof(T));
+            return Matrix_ref<T, N>(d, data());
+        }
 
-                // calculate offset
-                size_t offset = std::inner_product(slice.strides.begin(), slice.strides.end(), cursor.begin(), 0);
-                ptr = start + offset;
-                return *this;
-            }
+        // iterators
+        using Matrix_ref_iterator = Matrix_impl::Slice_iterator<T, N>;
+        using Matrix_ref_const_iterator = Matrix_impl::Slice_iterator<const T, N>;
 
-            // Postfix increment
-            virtual Matrix_ref_iterator operator++(int)
-            {
-                Matrix_ref_iterator tmp = *this;
-                ++(*this);
-                return tmp;
-            }
+        Matrix_ref_iterator begin() { return Matrix_ref_iterator(Matrix_base<T, N>::desc, data()); }
+        Matrix_ref_iterator end() { return Matrix_ref_iterator(Matrix_base<T, N>::desc, data(), Matrix_base<T, N>::size()); }
 
-            friend bool operator==(const Matrix_ref_iterator &a, const Matrix_ref_iterator &b) { return a.cursor == b.cursor; }
-            friend bool operator!=(const Matrix_ref_iterator &a, const Matrix_ref_iterator &b) { return a.cursor != b.cursor; }
+        Matrix_ref_const_iterator begin() const { return cbegin(); }
+        Matrix_ref_const_iterator end() const { return cend(); }
 
-        private:
-            const Matrix_slice<N> &slice;
-            std::array<size_t, N> cursor; // store the current position in this Matrix, 0 initialized.
-            pointer start = nullptr;
-            pointer ptr = nullptr;
-        };
+        Matrix_ref_const_iterator cbegin() const { return Matrix_ref_const_iterator(Matrix_base<T, N>::desc, data()); }
+        Matrix_ref_const_iterator cend() const { return Matrix_ref_const_iterator(Matrix_base<T, N>::desc, data(), Matrix_base<T, N>::size()); }
 
-        virtual Matrix_ref_iterator begin() { return Matrix_ref_iterator(Matrix_base<T, N>::desc, data()); }
-        virtual Matrix_ref_iterator end()
+        // Arithmetics
+        template <typename F>
+        auto &apply(F f)
         {
-            std::array<size_t, N> m_end{};
-            m_end[0] = Matrix_base<T, N>::desc.extents[0];
-            return Matrix_ref_iterator(Matrix_base<T, N>::desc, data(), std::move(m_end));
+            MAT_TELEMETRY_SCOPE(apply, this->descriptor(), sizeof(T));
+            const Matrix_impl::Segments<N> g(Matrix_base<T, N>::desc);
+            Matrix_impl::apply_strided(g, data(), 0, g.size, false, f);
+            return *this;
         }
 
-        // const iterator
         /**
-         * @brief Matrix_ref_const_iterator that provide access to member elements that can be read/written.
-         * @note The end of this iterator is determined by its degree, with the cursor at the end having its maximum degree exceeded one more.
+         * @brief Apply `f` to every element with the given execution policy.
          *
          */
-        class Matrix_ref_const_iterator
-        {
-        public:
-            using iterator_category = std::forward_iterator_tag; // Tag can impact the performance when used with STL algorithms
-            using difference_type = std::ptrdiff_t;
-            using value_type = const T;
-            using pointer = const T *;
-            using reference = const T &;
-
-            Matrix_ref_const_iterator() = default;
-            Matrix_ref_const_iterator(Matrix_ref_const_iterator &&) = default;
-            Matrix_ref_const_iterator &operator=(Matrix_ref_const_iterator &&) = default;
-            Matrix_ref_const_iterator(Matrix_ref_const_iterator const &) = default;
-            Matrix_ref_const_iterator &operator=(Matrix_ref_const_iterator const &) = default;
-            ~Matrix_ref_const_iterator() = default;
-
-            // Initialize
-            Matrix_ref_const_iterator(const Matrix_slice<N> &slice, pointer start, std::array<size_t, N> cursor = {})
-                : slice(slice), start(start + slice.start), ptr(start + slice.start), cursor(cursor) {} // Initialize with steps
-
-            virtual const reference operator*() const { return *ptr; }
-            virtual pointer operator->() { return ptr; }
-
-            // Prefix increment
-            virtual Matrix_ref_const_iterator &operator++()
-            {
-                // adjusting cursor
-                size_t step = N - 1;
-                bool overflow = false;
-                while (step >= 0)
-                {
-                    if (++cursor[step] >= slice.extents[step])
-                    {
-                        if (step == 0)
-                        {
-                            overflow = true;
-                            break;
-                        }
-                        else
-                        {
-                            cursor[step] = 0;
-                            --step;
-                        }
-                    }
-                    else
-                        break;
-                }
-
-                // calculate offset
-                size_t offset = std::inner_product(slice.strides.begin(), slice.strides.end(), cursor.begin(), 0);
-                ptr = start + offset;
-                return *this;
-            }
-
-            // Postfix increment
-            virtual Matrix_ref_const_iterator operator++(int)
-            {
-                Matrix_ref_const_iterator tmp = *this;
-                ++(*this);
-                return tmp;
-            }
-
-            friend bool operator==(const Matrix_ref_const_iterator &a, const Matrix_ref_const_iterator &b) { return a.cursor == b.cursor; }
-            friend bool operator!=(const Matrix_ref_const_iterator &a, const Matrix_ref_const_iterator &b) { return a.cursor != b.cursor; }
-
-        private:
-            const Matrix_slice<N> &slice;
-            std::array<size_t, N> cursor; // store the current position in this Matrix, 0 initialized.
-            pointer start = nullptr;
-            pointer ptr = nullptr;
-        };
-
-        virtual Matrix_ref_const_iterator cbegin() const { return Matrix_ref_const_iterator(Matrix_base<T, N>::desc, data()); }
-        virtual Matrix_ref_const_iterator cend() const
-        {
-            std::array<size_t, N> m_end{};
-            m_end[0] = Matrix_base<T, N>::desc.extents[0];
-            return Matrix_ref_const_iterator(Matrix_base<T, N>::desc, data(), std::move(m_end));
-        }
-
-        // Arithmetics
         template <typename F>
-        auto &apply(F f)
-        {
-            for (auto &x : (*this))
-                f(x);
+        auto &apply(const Execution_policy &policy, F f)
+        {
+            MAT_TELEMETRY_SCOPE(apply, this->descriptor(), sizeof(T));
+            const Matrix_impl::Segments<N> g(Matrix_base<T, N>::desc);
+            T *p = data();
+            const bool unseq = policy.kind == Execution_policy::parallel_unsequenced;
+            Matrix_impl::parallel_chunks(policy, g.size, [&](size_t first, size_t last)
+                                         { Matrix_impl::apply_strided(g, p, first, last, unseq, f); });
             return *this;
         }
 
         auto &operator+=(const T &val)
         {
-            return apply([&](T &a)
-                         { a += val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_add>(execution::par_unseq, Matrix_base<T, N>::desc, data(), val);
+            return *this;
         }
         auto &operator-=(const T &val)
         {
-            return apply([&](T &a)
-                         { a -= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_sub>(execution::par_unseq, Matrix_base<T, N>::desc, data(), val);
+            return *this;
         }
         auto &operator*=(const T &val)
         {
-            return apply([&](T &a)
-                         { a *= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_mul>(execution::par_unseq, Matrix_base<T, N>::desc, data(), val);
+            return *this;
         }
         auto &operator/=(const T &val)
         {
-            return apply([&](T &a)
-                         { a /= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_div>(execution::par_unseq, Matrix_base<T, N>::desc, data(), val);
+            return *this;
         }
         auto &operator%=(const T &val)
         {
-            return apply([&](T &a)
-                         { a %= val; });
-        }
-        friend auto &operator+(const Matrix_ref<T, N> &m, const T &val)
-        {
-            Matrix<T, N> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator-(const Matrix_ref<T, N> &m, const T &val)
-        {
-            Matrix<T, N> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator*(const Matrix_ref<T, N> &m, const T &val)
-        {
-            Matrix<T, N> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator/(const Matrix_ref<T, N> &m, const T &val)
-        {
-            Matrix<T, N> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator%(const Matrix_ref<T, N> &m, const T &val)
-        {
-            Matrix<T, N> res = m;
-            res += val;
-            return res;
+            return apply(execution::par_unseq, [&](T &a)
+                                               { a %= val; });
         }
     };
 
@@ -853,6 +1251,17 @@ namespace utils
             Matrix_base<T, 1>::desc = s;
         }
 
+        /**
+         * @brief Evaluate an element-wise expression into the referenced elements.
+         *
+         */
+        template <typename E>
+        Enable_if<Matrix_impl::Is_expr<E>::value, Matrix_ref &> operator=(const E &e)
+        {
+            Matrix_impl::eval_into(e, Matrix_base<T, 1>::desc, data());
+            return *this;
+        }
+
         // properties
 
         virtual T *data() { return ptr; };
@@ -875,241 +1284,81 @@ namespace utils
             assert(Matrix_impl::check_bounds(Matrix_base<T, 1>::desc, dims...));
             return *(data() + Matrix_base<T, 1>::desc(dims...));
         }
-        // todo: implement iterators
+
         /**
-         * @brief Matrix_ref_iterator that provide access to member elements that can be read/written.
-         * @note The end of this iterator is determined by its degree, with the cursor at the end having its maximum degree exceeded one more.
+         * @brief A view of the elements selected by a `Slice`, e.g. `v(Slice(0, 10, 2))`.
          *
          */
-        class Matrix_ref_iterator
+        template <typename... Dims>
+        Enable_if<Matrix_impl::Requesting_slice<Dims...>(), Matrix_ref<T, 1>> operator()(const Dims &...dims)
         {
-        public:
-            using iterator_category = std::forward_iterator_tag; // Tag can impact the performance when used with STL algorithms
-            using difference_type = std::ptrdiff_t;
-            using value_type = T;
-            using pointer = T *;
-            using reference = T &;
-
-            Matrix_ref_iterator() = default;
-            Matrix_ref_iterator(Matrix_ref_iterator &&) = default;
-            Matrix_ref_iterator &operator=(Matrix_ref_iterator &&) = default;
-            Matrix_ref_iterator(Matrix_ref_iterator const &) = default;
-            Matrix_ref_iterator &operator=(Matrix_ref_iterator const &) = default;
-            ~Matrix_ref_iterator() = default;
-
-            // Initialize
-            Matrix_ref_iterator(const Matrix_slice<1> &slice, pointer start, std::array<size_t, 1> cursor = {})
-                : slice(slice), start(start), ptr(start), cursor(cursor) {} // Initialize with steps
-
-            virtual reference operator*() const { return *ptr; }
-            virtual pointer operator->() { return ptr; }
-
-            // Prefix increment
-            virtual Matrix_ref_iterator &operator++()
-            {
-                // adjusting cursor
-                size_t step = 0;
-                bool overflow = false;
-                while (step >= 0)
-                {
-                    if (++cursor[step] >= slice.extents[step])
-                    {
-                        if (step == 0)
-                        {
-                            overflow = true;
-                            break;
-                        }
-                        else
-                        {
-                            cursor[step] = 0;
-                            --step;
-                        }
-                    }
-                    else
-                        break;
-                }
-
-                // calculate offset
-                size_t offset = std::inner_product(slice.strides.begin(), slice.strides.end(), cursor.begin(), 0);
-                ptr = start + offset;
-                return *this;
-            }
+            Matrix_slice<1> d = Matrix_impl::sub_slice(Matrix_base<T, 1>::desc, dims...);
+            MAT_TELEMETRY_SCOPE(slice, d, sizeof(T));
+            return Matrix_ref<T, 1>(d, data());
+        }
+        // iterators
+        using Matrix_ref_iterator = Matrix_impl::Slice_iterator<T, 1>;
+        using Matrix_ref_const_iterator = Matrix_impl::Slice_iterator<const T, 1>;
 
-            // Postfix increment
-            virtual Matrix_ref_iterator operator++(int)
-            {
-                Matrix_ref_iterator tmp = *this;
-                ++(*this);
-                return tmp;
-            }
+        Matrix_ref_iterator begin() { return Matrix_ref_iterator(Matrix_base<T, 1>::desc, data()); }
+        Matrix_ref_iterator end() { return Matrix_ref_iterator(Matrix_base<T, 1>::desc, data(), Matrix_base<T, 1>::size()); }
 
-            friend bool operator==(const Matrix_ref_iterator &a, const Matrix_ref_iterator &b) { return a.cursor == b.cursor; }
-            friend bool operator!=(const Matrix_ref_iterator &a, const Matrix_ref_iterator &b) { return a.cursor != b.cursor; }
+        Matrix_ref_const_iterator begin() const { return cbegin(); }
+        Matrix_ref_const_iterator end() const { return cend(); }
 
-        private:
-            const Matrix_slice<1> &slice;
-            std::array<size_t, 1> cursor; // store the current position in this Matrix, 0 initialized.
-            pointer start = nullptr;
-            pointer ptr = nullptr;
-        };
+        Matrix_ref_const_iterator cbegin() const { return Matrix_ref_const_iterator(Matrix_base<T, 1>::desc, data()); }
+        Matrix_ref_const_iterator cend() const { return Matrix_ref_const_iterator(Matrix_base<T, 1>::desc, data(), Matrix_base<T, 1>::size()); }
 
-        virtual Matrix_ref_iterator begin() { return Matrix_ref_iterator(Matrix_base<T, 1>::desc, data()); }
-        virtual Matrix_ref_iterator end()
+        // Arithmetics
+        template <typename F>
+        auto &apply(F f)
         {
-            std::array<size_t, 1> m_end{};
-            m_end[0] = Matrix_base<T, 1>::desc.extents[0];
-            return Matrix_ref_iterator(Matrix_base<T, 1>::desc, data(), std::move(m_end));
+            MAT_TELEMETRY_SCOPE(apply, this->descriptor(), sizeof(T));
+            const Matrix_impl::Segments<1> g(Matrix_base<T, 1>::desc);
+            Matrix_impl::apply_strided(g, data(), 0, g.size, false, f);
+            return *this;
         }
 
-        // const iterator
         /**
-         * @brief Matrix_ref_const_iterator that provide access to member elements that can be read/written.
-         * @note The end of this iterator is determined by its degree, with the cursor at the end having its maximum degree exceeded one more.
+         * @brief Apply `f` to every element with the given execution policy.
          *
          */
-        class Matrix_ref_const_iterator
-        {
-        public:
-            using iterator_category = std::forward_iterator_tag; // Tag can impact the performance when used with STL algorithms
-            using difference_type = std::ptrdiff_t;
-            using value_type = const T;
-            using pointer = const T *;
-            using reference = const T &;
-
-            Matrix_ref_const_iterator() = default;
-            Matrix_ref_const_iterator(Matrix_ref_const_iterator &&) = default;
-            Matrix_ref_const_iterator &operator=(Matrix_ref_const_iterator &&) = default;
-            Matrix_ref_const_iterator(Matrix_ref_const_iterator const &) = default;
-            Matrix_ref_const_iterator &operator=(Matrix_ref_const_iterator const &) = default;
-            ~Matrix_ref_const_iterator() = default;
-
-            // Initialize
-            Matrix_ref_const_iterator(const Matrix_slice<1> &slice, pointer start, std::array<size_t, 1> cursor = {})
-                : slice(slice), start(start + slice.start), ptr(start + slice.start), cursor(cursor) {} // Initialize with steps
-
-            virtual const reference operator*() const { return *ptr; }
-            virtual pointer operator->() { return ptr; }
-
-            // Prefix increment
-            virtual Matrix_ref_const_iterator &operator++()
-            {
-                // adjusting cursor
-                size_t step = 0;
-                bool overflow = false;
-                while (step >= 0)
-                {
-                    if (++cursor[step] >= slice.extents[step])
-                    {
-                        if (step == 0)
-                        {
-                            overflow = true;
-                            break;
-                        }
-                        else
-                        {
-                            cursor[step] = 0;
-                            --step;
-                        }
-                    }
-                    else
-                        break;
-                }
-
-                // calculate offset
-                size_t offset = std::inner_product(slice.strides.begin(), slice.strides.end(), cursor.begin(), 0);
-                ptr = start + offset;
-                return *this;
-            }
-
-            // Postfix increment
-            virtual Matrix_ref_const_iterator operator++(int)
-            {
-                Matrix_ref_const_iterator tmp = *this;
-                ++(*this);
-                return tmp;
-            }
-
-            friend bool operator==(const Matrix_ref_const_iterator &a, const Matrix_ref_const_iterator &b) { return a.cursor == b.cursor; }
-            friend bool operator!=(const Matrix_ref_const_iterator &a, const Matrix_ref_const_iterator &b) { return a.cursor != b.cursor; }
-
-        private:
-            const Matrix_slice<1> &slice;
-            std::array<size_t, 1> cursor; // store the current position in this Matrix, 0 initialized.
-            pointer start = nullptr;
-            pointer ptr = nullptr;
-        };
-
-        virtual Matrix_ref_const_iterator cbegin() const { return Matrix_ref_const_iterator(Matrix_base<T, 1>::desc, data()); }
-        virtual Matrix_ref_const_iterator cend() const
-        {
-            std::array<size_t, 1> m_end{};
-            m_end[0] = Matrix_base<T, 1>::desc.extents[0];
-            return Matrix_ref_const_iterator(Matrix_base<T, 1>::desc, data(), std::move(m_end));
-        }
-
-        // Arithmetics
         template <typename F>
-        auto &apply(F f)
-        {
-            for (auto &x : (*this))
-                f(x);
+        auto &apply(const Execution_policy &policy, F f)
+        {
+            MAT_TELEMETRY_SCOPE(apply, this->descriptor(), sizeof(T));
+            const Matrix_impl::Segments<1> g(Matrix_base<T, 1>::desc);
+            T *p = data();
+            const bool unseq = policy.kind == Execution_policy::parallel_unsequenced;
+            Matrix_impl::parallel_chunks(policy, g.size, [&](size_t first, size_t last)
+                                         { Matrix_impl::apply_strided(g, p, first, last, unseq, f); });
             return *this;
         }
 
         auto &operator+=(const T &val)
         {
-            return apply([&](T &a)
-                         { a += val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_add>(execution::par_unseq, Matrix_base<T, 1>::desc, data(), val);
+            return *this;
         }
         auto &operator-=(const T &val)
         {
-            return apply([&](T &a)
-                         { a -= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_sub>(execution::par_unseq, Matrix_base<T, 1>::desc, data(), val);
+            return *this;
         }
         auto &operator*=(const T &val)
         {
-            return apply([&](T &a)
-                         { a *= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_mul>(execution::par_unseq, Matrix_base<T, 1>::desc, data(), val);
+            return *this;
         }
         auto &operator/=(const T &val)
         {
-            return apply([&](T &a)
-                         { a /= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_div>(execution::par_unseq, Matrix_base<T, 1>::desc, data(), val);
+            return *this;
         }
         auto &operator%=(const T &val)
         {
-            return apply([&](T &a)
-                         { a %= val; });
-        }
-        friend auto &operator+(const Matrix_ref<T, 1> &m, const T &val)
-        {
-            Matrix_ref<T, 1> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator-(const Matrix_ref<T, 1> &m, const T &val)
-        {
-            Matrix_ref<T, 1> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator*(const Matrix_ref<T, 1> &m, const T &val)
-        {
-            Matrix_ref<T, 1> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator/(const Matrix_ref<T, 1> &m, const T &val)
-        {
-            Matrix_ref<T, 1> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator%(const Matrix_ref<T, 1> &m, const T &val)
-        {
-            Matrix_ref<T, 1> res = m;
-            res += val;
-            return res;
+            return apply(execution::par_unseq, [&](T &a)
+                                               { a %= val; });
         }
 
         template <typename F>
@@ -1209,49 +1458,47 @@ namespace utils
             return apply([&](T &a)
                          { a %= val; });
         }
-        friend auto &operator+(const Matrix_ref<T, 0> &m, const T &val)
+        friend Matrix<T, 0> operator+(const Matrix_ref<T, 0> &m, const T &val)
         {
-            Matrix_ref<T, 0> res = m;
-            res += val;
-            return res;
+            return Matrix<T, 0>(m() + val);
         }
-        friend auto &operator-(const Matrix_ref<T, 0> &m, const T &val)
+        friend Matrix<T, 0> operator-(const Matrix_ref<T, 0> &m, const T &val)
         {
-            Matrix_ref<T, 0> res = m;
-            res += val;
-            return res;
+            return Matrix<T, 0>(m() - val);
         }
-        friend auto &operator*(const Matrix_ref<T, 0> &m, const T &val)
+        friend Matrix<T, 0> operator*(const Matrix_ref<T, 0> &m, const T &val)
         {
-            Matrix_ref<T, 0> res = m;
-            res += val;
-            return res;
+            return Matrix<T, 0>(m() * val);
         }
-        friend auto &operator/(const Matrix_ref<T, 0> &m, const T &val)
+        friend Matrix<T, 0> operator/(const Matrix_ref<T, 0> &m, const T &val)
         {
-            Matrix_ref<T, 0> res = m;
-            res += val;
-            return res;
+            return Matrix<T, 0>(m() / val);
         }
-        friend auto &operator%(const Matrix_ref<T, 0> &m, const T &val)
+        friend Matrix<T, 0> operator%(const Matrix_ref<T, 0> &m, const T &val)
         {
-            Matrix_ref<T, 0> res = m;
-            res += val;
-            return res;
+            return Matrix<T, 0>(m() % val);
         }
     };
 
-    template <typename T, size_t N>
+    /**
+     * @brief A matrix owning its elements, stored contiguously in row-major order.
+     *
+     * @tparam T
+     * @tparam N
+     * @tparam Alloc the allocator of the storage, aligned to a cache line by default
+     */
+    template <typename T, size_t N, typename Alloc>
     class Matrix : public Matrix_base<T, N>
     {
     protected:
-        std::vector<T> elems; // storing the elements of the matrix
+        std::vector<T, Alloc> elems; // storing the elements of the matrix
 
     public:
         // variable properties
         using value_type = T;
-        using iterator = typename std::vector<T>::iterator;
-        using const_iterator = typename std::vector<T>::const_iterator;
+        using allocator_type = Alloc;
+        using iterator = typename std::vector<T, Alloc>::iterator;
+        using const_iterator = typename std::vector<T, Alloc>::const_iterator;
 
         // default constructors
 
@@ -1262,8 +1509,18 @@ namespace utils
         Matrix() = default;
         Matrix(Matrix &&) = default; // Move constructor
         Matrix &operator=(Matrix &&) = default;
-        Matrix(Matrix const &) = default;
-        Matrix &operator=(Matrix const &) = default;
+        Matrix(Matrix const &x) : Matrix_base<T, N>(x)
+        {
+            MAT_TELEMETRY_SCOPE(copy, x.descriptor(), sizeof(T));
+            elems = x.elems;
+        }
+        Matrix &operator=(Matrix const &x)
+        {
+            MAT_TELEMETRY_SCOPE(copy, x.descriptor(), sizeof(T));
+            Matrix_base<T, N>::operator=(x);
+            elems = x.elems;
+            return *this;
+        }
         ~Matrix() = default;
 
         /**
@@ -1273,23 +1530,24 @@ namespace utils
         template <typename U>
         Matrix(Matrix_ref<U, N> const &x)
         {
+            MAT_TELEMETRY_SCOPE(copy_from_ref, x.descriptor(), sizeof(T));
             assert((Convertible<T, U>()));
-            assert(Matrix_impl::same_extents(x.descriptor(), this->descriptor()));
-            elems.reserve(x.size());
-            elems.insert(elems.begin(), x.cbegin(), x.cend());
+            Matrix_base<T, N>::desc = x.descriptor().extents;
+            elems.resize(x.size());
+            Matrix_impl::gather(x.descriptor(), x.data(), elems.data());
         }
 
         /**
          * @brief
          *
          */
-        template <typename U>
-        Matrix(Matrix<U, N> const &x)
+        template <typename U, typename A>
+        Matrix(Matrix<U, N, A> const &x)
         {
+            MAT_TELEMETRY_SCOPE(copy, x.descriptor(), sizeof(T));
             assert((Convertible<T, U>()));
-            assert(Matrix_impl::same_extents(x.descriptor(), this->descriptor()));
-            elems.reserve(x.size());
-            elems.insert(elems.begin(), x.cbegin(), x.cend());
+            Matrix_base<T, N>::desc = x.descriptor().extents;
+            elems.assign(x.cbegin(), x.cend());
         }
 
         /**
@@ -1307,7 +1565,36 @@ namespace utils
             // std::cerr << "Matrix(Exts constructor): Slice created." << std::endl;
             Matrix_base<T, N>::desc.init_full_dim();
             // std::cerr << "Matrix(Exts constructor): Dimension initialized. The target size is " << Matrix_base<T, N>::desc.size << std::endl;
+            MAT_TELEMETRY_SCOPE(construct, Matrix_base<T, N>::desc, sizeof(T));
+            elems.resize(Matrix_base<T, N>::desc.size);
+        }
+
+        /**
+         * @brief Construct a new Matrix object by evaluating an element-wise expression in a single pass.
+         *
+         */
+        template <typename E, typename = Enable_if<Matrix_impl::Is_expr<E>::value, void>>
+        Matrix(const E &e)
+        {
+            Matrix_base<T, N>::desc = e.extents();
+            MAT_TELEMETRY_SCOPE(expr_eval, Matrix_base<T, N>::desc, sizeof(T));
             elems.resize(Matrix_base<T, N>::desc.size);
+            Matrix_impl::eval_into(e, Matrix_base<T, N>::desc, elems.data());
+        }
+
+        /**
+         * @brief Evaluate an element-wise expression in place, or into a new buffer moved in if the extents differ
+         *        or the expression reads this matrix through a view of another layout.
+         *
+         */
+        template <typename E>
+        Enable_if<Matrix_impl::Is_expr<E>::value, Matrix &> operator=(const E &e)
+        {
+            if (e.extents() != Matrix_base<T, N>::desc.extents ||
+                Matrix_impl::aliases_destination(e, Matrix_base<T, N>::desc, elems.data()))
+                return *this = Matrix(e);
+            Matrix_impl::eval_into(e, Matrix_base<T, N>::desc, elems.data());
+            return *this;
         }
 
         /**
@@ -1324,6 +1611,7 @@ namespace utils
             Matrix_base<T, N>::desc.extents = Matrix_impl::derive_extents<N>(init);
             Matrix_base<T, N>::desc.recalc_size();
             Matrix_base<T, N>::desc.init_full_dim();
+            MAT_TELEMETRY_SCOPE(construct, Matrix_base<T, N>::desc, sizeof(T));
             elems.reserve(Matrix_base<T, N>::desc.size);
             Matrix_impl::insert_flat(init, elems);
             assert((elems.size() == Matrix_base<T, N>::desc.size));
@@ -1347,6 +1635,7 @@ namespace utils
             assert(n < (Matrix_base<T, N>::rows()));
             Matrix_slice<N - 1> row;
             Matrix_impl::slice_dim<0>(n, Matrix_base<T, N>::desc, row);
+            MAT_TELEMETRY_SCOPE(slice, row, sizeof(T));
             // std::cerr << "(Matrix src row: " << Matrix_base<T, N>::desc.start << ")";
             return Matrix_ref<T, N - 1>(row, data());
         }
@@ -1356,6 +1645,7 @@ namespace utils
             assert(n < (Matrix_base<T, N>::columns()));
             Matrix_slice<N - 1> column;
             Matrix_impl::slice_dim<1>(n, Matrix_base<T, N>::desc, column);
+            MAT_TELEMETRY_SCOPE(slice, column, sizeof(T));
             return Matrix_ref<T, N - 1>(column, data());
         }
 
@@ -1368,106 +1658,109 @@ namespace utils
             return *(data() + Matrix_base<T, N>::desc(dims...));
         }
 
-        // template <typename... Dims>
-        // Enable_if<Matrix_impl::Requesting_slice<Dims...>(), Matrix_ref<T, N>> operator()(const Dims &...dims)
-        // {
-        //     Matrix_slice<N> d;
-        //     d.start = Matrix_impl::do_slice(Matrix_base<T, N>::desc, d, dims...);
-        //     d.recalc_size();
-        //     return Matrix_ref{d, data()};
-        // }
+        /**
+         * @brief A view of the elements selected by one `Slice` or index per dimension, e.g. `m(Slice(0, 10, 2), 3)`.
+         *        Indexed dimensions are kept with extent 1.
+         *
+         */
+        template <typename... Dims>
+        Enable_if<Matrix_impl::Requesting_slice<Dims...>(), Matrix_ref<T, N>> operator()(const Dims &...dims)
+        {
+            Matrix_slice<N> d = Matrix_impl::sub_slice(Matrix_base<T, N>::desc, dims...);
+            MAT_TELEMETRY_SCOPE(slice, d, sizeof(T));
+            return Matrix_ref<T, N>(d, data());
+        }
 
         // iterator
         iterator begin() { return elems.begin(); }
         iterator end() { return elems.end(); }
 
-        iterator cbegin() const { return elems.cbegin(); }
-        iterator cend() const { return elems.cend(); }
+        const_iterator begin() const { return elems.cbegin(); }
+        const_iterator end() const { return elems.cend(); }
+
+        const_iterator cbegin() const { return elems.cbegin(); }
+        const_iterator cend() const { return elems.cend(); }
 
         // Arithmetics
         template <typename F>
         auto &apply(F f)
         {
-            for (auto &x : (*this))
-                f(x);
+            MAT_TELEMETRY_SCOPE(apply, this->descriptor(), sizeof(T));
+            Matrix_impl::apply_contiguous(elems.data(), 0, elems.size(), false, f);
+            return *this;
+        }
+
+        /**
+         * @brief Apply `f` to every element with the given execution policy.
+         *
+         */
+        template <typename F>
+        auto &apply(const Execution_policy &policy, F f)
+        {
+            MAT_TELEMETRY_SCOPE(apply, this->descriptor(), sizeof(T));
+            T *p = data();
+            const bool unseq = policy.kind == Execution_policy::parallel_unsequenced;
+            Matrix_impl::parallel_chunks(policy, elems.size(), [&](size_t first, size_t last)
+                                         { Matrix_impl::apply_contiguous(p, first, last, unseq, f); });
             return *this;
         }
 
         auto &operator+=(const T &val)
         {
-            return apply([&](T &a)
-                         { a += val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_add>(execution::par_unseq, elems.data(), elems.size(), val);
+            return *this;
         }
         auto &operator-=(const T &val)
         {
-            return apply([&](T &a)
-                         { a -= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_sub>(execution::par_unseq, elems.data(), elems.size(), val);
+            return *this;
         }
         auto &operator*=(const T &val)
         {
-            return apply([&](T &a)
-                         { a *= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_mul>(execution::par_unseq, elems.data(), elems.size(), val);
+            return *this;
         }
         auto &operator/=(const T &val)
         {
-            return apply([&](T &a)
-                         { a /= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_div>(execution::par_unseq, elems.data(), elems.size(), val);
+            return *this;
         }
         auto &operator%=(const T &val)
         {
-            return apply([&](T &a)
-                         { a %= val; });
-        }
-        friend auto &operator+(const Matrix<T, N> &m, const T &val)
-        {
-            Matrix<T, N> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator-(const Matrix<T, N> &m, const T &val)
-        {
-            Matrix<T, N> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator*(const Matrix<T, N> &m, const T &val)
-        {
-            Matrix<T, N> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator/(const Matrix<T, N> &m, const T &val)
-        {
-            Matrix<T, N> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator%(const Matrix<T, N> &m, const T &val)
-        {
-            Matrix<T, N> res = m;
-            res += val;
-            return res;
+            return apply(execution::par_unseq, [&](T &a)
+                                               { a %= val; });
         }
     };
 
-    template <typename T>
-    class Matrix<T, 1> : public Matrix_base<T, 1>
+    template <typename T, typename Alloc>
+    class Matrix<T, 1, Alloc> : public Matrix_base<T, 1>
     {
     protected:
-        std::vector<T> elems;
+        std::vector<T, Alloc> elems;
 
     public:
         // variable properties
         using value_type = T;
-        using iterator = typename std::vector<T>::iterator;
-        using const_iterator = typename std::vector<T>::const_iterator;
+        using allocator_type = Alloc;
+        using iterator = typename std::vector<T, Alloc>::iterator;
+        using const_iterator = typename std::vector<T, Alloc>::const_iterator;
 
         // default constructors
         Matrix() = default;
         Matrix(Matrix &&) = default; // Move constructor
         Matrix &operator=(Matrix &&) = default;
-        Matrix(Matrix const &) = default;
-        Matrix &operator=(Matrix const &) = default;
+        Matrix(Matrix const &x) : Matrix_base<T, 1>(x)
+        {
+            MAT_TELEMETRY_SCOPE(copy, x.descriptor(), sizeof(T));
+            elems = x.elems;
+        }
+        Matrix &operator=(Matrix const &x)
+        {
+            MAT_TELEMETRY_SCOPE(copy, x.descriptor(), sizeof(T));
+            Matrix_base<T, 1>::operator=(x);
+            elems = x.elems;
+            return *this;
+        }
         ~Matrix() = default;
 
         /**
@@ -1477,23 +1770,24 @@ namespace utils
         template <typename U>
         Matrix(Matrix_ref<U, 1> const &x)
         {
+            MAT_TELEMETRY_SCOPE(copy_from_ref, x.descriptor(), sizeof(T));
             assert((Convertible<T, U>()));
-            assert(Matrix_impl::same_extents(Matrix_base<T, 1>::desc, x.descriptor()));
-            elems.reserve(x.size());
-            elems.insert(elems.begin(), x.cbegin(), x.cend());
+            Matrix_base<T, 1>::desc = x.descriptor().extents;
+            elems.resize(x.size());
+            Matrix_impl::gather(x.descriptor(), x.data(), elems.data());
         }
 
         /**
          * @brief
          *
          */
-        template <typename U>
-        Matrix(Matrix<U, 1> const &x)
+        template <typename U, typename A>
+        Matrix(Matrix<U, 1, A> const &x)
         {
+            MAT_TELEMETRY_SCOPE(copy, x.descriptor(), sizeof(T));
             assert((Convertible<T, U>()));
-            assert(Matrix_impl::same_extents(Matrix_base<T, 1>::desc, x.descriptor()));
-            elems.reserve(x.size());
-            elems.insert(elems.begin(), x.cbegin(), x.cend());
+            Matrix_base<T, 1>::desc = x.descriptor().extents;
+            elems.assign(x.cbegin(), x.cend());
         }
 
         /**
@@ -1509,7 +1803,36 @@ namespace utils
             // std::cerr << "Matrix(Exts constructor)" << std::endl;
             Matrix_base<T, 1>::desc = Matrix_slice<1>(exts...);
             Matrix_base<T, 1>::desc.init_full_dim();
+            MAT_TELEMETRY_SCOPE(construct, Matrix_base<T, 1>::desc, sizeof(T));
+            elems.resize(Matrix_base<T, 1>::desc.size);
+        }
+
+        /**
+         * @brief Construct a new Matrix object by evaluating an element-wise expression in a single pass.
+         *
+         */
+        template <typename E, typename = Enable_if<Matrix_impl::Is_expr<E>::value, void>>
+        Matrix(const E &e)
+        {
+            Matrix_base<T, 1>::desc = e.extents();
+            MAT_TELEMETRY_SCOPE(expr_eval, Matrix_base<T, 1>::desc, sizeof(T));
             elems.resize(Matrix_base<T, 1>::desc.size);
+            Matrix_impl::eval_into(e, Matrix_base<T, 1>::desc, elems.data());
+        }
+
+        /**
+         * @brief Evaluate an element-wise expression in place, or into a new buffer moved in if the extents differ
+         *        or the expression reads this matrix through a view of another layout.
+         *
+         */
+        template <typename E>
+        Enable_if<Matrix_impl::Is_expr<E>::value, Matrix &> operator=(const E &e)
+        {
+            if (e.extents() != Matrix_base<T, 1>::desc.extents ||
+                Matrix_impl::aliases_destination(e, Matrix_base<T, 1>::desc, elems.data()))
+                return *this = Matrix(e);
+            Matrix_impl::eval_into(e, Matrix_base<T, 1>::desc, elems.data());
+            return *this;
         }
 
         /**
@@ -1526,6 +1849,7 @@ namespace utils
             Matrix_base<T, 1>::desc.extents = Matrix_impl::derive_extents<1>(init);
             Matrix_base<T, 1>::desc.recalc_size();
             Matrix_base<T, 1>::desc.init_full_dim();
+            MAT_TELEMETRY_SCOPE(construct, Matrix_base<T, 1>::desc, sizeof(T));
             elems.reserve(Matrix_base<T, 1>::desc.size);
             Matrix_impl::insert_flat(init, elems);
             assert((elems.size() == Matrix_base<T, 1>::desc.size));
@@ -1562,12 +1886,27 @@ namespace utils
             return *(data() + Matrix_base<T, 1>::desc(dims...));
         }
 
+        /**
+         * @brief A view of the elements selected by a `Slice`, e.g. `v(Slice(0, 10, 2))`.
+         *
+         */
+        template <typename... Dims>
+        Enable_if<Matrix_impl::Requesting_slice<Dims...>(), Matrix_ref<T, 1>> operator()(const Dims &...dims)
+        {
+            Matrix_slice<1> d = Matrix_impl::sub_slice(Matrix_base<T, 1>::desc, dims...);
+            MAT_TELEMETRY_SCOPE(slice, d, sizeof(T));
+            return Matrix_ref<T, 1>(d, data());
+        }
+
         // iterators
         iterator begin() { return elems.begin(); }
         iterator end() { return elems.end(); }
 
-        iterator cbegin() const { return elems.cbegin(); }
-        iterator cend() const { return elems.cend(); }
+        const_iterator begin() const { return elems.cbegin(); }
+        const_iterator end() const { return elems.cend(); }
+
+        const_iterator cbegin() const { return elems.cbegin(); }
+        const_iterator cend() const { return elems.cend(); }
 
         // todo: Do specializations when N == 1
         // todo: copy implementation to Matrix_ref class
@@ -1581,70 +1920,55 @@ namespace utils
         template <typename F>
         auto &apply(F f)
         {
-            for (auto &x : (*this))
-                f(x);
+            MAT_TELEMETRY_SCOPE(apply, this->descriptor(), sizeof(T));
+            Matrix_impl::apply_contiguous(elems.data(), 0, elems.size(), false, f);
+            return *this;
+        }
+
+        /**
+         * @brief Apply `f` to every element with the given execution policy.
+         *
+         */
+        template <typename F>
+        auto &apply(const Execution_policy &policy, F f)
+        {
+            MAT_TELEMETRY_SCOPE(apply, this->descriptor(), sizeof(T));
+            T *p = data();
+            const bool unseq = policy.kind == Execution_policy::parallel_unsequenced;
+            Matrix_impl::parallel_chunks(policy, elems.size(), [&](size_t first, size_t last)
+                                         { Matrix_impl::apply_contiguous(p, first, last, unseq, f); });
             return *this;
         }
 
         auto &operator+=(const T &val)
         {
-            return apply([&](T &a)
-                         { a += val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_add>(execution::par_unseq, elems.data(), elems.size(), val);
+            return *this;
         }
         auto &operator-=(const T &val)
         {
-            return apply([&](T &a)
-                         { a -= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_sub>(execution::par_unseq, elems.data(), elems.size(), val);
+            return *this;
         }
         auto &operator*=(const T &val)
         {
-            return apply([&](T &a)
-                         { a *= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_mul>(execution::par_unseq, elems.data(), elems.size(), val);
+            return *this;
         }
         auto &operator/=(const T &val)
         {
-            return apply([&](T &a)
-                         { a /= val; });
+            Matrix_impl::scalar_op<Matrix_impl::Simd_div>(execution::par_unseq, elems.data(), elems.size(), val);
+            return *this;
         }
         auto &operator%=(const T &val)
         {
-            return apply([&](T &a)
-                         { a %= val; });
-        }
-        friend auto &operator+(const Matrix<T, 1> &m, const T &val)
-        {
-            Matrix<T, 1> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator-(const Matrix<T, 1> &m, const T &val)
-        {
-            Matrix<T, 1> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator*(const Matrix<T, 1> &m, const T &val)
-        {
-            Matrix<T, 1> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator/(const Matrix<T, 1> &m, const T &val)
-        {
-            Matrix<T, 1> res = m;
-            res += val;
-            return res;
-        }
-        friend auto &operator%(const Matrix<T, 1> &m, const T &val)
-        {
-            Matrix<T, 1> res = m;
-            res += val;
-            return res;
+            return apply(execution::par_unseq, [&](T &a)
+                                               { a %= val; });
         }
     };
 
-    template <typename T>
-    class Matrix<T, 0> : Matrix_base<T, 0>
+    template <typename T, typename Alloc>
+    class Matrix<T, 0, Alloc> : Matrix_base<T, 0>
     {
     private:
         T elem;
@@ -1721,38 +2045,56 @@ namespace utils
             return apply([&](T &a)
                          { a %= val; });
         }
-        friend auto &operator+(const Matrix<T, 0> &m, const T &val)
+        friend Matrix operator+(const Matrix &m, const T &val)
         {
-            Matrix<T, 0> res = m;
-            res += val;
-            return res;
+            return Matrix(m() + val);
         }
-        friend auto &operator-(const Matrix<T, 0> &m, const T &val)
+        friend Matrix operator-(const Matrix &m, const T &val)
         {
-            Matrix<T, 0> res = m;
-            res += val;
-            return res;
+            return Matrix(m() - val);
         }
-        friend auto &operator*(const Matrix<T, 0> &m, const T &val)
+        friend Matrix operator*(const Matrix &m, const T &val)
         {
-            Matrix<T, 0> res = m;
-            res += val;
-            return res;
+            return Matrix(m() * val);
         }
-        friend auto &operator/(const Matrix<T, 0> &m, const T &val)
+        friend Matrix operator/(const Matrix &m, const T &val)
         {
-            Matrix<T, 0> res = m;
-            res += val;
-            return res;
+            return Matrix(m() / val);
         }
-        friend auto &operator%(const Matrix<T, 0> &m, const T &val)
+        friend Matrix operator%(const Matrix &m, const T &val)
         {
-            Matrix<T, 0> res = m;
-            res += val;
-            return res;
+            return Matrix(m() % val);
         }
     };
 
+
+    /**
+     * @brief View the first `columns` columns of `storage`, whose rows are typically padded to a `leading_dimension`,
+     *        so that every row of the view starts at the alignment of the storage.
+     *
+     */
+    template <typename T, typename A>
+    Matrix_ref<T, 2> padded_view(Matrix<T, 2, A> &storage, size_t columns)
+    {
+        assert(columns <= storage.columns());
+        Matrix_slice<2> s(std::array<size_t, 2>{storage.rows(), columns});
+        s.strides[0] = storage.columns();
+        return Matrix_ref<T, 2>(s, storage.data());
+    }
 };
 
+// Extensions
+#include "mat_expr.hpp"
+#include "mat_gemm.hpp"
+#include "mat_static.hpp"
+#include "mat_mmap.hpp"
+#include "mat_io.hpp"
+#include "mat_stream.hpp"
+#include "mat_permute.hpp"
+#include "mat_reduce.hpp"
+#include "mat_einsum.hpp"
+#include "mat_sparse.hpp"
+#include "mat_conv.hpp"
+#include "mat_linalg.hpp"
+
 #endif
\ No newline at end of file
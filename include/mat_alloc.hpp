@@ -0,0 +1,356 @@
+/**
+ * @file mat_alloc.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the allocators used for the storage of `Matrix`. The default one aligns every buffer to a
+ *        cache line, so that the SIMD kernels never split a load across two lines at the start of a matrix.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_ALLOC_H
+#define MAT_ALLOC_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+#include "mat_telemetry.hpp"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifndef MAT_DEFAULT_ALIGNMENT
+#define MAT_DEFAULT_ALIGNMENT 64 // bytes, one cache line
+#endif
+
+namespace utils
+{
+    namespace Matrix_impl
+    {
+        constexpr size_t page_bytes = size_t(4) << 10;
+        constexpr size_t huge_page_bytes = size_t(2) << 20;
+
+        inline bool is_aligned(const void *p, size_t align) { return reinterpret_cast<std::uintptr_t>(p) % align == 0; }
+    };
+
+    /**
+     * @brief A standard allocator returning storage aligned to `Align` bytes. Buffers of at least `Align` bytes are
+     *        rounded up to a multiple of it, and buffers aligned to huge pages are advised to be backed by them.
+     *
+     * @tparam T
+     * @tparam Align a power of two, not less than `alignof(T)`
+     * @note Elements are value-initialized by the containers as usual; only the placement of the buffer changes.
+     */
+    template <typename T, size_t Align = MAT_DEFAULT_ALIGNMENT>
+    class Aligned_allocator
+    {
+        static_assert(Align > 0 && (Align & (Align - 1)) == 0, "the alignment must be a power of two");
+        static_assert(Align >= alignof(T), "the alignment must not be weaker than that of the element type");
+
+    public:
+        using value_type = T;
+        using size_type = size_t;
+        using difference_type = std::ptrdiff_t;
+        using propagate_on_container_move_assignment = std::true_type;
+        using is_always_equal = std::true_type;
+
+        static constexpr size_t alignment = Align;
+
+        template <typename U>
+        struct rebind
+        {
+            using other = Aligned_allocator<U, (Align < alignof(U) ? alignof(U) : Align)>;
+        };
+
+        Aligned_allocator() noexcept = default;
+
+        template <typename U, size_t A2>
+        Aligned_allocator(const Aligned_allocator<U, A2> &) noexcept {}
+
+        T *allocate(size_t n)
+        {
+            if (n > std::numeric_limits<size_t>::max() / sizeof(T))
+                throw std::bad_array_new_length();
+            size_t bytes = n * sizeof(T);
+            if (bytes >= Align)
+                bytes = (bytes + Align - 1) / Align * Align;
+            void *p = ::operator new(bytes, std::align_val_t(Align));
+            MAT_TELEMETRY_ALLOC(bytes);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+            if (Align >= Matrix_impl::huge_page_bytes && bytes >= Matrix_impl::huge_page_bytes)
+                madvise(p, bytes, MADV_HUGEPAGE); // a hint only, failure is harmless
+#endif
+            return static_cast<T *>(p);
+        }
+
+        void deallocate(T *p, size_t) noexcept
+        {
+            MAT_TELEMETRY_FREE();
+            ::operator delete(p, std::align_val_t(Align));
+        }
+
+        template <typename U, size_t A2>
+        bool operator==(const Aligned_allocator<U, A2> &) const noexcept { return Align == A2; }
+        template <typename U, size_t A2>
+        bool operator!=(const Aligned_allocator<U, A2> &) const noexcept { return Align != A2; }
+    };
+
+    template <typename T>
+    using Page_aligned_allocator = Aligned_allocator<T, Matrix_impl::page_bytes>;
+
+    template <typename T>
+    using Huge_page_allocator = Aligned_allocator<T, Matrix_impl::huge_page_bytes>;
+
+    /**
+     * @brief The smallest row length, in elements, not less than `n` whose rows of `T` stay aligned to `align` bytes.
+     *        Allocate a `Matrix<T, 2>` with this many columns and take a `padded_view` of it to get aligned rows.
+     *
+     */
+    template <typename T>
+    constexpr size_t leading_dimension(size_t n, size_t align = MAT_DEFAULT_ALIGNMENT)
+    {
+        return align % sizeof(T) != 0 ? n : (n + align / sizeof(T) - 1) / (align / sizeof(T)) * (align / sizeof(T));
+    }
+
+    /**
+     * @brief A bump arena with per-size free lists for short-lived matrices. Install it for a scope with
+     *        `Matrix_arena::Scope`; every `Arena_allocator` constructed on that thread inside the scope draws from it.
+     *        When the outermost scope ends the arena is reset: its blocks are coalesced into one, so that the next
+     *        round of the same computation allocates nothing from the system.
+     *
+     * @note Not thread-safe, and the matrices allocated from an arena must not outlive the scope that installed it.
+     */
+    class Matrix_arena
+    {
+    public:
+        /**
+         * @brief Installs an arena as the current one of this thread until the end of the scope.
+         *
+         */
+        class Scope
+        {
+        public:
+            explicit Scope(Matrix_arena &arena) : arena(arena), prev(current_ref())
+            {
+                ++arena.depth;
+                current_ref() = &arena;
+            }
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+            ~Scope()
+            {
+                current_ref() = prev;
+                if (--arena.depth == 0)
+                    arena.reset();
+            }
+
+        private:
+            Matrix_arena &arena;
+            Matrix_arena *prev;
+        };
+
+        explicit Matrix_arena(size_t block_bytes = size_t(1) << 20) : block_bytes(block_bytes) {}
+        Matrix_arena(const Matrix_arena &) = delete;
+        Matrix_arena &operator=(const Matrix_arena &) = delete;
+        ~Matrix_arena() { free_blocks(); }
+
+        /**
+         * @brief The arena installed on this thread, or `nullptr`.
+         *
+         */
+        static Matrix_arena *current() { return current_ref(); }
+
+        void *allocate(size_t bytes, size_t align)
+        {
+            bytes = round_bytes(bytes, align);
+            for (auto &f : free_lists)
+                if (f.bytes == bytes && f.align == align && f.head)
+                {
+                    void *p = f.head;
+                    f.head = *static_cast<void **>(p);
+                    return p;
+                }
+
+            char *p = align_up(cur, align);
+            if (!cur || p + bytes > end)
+            {
+                add_block(std::max(block_bytes, bytes + align));
+                p = align_up(cur, align);
+            }
+            cur = p + bytes;
+            return p;
+        }
+
+        void deallocate(void *p, size_t bytes, size_t align)
+        {
+            bytes = round_bytes(bytes, align);
+            if (static_cast<char *>(p) + bytes == cur) // the last allocation: just bump back
+            {
+                cur = static_cast<char *>(p);
+                return;
+            }
+            for (auto &f : free_lists)
+                if (f.bytes == bytes && f.align == align)
+                {
+                    *static_cast<void **>(p) = f.head;
+                    f.head = p;
+                    return;
+                }
+            *static_cast<void **>(p) = nullptr;
+            free_lists.push_back(Free_list{bytes, align, p});
+        }
+
+        /**
+         * @brief Drop every allocation. The blocks are merged into a single one large enough for all of them.
+         *
+         */
+        void reset()
+        {
+            free_lists.clear();
+            if (blocks.size() > 1)
+            {
+                size_t total = 0;
+                for (auto &b : blocks)
+                    total += b.second;
+                free_blocks();
+                add_block(total);
+            }
+            else if (!blocks.empty())
+            {
+                cur = blocks.front().first;
+            }
+        }
+
+        size_t bytes_reserved() const
+        {
+            size_t total = 0;
+            for (auto &b : blocks)
+                total += b.second;
+            return total;
+        }
+
+    private:
+        struct Free_list
+        {
+            size_t bytes;
+            size_t align;
+            void *head;
+        };
+
+        static constexpr size_t block_alignment = 64;
+
+        static Matrix_arena *&current_ref()
+        {
+            thread_local Matrix_arena *arena = nullptr;
+            return arena;
+        }
+
+        static size_t round_bytes(size_t bytes, size_t align)
+        {
+            bytes = std::max(bytes, sizeof(void *));
+            return (bytes + align - 1) / align * align;
+        }
+
+        static char *align_up(char *p, size_t align)
+        {
+            return reinterpret_cast<char *>((reinterpret_cast<std::uintptr_t>(p) + align - 1) / align * align);
+        }
+
+        void add_block(size_t bytes)
+        {
+            char *b = static_cast<char *>(::operator new(bytes, std::align_val_t(block_alignment)));
+            blocks.emplace_back(b, bytes);
+            cur = b;
+            end = b + bytes;
+        }
+
+        void free_blocks()
+        {
+            for (auto &b : blocks)
+                ::operator delete(b.first, std::align_val_t(block_alignment));
+            blocks.clear();
+            cur = end = nullptr;
+        }
+
+        size_t block_bytes;
+        size_t depth = 0;
+        std::vector<std::pair<char *, size_t>> blocks;
+        std::vector<Free_list> free_lists;
+        char *cur = nullptr;
+        char *end = nullptr;
+    };
+
+    /**
+     * @brief An allocator drawing from the `Matrix_arena` current at its construction, or from the heap (aligned to
+     *        `Align` bytes) when there is none.
+     *
+     */
+    template <typename T, size_t Align = MAT_DEFAULT_ALIGNMENT>
+    class Arena_allocator
+    {
+        static_assert(Align > 0 && (Align & (Align - 1)) == 0, "the alignment must be a power of two");
+        static_assert(Align >= alignof(T), "the alignment must not be weaker than that of the element type");
+
+    public:
+        using value_type = T;
+        using size_type = size_t;
+        using difference_type = std::ptrdiff_t;
+        using propagate_on_container_copy_assignment = std::false_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+        using is_always_equal = std::false_type;
+
+        template <typename U>
+        struct rebind
+        {
+            using other = Arena_allocator<U, (Align < alignof(U) ? alignof(U) : Align)>;
+        };
+
+        Arena_allocator() noexcept : arena_(Matrix_arena::current()) {}
+
+        template <typename U, size_t A2>
+        Arena_allocator(const Arena_allocator<U, A2> &x) noexcept : arena_(x.arena()) {}
+
+        // copies take the arena current where they are made, not that of the original
+        Arena_allocator select_on_container_copy_construction() const { return Arena_allocator(); }
+
+        Matrix_arena *arena() const noexcept { return arena_; }
+
+        T *allocate(size_t n)
+        {
+            if (n > std::numeric_limits<size_t>::max() / sizeof(T))
+                throw std::bad_array_new_length();
+            MAT_TELEMETRY_ALLOC(n * sizeof(T));
+            if (arena_)
+                return static_cast<T *>(arena_->allocate(n * sizeof(T), Align));
+            return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+        }
+
+        void deallocate(T *p, size_t n) noexcept
+        {
+            MAT_TELEMETRY_FREE();
+            if (arena_)
+                arena_->deallocate(p, n * sizeof(T), Align);
+            else
+                ::operator delete(p, std::align_val_t(Align));
+        }
+
+        template <typename U, size_t A2>
+        bool operator==(const Arena_allocator<U, A2> &x) const noexcept { return arena_ == x.arena() && Align == A2; }
+        template <typename U, size_t A2>
+        bool operator!=(const Arena_allocator<U, A2> &x) const noexcept { return !(*this == x); }
+
+    private:
+        Matrix_arena *arena_;
+    };
+};
+
+#endif
@@ -0,0 +1,261 @@
+/**
+ * @file mat_conv.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the 2-dimensional convolution and correlation of multi-channel images stored as
+ *        `Matrix<T, 3>` (channels * height * width) with a bank of kernels stored as `Matrix<T, 4>` (output channels *
+ *        input channels * height * width). Two methods are provided: a direct one, which adds shifted rows of the
+ *        input to rows of the output, and one which unfolds patches of the input into columns (im2col) and multiplies
+ *        them with the kernels through GEMM. The second is faster when the kernels are many and deep.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_CONV_H
+#define MAT_CONV_H
+
+#include "mat.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace utils
+{
+    /**
+     * @brief How a convolution is computed. `automatic` picks by the shape of the operands.
+     *
+     */
+    enum class Conv_method
+    {
+        automatic,
+        direct,
+        im2col
+    };
+
+    namespace Matrix_impl
+    {
+        // GEMM needs enough kernels (its rows) and input channels * kernel area (its depth) to outrun the direct
+        // loops, which add contiguous rows with SIMD when the stride is 1 but gather them element by element otherwise
+        constexpr size_t conv_im2col_kernels = 16;
+        constexpr size_t conv_im2col_depth = 16;
+        constexpr size_t conv_im2col_strided_kernels = 4;
+
+        struct Conv_shape
+        {
+            size_t cin, h, w;    // input
+            size_t cout, kh, kw; // kernels
+            size_t stride, pad;
+            size_t oh, ow; // output
+        };
+
+        /**
+         * @brief The output columns `[x0, x1)` for which column `x * stride + kx - pad` of the input is inside it.
+         *
+         */
+        inline void conv_columns(const Conv_shape &s, size_t kx, size_t &x0, size_t &x1)
+        {
+            x0 = kx < s.pad ? (s.pad - kx + s.stride - 1) / s.stride : 0;
+            x1 = s.w + s.pad > kx ? std::min(s.ow, (s.w + s.pad - kx + s.stride - 1) / s.stride) : 0;
+            x1 = std::max(x0, x1);
+        }
+
+        /**
+         * @brief Direct correlation of contiguous operands: each row of the output is a sum of shifted rows of the
+         *        input scaled by elements of the kernel, with the padding excluded from the bounds of the inner loop.
+         *
+         */
+        template <typename T>
+        void conv_direct(const Conv_shape &s, const T *in, const T *ker, T *out, const Execution_policy &policy)
+        {
+            const size_t work = std::max<size_t>(s.ow * s.cin * s.kh * s.kw, 1);
+            parallel_chunks(policy.grained(std::max<size_t>(policy.grain / work, 1)), s.cout * s.oh, [&](size_t first, size_t last)
+                            {
+                                for (size_t t = first; t < last; ++t)
+                                {
+                                    const size_t co = t / s.oh, y = t % s.oh;
+                                    T *o = out + t * s.ow;
+                                    std::fill(o, o + s.ow, T());
+                                    for (size_t ci = 0; ci < s.cin; ++ci)
+                                        for (size_t ky = 0; ky < s.kh; ++ky)
+                                        {
+                                            const size_t iy = y * s.stride + ky;
+                                            if (iy < s.pad || iy - s.pad >= s.h)
+                                                continue;
+                                            const T *row = in + (ci * s.h + iy - s.pad) * s.w;
+                                            const T *k = ker + ((co * s.cin + ci) * s.kh + ky) * s.kw;
+                                            for (size_t kx = 0; kx < s.kw; ++kx)
+                                            {
+                                                size_t x0, x1;
+                                                conv_columns(s, kx, x0, x1);
+                                                const T wk = k[kx];
+                                                const T *src = row + (x0 * s.stride + kx - s.pad);
+                                                if (s.stride == 1)
+                                                    simd_axpy(o + x0, src, x1 - x0, wk);
+                                                else
+                                                    for (size_t x = x0; x < x1; ++x)
+                                                        o[x] += wk * src[(x - x0) * s.stride];
+                                            }
+                                        }
+                                } });
+        }
+
+        /**
+         * @brief The output pixels `[j0, j1)` of the im2col matrix of contiguous `in`, row-major in `col`: row
+         *        `(ci, ky, kx)` holds, for each pixel `(y, x)`, the input at `(ci, y * stride + ky - pad,
+         *        x * stride + kx - pad)`, or zero in the padding.
+         *
+         */
+        template <typename T>
+        void im2col(const Conv_shape &s, const T *in, size_t j0, size_t j1, T *col)
+        {
+            const size_t n = j1 - j0;
+            for (size_t ci = 0; ci < s.cin; ++ci)
+                for (size_t ky = 0; ky < s.kh; ++ky)
+                    for (size_t kx = 0; kx < s.kw; ++kx, col += n)
+                    {
+                        size_t x0, x1;
+                        conv_columns(s, kx, x0, x1);
+                        // walk the pixels one output row at a time
+                        for (size_t j = j0; j < j1;)
+                        {
+                            const size_t y = j / s.ow, xa = j % s.ow, xb = std::min(s.ow, xa + (j1 - j));
+                            T *dst = col + (j - j0); // pixel (y, xa)
+                            const size_t iy = y * s.stride + ky;
+                            if (iy < s.pad || iy - s.pad >= s.h)
+                                std::fill(dst, dst + (xb - xa), T());
+                            else
+                            {
+                                const T *row = in + (ci * s.h + iy - s.pad) * s.w;
+                                const size_t lo = std::min(std::max(xa, x0), xb), hi = std::max(lo, std::min(xb, x1));
+                                std::fill(dst, dst + (lo - xa), T());
+                                for (size_t x = lo; x < hi; ++x)
+                                    dst[x - xa] = row[x * s.stride + kx - s.pad];
+                                std::fill(dst + (hi - xa), dst + (xb - xa), T());
+                            }
+                            j += xb - xa;
+                        }
+                    }
+        }
+
+        template <typename T>
+        T *conv_workspace(size_t n)
+        {
+            thread_local std::vector<T> buf;
+            if (buf.size() < n)
+                buf.resize(n);
+            return buf.data();
+        }
+
+        /**
+         * @brief Correlation of contiguous operands as `out = ker * im2col(in)`, `(cout * depth) * (depth * pixels)`,
+         *        in blocks of pixels whose columns stay in L2, each block unfolded and multiplied on one thread.
+         *
+         */
+        template <typename T>
+        void conv_im2col(const Conv_shape &s, const T *in, const T *ker, T *out, const Execution_policy &policy)
+        {
+            const size_t depth = s.cin * s.kh * s.kw, pixels = s.oh * s.ow;
+            const size_t block = std::max<size_t>(MAT_GEMM_L2_BYTES / 2 / (depth * sizeof(T)), 64);
+            parallel_chunks(policy.grained(block), pixels, [&](size_t j0, size_t j1)
+                            {
+                                for (size_t j = j0; j < j1; j += block)
+                                {
+                                    const size_t n = std::min(block, j1 - j);
+                                    T *col = conv_workspace<T>(depth * n);
+                                    im2col(s, in, j, j + n, col);
+                                    gemm_strided<T>(s.cout, n, depth, T(1), ker, ptrdiff_t(depth), 1, col, ptrdiff_t(n), 1,
+                                                    T(0), out + j, ptrdiff_t(pixels), 1);
+                                } });
+        }
+
+        template <typename T>
+        void conv_run(const Conv_shape &s, const T *in, const T *ker, T *out, Conv_method method, const Execution_policy &policy)
+        {
+            if (method == Conv_method::automatic)
+            {
+                const bool gemm = s.stride == 1 ? s.cout >= conv_im2col_kernels && s.cin * s.kh * s.kw >= conv_im2col_depth
+                                                : s.cout >= conv_im2col_strided_kernels;
+                method = gemm ? Conv_method::im2col : Conv_method::direct;
+            }
+            if (method == Conv_method::im2col)
+                conv_im2col(s, in, ker, out, policy);
+            else
+                conv_direct(s, in, ker, out, policy);
+        }
+
+        /**
+         * @brief The correlation of `input` with `kernel`, flipping the kernel first if `flip`.
+         *        Non-contiguous operands are copied first.
+         *
+         */
+        template <typename T>
+        Matrix<T, 3> correlate(const Matrix_base<T, 3> &input, const Matrix_base<T, 4> &kernel, size_t stride,
+                               size_t padding, bool flip, Conv_method method, const Execution_policy &policy)
+        {
+            const Matrix_slice<3> &di = input.descriptor();
+            const Matrix_slice<4> &dk = kernel.descriptor();
+            assert(stride > 0 && dk.extents[1] == di.extents[0]);
+            assert(dk.extents[2] <= di.extents[1] + 2 * padding && dk.extents[3] <= di.extents[2] + 2 * padding);
+            Conv_shape s{di.extents[0], di.extents[1], di.extents[2], dk.extents[0], dk.extents[2], dk.extents[3],
+                         stride, padding, 0, 0};
+            s.oh = (s.h + 2 * padding - s.kh) / stride + 1;
+            s.ow = (s.w + 2 * padding - s.kw) / stride + 1;
+            MAT_TELEMETRY_SCOPE(conv, {s.cout, s.oh, s.ow, s.cin, s.kh, s.kw}, s.cout * s.oh * s.ow,
+                                (di.size + dk.size + s.cout * s.oh * s.ow) * sizeof(T));
+
+            Matrix<T, 3> in_copy;
+            const T *in = input.data() + di.start;
+            if (!is_contiguous(di))
+            {
+                in_copy = materialize(input, policy);
+                in = in_copy.data();
+            }
+            Matrix<T, 4> ker_copy;
+            const T *ker = kernel.data() + dk.start;
+            if (flip || !is_contiguous(dk))
+            {
+                ker_copy = materialize(kernel, policy);
+                if (flip) // reverse each kernel plane
+                    for (size_t p = 0; p < s.cout * s.cin; ++p)
+                        std::reverse(ker_copy.data() + p * s.kh * s.kw, ker_copy.data() + (p + 1) * s.kh * s.kw);
+                ker = ker_copy.data();
+            }
+
+            Matrix<T, 3> out(s.cout, s.oh, s.ow);
+            conv_run(s, in, ker, out.data(), method, policy);
+            return out;
+        }
+    };
+
+    /**
+     * @brief Cross-correlation of the `channels * height * width` `input` with the bank of kernels `kernel`
+     *        (`output channels * channels * kh * kw`), as computed by the convolutional layers of neural networks:
+     *        `out(o, y, x) = sum input(c, y * stride + i - padding, x * stride + j - padding) * kernel(o, c, i, j)`,
+     *        the input being zero outside of it. The result is `output channels * oh * ow`, with
+     *        `oh = (height + 2 * padding - kh) / stride + 1`, and likewise `ow`.
+     *
+     */
+    template <typename T>
+    Matrix<T, 3> correlate2d(const Matrix_base<T, 3> &input, const Matrix_base<T, 4> &kernel, size_t stride = 1,
+                             size_t padding = 0, Conv_method method = Conv_method::automatic,
+                             const Execution_policy &policy = execution::par)
+    {
+        return Matrix_impl::correlate(input, kernel, stride, padding, false, method, policy);
+    }
+
+    /**
+     * @brief Convolution of `input` with the bank of kernels `kernel`: the cross-correlation with each kernel
+     *        rotated by 180 degrees. See `correlate2d`.
+     *
+     */
+    template <typename T>
+    Matrix<T, 3> conv2d(const Matrix_base<T, 3> &input, const Matrix_base<T, 4> &kernel, size_t stride = 1,
+                        size_t padding = 0, Conv_method method = Conv_method::automatic,
+                        const Execution_policy &policy = execution::par)
+    {
+        return Matrix_impl::correlate(input, kernel, stride, padding, true, method, policy);
+    }
+};
+
+#endif
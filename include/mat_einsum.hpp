@@ -0,0 +1,472 @@
+/**
+ * @file mat_einsum.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the tensor contractions of `Matrix`: `einsum`, with the subscript notation of NumPy, and
+ *        `contract`, which sums over pairs of axes of two tensors. Each contraction of two operands is mapped onto
+ *        the blocked GEMM of `mat_gemm.hpp`: the axes are grouped into batch, row, column and summed axes, and a
+ *        group is read in place when its strides allow it to be addressed as a single axis, so that permuted and
+ *        sliced operands are usually not copied. More operands are contracted pairwise, smallest result first.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_EINSUM_H
+#define MAT_EINSUM_H
+
+#include "mat.hpp"
+
+#include <cctype>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+namespace utils
+{
+    namespace Matrix_impl
+    {
+        constexpr size_t einsum_parallel_work = size_t(1) << 15; // multiply-adds per batch worth a thread
+
+        /**
+         * @brief An operand of a contraction, with one label per axis. The elements are borrowed from a `Matrix`, or
+         *        owned in `storage` for the intermediate results.
+         *
+         */
+        template <typename T>
+        struct Einsum_operand
+        {
+            const T *data = nullptr; // the first element
+            std::string labels;
+            std::vector<size_t> extents;
+            std::vector<size_t> strides;
+            std::vector<T> storage;
+
+            size_t size() const
+            {
+                size_t n = 1;
+                for (size_t e : extents)
+                    n *= e;
+                return n;
+            }
+            bool has(char c) const { return labels.find(c) != std::string::npos; }
+            size_t extent(char c) const { return extents[labels.find(c)]; }
+        };
+
+        [[noreturn]] inline void einsum_error(const std::string &what)
+        {
+            throw std::invalid_argument("einsum: " + what);
+        }
+
+        template <typename T, size_t N>
+        Einsum_operand<T> einsum_operand(const Matrix_base<T, N> &m)
+        {
+            const Matrix_slice<N> &s = m.descriptor();
+            Einsum_operand<T> op;
+            op.data = m.data() + s.start;
+            op.extents.assign(s.extents.begin(), s.extents.end());
+            op.strides.assign(s.strides.begin(), s.strides.end());
+            return op;
+        }
+
+        /**
+         * @brief A row-major operand of the given labels, in `into` if not null.
+         *
+         */
+        template <typename T>
+        Einsum_operand<T> dense_operand(const std::string &labels, std::vector<size_t> extents, T *into = nullptr)
+        {
+            Einsum_operand<T> r;
+            r.labels = labels;
+            r.extents = std::move(extents);
+            r.strides.resize(labels.size());
+            size_t n = 1;
+            for (size_t d = labels.size(); d-- > 0;)
+                r.strides[d] = n, n *= r.extents[d];
+            if (!into)
+            {
+                r.storage.resize(n);
+                into = r.storage.data();
+            }
+            r.data = into;
+            return r;
+        }
+
+        /**
+         * @brief Call `f(a, b)` for every index of `extents` in row-major order, with its offsets under the strides
+         *        `sa` and `sb`.
+         *
+         */
+        template <typename F>
+        void for_each_index(const std::vector<size_t> &extents, const std::vector<size_t> &sa, const std::vector<size_t> &sb, F f)
+        {
+            for (size_t e : extents)
+                if (e == 0)
+                    return;
+            std::vector<size_t> idx(extents.size(), 0);
+            size_t a = 0, b = 0;
+            for (;;)
+            {
+                f(a, b);
+                size_t d = extents.size();
+                while (d-- > 0)
+                {
+                    a += sa[d], b += sb[d];
+                    if (++idx[d] < extents[d])
+                        break;
+                    a -= extents[d] * sa[d], b -= extents[d] * sb[d];
+                    idx[d] = 0;
+                }
+                if (d == size_t(-1))
+                    return;
+            }
+        }
+
+        /**
+         * @brief Turn each label repeated within `op` into a single axis along the diagonal, whose stride is the sum
+         *        of the strides of the repeated axes.
+         *
+         */
+        template <typename T>
+        void merge_repeated(Einsum_operand<T> &op)
+        {
+            for (size_t i = 0; i < op.labels.size(); ++i)
+                for (size_t j = op.labels.size(); j-- > i + 1;)
+                    if (op.labels[j] == op.labels[i])
+                    {
+                        if (op.extents[j] != op.extents[i])
+                            einsum_error(std::string("the extents of the diagonal '") + op.labels[i] + "' differ");
+                        op.strides[i] += op.strides[j];
+                        op.labels.erase(j, 1);
+                        op.extents.erase(op.extents.begin() + ptrdiff_t(j));
+                        op.strides.erase(op.strides.begin() + ptrdiff_t(j));
+                    }
+        }
+
+        /**
+         * @brief A row-major copy of `op` with the axes `labels`, summing over the axes of `op` not among them.
+         *
+         */
+        template <typename T>
+        Einsum_operand<T> reduce_to(const Einsum_operand<T> &op, const std::string &labels, T *into = nullptr)
+        {
+            std::vector<size_t> extents, strides, summed_extents, summed_strides;
+            for (char c : labels)
+            {
+                const size_t i = op.labels.find(c);
+                extents.push_back(op.extents[i]);
+                strides.push_back(op.strides[i]);
+            }
+            for (size_t i = 0; i < op.labels.size(); ++i)
+                if (labels.find(op.labels[i]) == std::string::npos)
+                    summed_extents.push_back(op.extents[i]), summed_strides.push_back(op.strides[i]);
+
+            Einsum_operand<T> r = dense_operand<T>(labels, extents, into);
+            T *out = const_cast<T *>(r.data);
+            if (summed_extents.empty())
+            {
+                for_each_index(r.extents, strides, r.strides, [&](size_t src, size_t dst)
+                               { out[dst] = op.data[src]; });
+                return r;
+            }
+            std::vector<size_t> offsets;
+            for_each_index(summed_extents, summed_strides, summed_strides, [&](size_t src, size_t)
+                           { offsets.push_back(src); });
+            for_each_index(r.extents, strides, r.strides, [&](size_t src, size_t dst)
+                           {
+                               T acc = T();
+                               for (size_t o : offsets)
+                                   acc += op.data[src + o];
+                               out[dst] = acc; });
+            return r;
+        }
+
+        /**
+         * @brief Whether the axes `labels` of `op`, in this order, can be addressed as a single axis; if so, its
+         *        extent and stride.
+         *
+         */
+        template <typename T>
+        bool collapse(const Einsum_operand<T> &op, const std::string &labels, size_t &extent, size_t &stride)
+        {
+            extent = 1, stride = 1;
+            bool first = true;
+            for (char c : labels)
+            {
+                const size_t i = op.labels.find(c), e = op.extents[i], s = op.strides[i];
+                extent *= e;
+                if (e == 1)
+                    continue;
+                if (!first && stride != s * e)
+                    return false;
+                stride = s, first = false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Contract `a` and `b` into a row-major operand of the axes `labels`, in `into` if not null.
+         *        The axes of both and of the result are batched, those of both only are summed by the GEMM, and those
+         *        of one side and of the result are its rows or columns. Axes of one side only are summed beforehand.
+         *
+         */
+        template <typename T>
+        Einsum_operand<T> contract_pair(Einsum_operand<T> a, Einsum_operand<T> b, const std::string &labels, T *into = nullptr)
+        {
+            auto needed = [&](const Einsum_operand<T> &x, const Einsum_operand<T> &other)
+            {
+                std::string keep;
+                for (char c : x.labels)
+                    if (labels.find(c) != std::string::npos || other.has(c))
+                        keep += c;
+                return keep;
+            };
+            const std::string ka = needed(a, b), kb = needed(b, a);
+            if (ka.size() != a.labels.size())
+                a = reduce_to(a, ka);
+            if (kb.size() != b.labels.size())
+                b = reduce_to(b, kb);
+
+            std::string batch, rows, cols, sum;
+            std::vector<size_t> extents;
+            for (char c : labels)
+            {
+                (a.has(c) && b.has(c) ? batch : a.has(c) ? rows : cols) += c;
+                extents.push_back(a.has(c) ? a.extent(c) : b.extent(c));
+            }
+            for (char c : a.labels)
+                if (b.has(c) && labels.find(c) == std::string::npos)
+                    sum += c;
+
+            // read the operands in place if each group is a single axis, trying the order of the summed axes of both
+            size_t m, n, k, rsa, csa, rsb, csb;
+            bool in_place = collapse(a, rows, m, rsa) && collapse(b, cols, n, csb);
+            if (in_place && !(collapse(a, sum, k, csa) && collapse(b, sum, k, rsb)))
+            {
+                std::string order;
+                for (char c : b.labels)
+                    if (sum.find(c) != std::string::npos)
+                        order += c;
+                in_place = collapse(a, order, k, csa) && collapse(b, order, k, rsb);
+                if (in_place)
+                    sum = order;
+            }
+            if (!in_place)
+            {
+                a = reduce_to(a, batch + rows + sum);
+                b = reduce_to(b, batch + sum + cols);
+                collapse(a, rows, m, rsa), collapse(a, sum, k, csa);
+                collapse(b, sum, k, rsb), collapse(b, cols, n, csb);
+            }
+
+            Einsum_operand<T> r = dense_operand<T>(labels, extents, into);
+            Einsum_operand<T> scratch;
+            const Einsum_operand<T> *c = &r;
+            size_t rsc, csc;
+            if (!(collapse(r, rows, m, rsc) && collapse(r, cols, n, csc)))
+            {
+                std::vector<size_t> e;
+                for (char x : batch + rows + cols)
+                    e.push_back(r.extent(x));
+                scratch = dense_operand<T>(batch + rows + cols, e);
+                c = &scratch;
+                collapse(scratch, rows, m, rsc), collapse(scratch, cols, n, csc);
+            }
+
+            std::vector<size_t> bext, bsa, bsb, bsc;
+            size_t batches = 1;
+            for (char x : batch)
+            {
+                bext.push_back(a.extent(x));
+                bsa.push_back(a.strides[a.labels.find(x)]);
+                bsb.push_back(b.strides[b.labels.find(x)]);
+                bsc.push_back(c->strides[c->labels.find(x)]);
+                batches *= bext.back();
+            }
+            T *cd = const_cast<T *>(c->data);
+            auto body = [&](size_t first, size_t last)
+            {
+                for (size_t t = first; t < last; ++t)
+                {
+                    size_t oa = 0, ob = 0, oc = 0;
+                    for (size_t d = bext.size(), rem = t; d-- > 0;)
+                    {
+                        const size_t i = rem % bext[d];
+                        rem /= bext[d];
+                        oa += i * bsa[d], ob += i * bsb[d], oc += i * bsc[d];
+                    }
+                    gemm_strided<T>(m, n, k, T(1), a.data + oa, ptrdiff_t(rsa), ptrdiff_t(csa), b.data + ob, ptrdiff_t(rsb),
+                                    ptrdiff_t(csb), T(0), cd + oc, ptrdiff_t(rsc), ptrdiff_t(csc));
+                }
+            };
+            if (batches > 1 && m * n * k >= einsum_parallel_work)
+                parallel_chunks(execution::par.grained(1), batches, body);
+            else
+                body(0, batches);
+
+            if (c == &scratch)
+                reduce_to(scratch, labels, const_cast<T *>(r.data));
+            return r;
+        }
+
+        /**
+         * @brief Contract `ops` into the row-major buffer `out` of the axes `labels`. With more than two operands,
+         *        the pair whose result is smallest is contracted first, keeping only the axes still needed.
+         *
+         */
+        template <typename T>
+        void einsum_into(std::vector<Einsum_operand<T>> ops, const std::string &labels, T *out)
+        {
+            while (ops.size() > 2)
+            {
+                size_t bi = 0, bj = 1, best = size_t(-1);
+                std::string best_labels;
+                for (size_t i = 0; i < ops.size(); ++i)
+                    for (size_t j = i + 1; j < ops.size(); ++j)
+                    {
+                        std::string kept;
+                        size_t size = 1;
+                        for (char c : ops[i].labels + ops[j].labels)
+                        {
+                            bool used = labels.find(c) != std::string::npos;
+                            for (size_t o = 0; o < ops.size() && !used; ++o)
+                                used = o != i && o != j && ops[o].has(c);
+                            if (used && kept.find(c) == std::string::npos)
+                                kept += c, size *= ops[i].has(c) ? ops[i].extent(c) : ops[j].extent(c);
+                        }
+                        if (size < best)
+                            best = size, bi = i, bj = j, best_labels = kept;
+                    }
+                Einsum_operand<T> r = contract_pair(std::move(ops[bi]), std::move(ops[bj]), best_labels);
+                ops.erase(ops.begin() + ptrdiff_t(bj));
+                ops[bi] = std::move(r);
+            }
+            if (ops.size() == 2)
+                contract_pair(std::move(ops[0]), std::move(ops[1]), labels, out);
+            else
+                reduce_to(ops[0], labels, out);
+        }
+
+        template <typename T, size_t M, typename Run>
+        Matrix<T, M> einsum_result(const std::vector<size_t> &extents, Run run, std::false_type)
+        {
+            std::array<size_t, M> e;
+            std::copy(extents.begin(), extents.end(), e.begin());
+            Matrix<T, M> out(e);
+            run(out.data());
+            return out;
+        }
+
+        template <typename T, size_t M, typename Run>
+        Matrix<T, M> einsum_result(const std::vector<size_t> &, Run run, std::true_type)
+        {
+            T x = T();
+            run(&x);
+            return Matrix<T, 0>(x);
+        }
+    };
+
+    /**
+     * @brief The contraction of `operands` described by `spec` in the notation of `numpy.einsum`, such as
+     *        `"ijk,kl->ijl"` or `"bij,bjk->bik"`: each operand gets one letter per axis, the letters after `->` are
+     *        the axes of the result in order, and every other axis is summed over. Without `->`, the result has the
+     *        letters used once, in alphabetical order. A letter repeated within an operand takes its diagonal.
+     *
+     * @tparam M the order of the result
+     * @throw std::invalid_argument if `spec` does not match the operands.
+     */
+    template <size_t M, typename T, size_t... Ns>
+    Matrix<T, M> einsum(const std::string &spec, const Matrix_base<T, Ns> &...operands)
+    {
+        using namespace Matrix_impl;
+        std::string s;
+        for (char c : spec)
+            if (c != ' ')
+                s += c;
+        const size_t arrow = s.find("->");
+        const std::string lhs = s.substr(0, arrow);
+
+        std::vector<Einsum_operand<T>> ops;
+        (ops.push_back(einsum_operand(operands)), ...);
+        std::map<char, size_t> extents, uses;
+        size_t pos = 0;
+        for (auto &op : ops)
+        {
+            const size_t comma = lhs.find(',', pos);
+            if (pos > lhs.size())
+                einsum_error("fewer subscripts than operands in \"" + spec + "\"");
+            op.labels = lhs.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+            pos = comma == std::string::npos ? lhs.size() + 1 : comma + 1;
+            if (op.labels.size() != op.extents.size())
+                einsum_error("\"" + op.labels + "\" does not match an operand of order " + std::to_string(op.extents.size()));
+            for (size_t d = 0; d < op.labels.size(); ++d)
+            {
+                const char c = op.labels[d];
+                if (!std::isalpha(static_cast<unsigned char>(c)))
+                    einsum_error(std::string("invalid subscript '") + c + "'");
+                if (extents.count(c) && extents[c] != op.extents[d])
+                    einsum_error(std::string("the extents of '") + c + "' differ");
+                extents[c] = op.extents[d], ++uses[c];
+            }
+            merge_repeated(op);
+        }
+        if (pos <= lhs.size())
+            einsum_error("more subscripts than operands in \"" + spec + "\"");
+
+        std::string out;
+        if (arrow == std::string::npos)
+        {
+            for (auto &u : uses)
+                if (u.second == 1)
+                    out += u.first;
+        }
+        else
+            out = s.substr(arrow + 2);
+        if (out.size() != M)
+            einsum_error("the result \"" + out + "\" is not of order " + std::to_string(M));
+        std::vector<size_t> out_extents;
+        for (size_t d = 0; d < out.size(); ++d)
+        {
+            if (!extents.count(out[d]) || out.find(out[d], d + 1) != std::string::npos)
+                einsum_error(std::string("invalid result subscript '") + out[d] + "'");
+            out_extents.push_back(extents[out[d]]);
+        }
+
+        size_t size = 1;
+        for (size_t e : out_extents)
+            size *= e;
+        MAT_TELEMETRY_SCOPE(einsum, size, size * sizeof(T));
+        return einsum_result<T, M>(
+            out_extents, [&](T *p)
+            { einsum_into(std::move(ops), out, p); },
+            std::integral_constant<bool, M == 0>());
+    }
+
+    /**
+     * @brief The contraction of axis `axes_a[i]` of `a` with axis `axes_b[i]` of `b` for every `i`, as in
+     *        `numpy.tensordot`. The result has the other axes of `a`, then the other axes of `b`.
+     *
+     */
+    template <typename T, size_t N1, size_t N2, size_t K>
+    Matrix<T, N1 + N2 - 2 * K> contract(const Matrix_base<T, N1> &a, const Matrix_base<T, N2> &b,
+                                        const std::array<size_t, K> &axes_a, const std::array<size_t, K> &axes_b)
+    {
+        static_assert(K <= N1 && K <= N2 && N1 + N2 <= 52, "contract: too many axes.");
+        static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        std::string la(letters, N1), lb(letters + N1, N2), out;
+        for (size_t i = 0; i < K; ++i)
+        {
+            assert(axes_a[i] < N1 && axes_b[i] < N2);
+            lb[axes_b[i]] = la[axes_a[i]];
+        }
+        for (char c : la)
+            if (lb.find(c) == std::string::npos)
+                out += c;
+        for (char c : lb)
+            if (la.find(c) == std::string::npos)
+                out += c;
+        return einsum<N1 + N2 - 2 * K>(la + "," + lb + "->" + out, a, b);
+    }
+};
+
+#endif
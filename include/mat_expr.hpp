@@ -0,0 +1,751 @@
+/**
+ * @file mat_expr.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the expression templates behind the element-wise operators of `Matrix` and `Matrix_ref`.
+ *        An expression such as `a * 2.0 + b - c` only builds a lightweight tree of views and scalars, which is
+ *        evaluated in a single fused pass when it is assigned to a `Matrix`/`Matrix_ref` or passed to `eval()`.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_EXPR_H
+#define MAT_EXPR_H
+
+#include "mat.hpp"
+
+#include <functional>
+#include <utility>
+
+namespace utils
+{
+    namespace Matrix_impl
+    {
+        /**
+         * @brief Common base of the expression nodes, providing the eager evaluation point.
+         *
+         */
+        template <typename E>
+        struct Matrix_expr : Expr_tag
+        {
+            auto eval() const
+            {
+                return Matrix<typename E::value_type, E::order>(static_cast<const E &>(*this));
+            }
+        };
+
+        /**
+         * @brief A leaf that reads the elements of a `Matrix` or a `Matrix_ref`. Only the pointer and the descriptor
+         *        are kept, so the referenced matrix must outlive the expression.
+         * @note  Every node is evaluated either by `flat(i)`, when all the leaves are contiguous, or run by run with
+         *        `seek(cursor)` followed by `inner(j)`. `fusible(p, d)` tells whether dimension `d` can be merged
+         *        into the dimension `p` before it for every leaf, as in `Segments`. `reads_overlapping(lo, hi, s)`
+         *        tells whether a leaf reads from the addresses `[lo, hi)` of a destination described by `s` starting at
+         *        `lo` with another layout than `s` (another start, extents or strides, a broadcast among them), so that
+         *        it would read elements already overwritten.
+         */
+        template <typename T, size_t N>
+        class Expr_leaf : public Matrix_expr<Expr_leaf<T, N>>
+        {
+        public:
+            using value_type = T;
+            static constexpr size_t order = N;
+
+            explicit Expr_leaf(const Matrix_base<T, N> &m) : desc(m.descriptor()), base(m.data()) {}
+            Expr_leaf(const Matrix_slice<N> &desc, const T *base) : desc(desc), base(base) {}
+
+            const Matrix_slice<N> &descriptor() const { return desc; }
+            const T *data() const { return base; }
+
+            const std::array<size_t, N> &extents() const { return desc.extents; }
+            bool contiguous() const { return is_contiguous(desc); }
+
+            const T &flat(size_t i) const { return base[desc.start + i]; }
+            void seek(const std::array<size_t, N> &cursor) const
+            {
+                size_t offset = desc.start;
+                for (size_t d = 0; d + 1 < N; ++d)
+                    offset += cursor[d] * desc.strides[d];
+                row = base + offset;
+            }
+            const T &inner(size_t j) const { return row[j * desc.strides[N - 1]]; }
+            bool fusible(size_t p, size_t d) const { return desc.strides[p] == desc.strides[d] * desc.extents[d]; }
+            template <typename U>
+            bool reads_overlapping(const U *lo, const U *hi, const Matrix_slice<N> &s) const
+            {
+                const void *first = base + desc.start, *last = base + span(desc);
+                const std::less<const void *> before; // a total order, also between unrelated buffers
+                if (desc.size == 0 || !before(first, hi) || !before(lo, last))
+                    return false;
+                bool same = std::is_same<T, U>::value && first == static_cast<const void *>(lo) && desc.extents == s.extents;
+                for (size_t d = 0; same && d < N; ++d)
+                    same = desc.extents[d] <= 1 || desc.strides[d] == s.strides[d];
+                return !same;
+            }
+
+        private:
+            Matrix_slice<N> desc;
+            const T *base;
+            mutable const T *row = nullptr;
+        };
+
+        /**
+         * @brief A scalar broadcast to every element.
+         *
+         */
+        template <typename T, size_t N>
+        class Expr_scalar : public Matrix_expr<Expr_scalar<T, N>>
+        {
+        public:
+            using value_type = T;
+            static constexpr size_t order = N;
+
+            explicit Expr_scalar(const T &v) : v(v) {}
+
+            bool contiguous() const { return true; }
+            const T &value() const { return v; }
+
+            const T &flat(size_t) const { return v; }
+            void seek(const std::array<size_t, N> &) const {}
+            const T &inner(size_t) const { return v; }
+            bool fusible(size_t, size_t) const { return true; }
+            template <typename U>
+            bool reads_overlapping(const U *, const U *, const Matrix_slice<N> &) const { return false; }
+
+        private:
+            T v;
+        };
+
+        template <typename X>
+        struct Is_scalar_node : std::false_type
+        {
+        };
+
+        template <typename T, size_t N>
+        struct Is_scalar_node<Expr_scalar<T, N>> : std::true_type
+        {
+        };
+
+        template <typename Op, typename E>
+        class Expr_unary : public Matrix_expr<Expr_unary<Op, E>>
+        {
+        public:
+            using value_type = typename E::value_type;
+            static constexpr size_t order = E::order;
+
+            explicit Expr_unary(const E &e) : e(e) {}
+
+            const E &operand() const { return e; }
+            const std::array<size_t, order> &extents() const { return e.extents(); }
+            bool contiguous() const { return e.contiguous(); }
+
+            value_type flat(size_t i) const { return Op()(e.flat(i)); }
+            void seek(const std::array<size_t, order> &cursor) const { e.seek(cursor); }
+            value_type inner(size_t j) const { return Op()(e.inner(j)); }
+            bool fusible(size_t p, size_t d) const { return e.fusible(p, d); }
+            template <typename U>
+            bool reads_overlapping(const U *lo, const U *hi, const Matrix_slice<order> &s) const
+            {
+                return e.reads_overlapping(lo, hi, s);
+            }
+
+        private:
+            E e;
+        };
+
+        template <typename Op, typename L, typename R>
+        class Expr_binary : public Matrix_expr<Expr_binary<Op, L, R>>
+        {
+        public:
+            using value_type = Common_type<typename L::value_type, typename R::value_type>;
+            static constexpr size_t order = L::order;
+
+            Expr_binary(const L &l, const R &r) : l(l), r(r)
+            {
+                static_assert(L::order == R::order, "Expr_binary: unmatched dimensions.");
+                assert(same_extents(l, r, Is_scalar_node<L>(), Is_scalar_node<R>()));
+            }
+
+            const L &left() const { return l; }
+            const R &right() const { return r; }
+            const std::array<size_t, order> &extents() const { return extents(Is_scalar_node<L>()); }
+            bool contiguous() const { return l.contiguous() && r.contiguous(); }
+
+            value_type flat(size_t i) const { return Op()(l.flat(i), r.flat(i)); }
+            void seek(const std::array<size_t, order> &cursor) const { l.seek(cursor), r.seek(cursor); }
+            value_type inner(size_t j) const { return Op()(l.inner(j), r.inner(j)); }
+            bool fusible(size_t p, size_t d) const { return l.fusible(p, d) && r.fusible(p, d); }
+            template <typename U>
+            bool reads_overlapping(const U *lo, const U *hi, const Matrix_slice<order> &s) const
+            {
+                return l.reads_overlapping(lo, hi, s) || r.reads_overlapping(lo, hi, s);
+            }
+
+        private:
+            const std::array<size_t, order> &extents(std::false_type) const { return l.extents(); }
+            const std::array<size_t, order> &extents(std::true_type) const { return r.extents(); }
+
+            static bool same_extents(const L &l, const R &r, std::false_type, std::false_type) { return l.extents() == r.extents(); }
+            template <typename A, typename B>
+            static bool same_extents(const L &, const R &, A, B) { return true; }
+
+            L l;
+            R r;
+        };
+
+        // ------------------------------
+        // Broadcasting
+
+        /**
+         * @brief The extents of the result of an element-wise operation between operands of extents `a` and `b`,
+         *        aligned on their last dimension as in NumPy: each pair of extents must be equal or contain a 1, and
+         *        the missing leading dimensions count as 1.
+         *
+         */
+        template <size_t M, size_t N>
+        std::array<size_t, (M > N ? M : N)> broadcast_extents(const std::array<size_t, M> &a, const std::array<size_t, N> &b)
+        {
+            constexpr size_t K = M > N ? M : N;
+            std::array<size_t, K> r;
+            for (size_t d = 0; d < K; ++d)
+            {
+                const size_t x = d + M >= K ? a[d + M - K] : 1, y = d + N >= K ? b[d + N - K] : 1;
+                assert(x == y || x == 1 || y == 1);
+                r[d] = x == 1 ? y : x;
+            }
+            return r;
+        }
+
+        /**
+         * @brief The slice reading the elements of `s` as if repeated to `extents`: the new leading dimensions and the
+         *        dimensions of extent 1 that are stretched get a stride of 0, so nothing is copied.
+         *
+         */
+        template <size_t M, size_t N>
+        Matrix_slice<M> broadcast_slice(const Matrix_slice<N> &s, const std::array<size_t, M> &extents)
+        {
+            static_assert(N <= M, "broadcast_slice: cannot broadcast to fewer dimensions.");
+            Matrix_slice<M> r;
+            for (size_t d = 0; d < M; ++d)
+            {
+                r.extents[d] = extents[d];
+                r.strides[d] = 0;
+                if (d + N >= M)
+                {
+                    const size_t e = d + N - M;
+                    assert(s.extents[e] == extents[d] || s.extents[e] == 1);
+                    if (s.extents[e] == extents[d])
+                        r.strides[d] = s.strides[e];
+                }
+            }
+            r.start = s.start;
+            r.recalc_size();
+            return r;
+        }
+
+        // `broadcast_node(e, extents)` rebuilds the expression `e` with every leaf broadcast to `extents`.
+
+        template <size_t M, typename T, size_t N>
+        Expr_leaf<T, M> broadcast_node(const Expr_leaf<T, N> &e, const std::array<size_t, M> &extents)
+        {
+            return Expr_leaf<T, M>(broadcast_slice(e.descriptor(), extents), e.data());
+        }
+
+        template <size_t M, typename T, size_t N>
+        Expr_scalar<T, M> broadcast_node(const Expr_scalar<T, N> &e, const std::array<size_t, M> &)
+        {
+            return Expr_scalar<T, M>(e.value());
+        }
+
+        template <size_t M, typename Op, typename E>
+        auto broadcast_node(const Expr_unary<Op, E> &e, const std::array<size_t, M> &extents)
+        {
+            auto x = broadcast_node(e.operand(), extents);
+            return Expr_unary<Op, decltype(x)>(x);
+        }
+
+        template <size_t M, typename Op, typename L, typename R>
+        auto broadcast_node(const Expr_binary<Op, L, R> &e, const std::array<size_t, M> &extents)
+        {
+            auto l = broadcast_node(e.left(), extents);
+            auto r = broadcast_node(e.right(), extents);
+            return Expr_binary<Op, decltype(l), decltype(r)>(l, r);
+        }
+
+        template <typename E, size_t M>
+        using Broadcast_node = decltype(broadcast_node(std::declval<const E &>(), std::declval<const std::array<size_t, M> &>()));
+
+        // ------------------------------
+        // Traversal plan
+
+        // `plan_node(e, fusible)` rebuilds the expression `e` with the slice of every leaf collapsed by `Segments`
+        // under `fusible`, so that the leaves and the destination share one grouping of the dimensions.
+
+        template <typename T, size_t N, typename F>
+        Expr_leaf<T, N> plan_node(const Expr_leaf<T, N> &e, const F &fusible)
+        {
+            return Expr_leaf<T, N>(Segments<N>(e.descriptor(), fusible).collapsed(), e.data());
+        }
+
+        template <typename T, size_t N, typename F>
+        Expr_scalar<T, N> plan_node(const Expr_scalar<T, N> &e, const F &)
+        {
+            return e;
+        }
+
+        template <typename Op, typename E, typename F>
+        Expr_unary<Op, E> plan_node(const Expr_unary<Op, E> &e, const F &fusible)
+        {
+            return Expr_unary<Op, E>(plan_node(e.operand(), fusible));
+        }
+
+        template <typename Op, typename L, typename R, typename F>
+        Expr_binary<Op, L, R> plan_node(const Expr_binary<Op, L, R> &e, const F &fusible)
+        {
+            return Expr_binary<Op, L, R>(plan_node(e.left(), fusible), plan_node(e.right(), fusible));
+        }
+
+        // ------------------------------
+        // Classifying the operands of the element-wise operators
+
+        template <typename... Ts>
+        struct Make_void
+        {
+            using type = void;
+        };
+
+        template <typename... Ts>
+        using Void_t = typename Make_void<Ts...>::type;
+
+        template <typename T, size_t N>
+        Enable_if<(N > 0), Expr_leaf<T, N>> as_leaf(const Matrix_base<T, N> &); // only used in unevaluated contexts
+
+        /**
+         * @brief `Operand<X>::value` is true for the expressions, and for every `Matrix`/`Matrix_ref` of order > 0.
+         *        `Operand<X>::make` turns such an object into an expression node.
+         *
+         */
+        template <typename X, typename = void>
+        struct Operand : std::false_type
+        {
+        };
+
+        template <typename X>
+        struct Operand<X, Enable_if<Is_expr<X>::value, void>> : std::true_type
+        {
+            using type = X;
+            static const X &make(const X &x) { return x; }
+        };
+
+        template <typename X>
+        struct Operand<X, Enable_if<!Is_expr<X>::value, Void_t<decltype(as_leaf(std::declval<const X &>()))>>>
+            : std::true_type
+        {
+            using type = decltype(as_leaf(std::declval<const X &>()));
+            static type make(const X &x) { return type(x); }
+        };
+
+        /**
+         * @brief The result of an element-wise binary operator. `type` only exists when at least one side is an
+         *        operand and the other is an operand or a scalar convertible to its element type.
+         *        Two operands are broadcast to their common extents (see `broadcast_extents`), which leaves operands
+         *        of the same extents unchanged.
+         *
+         */
+        template <typename Op, typename L, typename R, bool = Operand<L>::value, bool = Operand<R>::value, typename = void>
+        struct Binary_result
+        {
+        };
+
+        template <typename Op, typename L, typename R>
+        struct Binary_result<Op, L, R, true, true, Enable_if<Operand<L>::value && Operand<R>::value, void>>
+        {
+            using LE = typename Operand<L>::type;
+            using RE = typename Operand<R>::type;
+            static constexpr size_t order = LE::order > RE::order ? LE::order : RE::order;
+            using type = Expr_binary<Op, Broadcast_node<LE, order>, Broadcast_node<RE, order>>;
+            static type make(const L &l, const R &r)
+            {
+                const LE le = Operand<L>::make(l);
+                const RE re = Operand<R>::make(r);
+                const std::array<size_t, order> extents = broadcast_extents(le.extents(), re.extents());
+                return type(broadcast_node(le, extents), broadcast_node(re, extents));
+            }
+        };
+
+        template <typename Op, typename L, typename R>
+        struct Binary_result<Op, L, R, true, false,
+                             Enable_if<Convertible<R, typename Operand<L>::type::value_type>::value, void>>
+        {
+            using E = typename Operand<L>::type;
+            using S = Expr_scalar<typename E::value_type, E::order>;
+            using type = Expr_binary<Op, E, S>;
+            static type make(const L &l, const R &r) { return type(Operand<L>::make(l), S(r)); }
+        };
+
+        template <typename Op, typename L, typename R>
+        struct Binary_result<Op, L, R, false, true,
+                             Enable_if<Convertible<L, typename Operand<R>::type::value_type>::value, void>>
+        {
+            using E = typename Operand<R>::type;
+            using S = Expr_scalar<typename E::value_type, E::order>;
+            using type = Expr_binary<Op, S, E>;
+            static type make(const L &l, const R &r) { return type(S(l), Operand<R>::make(r)); }
+        };
+
+        /**
+         * @brief `*` between two matrices is the matrix product, so only the forms with a scalar are element-wise.
+         *
+         */
+        template <typename L, typename R, bool = Operand<L>::value && Operand<R>::value>
+        struct Scaling_result : Binary_result<std::multiplies<>, L, R>
+        {
+        };
+
+        template <typename L, typename R>
+        struct Scaling_result<L, R, true>
+        {
+        };
+
+        /**
+         * @brief Whether `e` reads the region described by `s` through a view of another layout, so that evaluating
+         *        it in place would read elements already overwritten: `a + a.row(0)` or `transpose(a) * 2` assigned to
+         *        `a`, or `v(Slice(0, 4))` assigned to `v(Slice(1, 5))`.
+         *
+         */
+        template <typename E, size_t N, typename T>
+        bool aliases_destination(const E &e, const Matrix_slice<N> &s, const T *base)
+        {
+            return s.size > 0 && e.reads_overlapping(base + s.start, base + span(s), s);
+        }
+
+        /**
+         * @brief Evaluate `e` into the region described by `s`, in a single pass and without temporaries.
+         *        Elements are only read at the position they are written to, so `m = m * 2 + 1` is safe. An
+         *        expression reading the destination with another layout is evaluated into a temporary first (see
+         *        `aliases_destination`).
+         *
+         */
+        template <typename E, size_t N, typename T>
+        void eval_into(const E &e, const Matrix_slice<N> &s, T *base)
+        {
+            static_assert(E::order == N, "eval_into: unmatched dimensions.");
+            assert(e.extents() == s.extents);
+            if (aliases_destination(e, s, base))
+            {
+                const Matrix<T, N> tmp(e);
+                eval_into(Expr_leaf<T, N>(tmp), s, base);
+                return;
+            }
+            MAT_TELEMETRY_SCOPE(expr_eval, s, sizeof(T));
+
+            if (is_contiguous(s) && e.contiguous())
+            {
+                T *p = base + s.start;
+                parallel_chunks(execution::par_unseq, s.size, [&](size_t first, size_t last)
+                                {
+#pragma omp simd
+                                    for (size_t i = first; i < last; ++i)
+                                        p[i] = T(e.flat(i)); });
+                return;
+            }
+
+            if (s.size == 0)
+                return;
+            // merge the dimensions that are collapsible for the destination and for every leaf alike
+            auto fusible = [&](size_t p, size_t d)
+            { return s.strides[p] == s.strides[d] * s.extents[d] && e.fusible(p, d); };
+            const Segments<N> g(s, fusible);
+            const Matrix_slice<N> c = g.collapsed();
+            const E planned = plan_node(e, fusible);
+            parallel_chunks(execution::par_unseq, s.size, [&](size_t first, size_t last)
+                            {
+                                E local = planned; // the row cursors of the leaves are per thread
+                                std::array<size_t, N> cursor{};
+                                size_t rem = first;
+                                for (size_t d = N; d-- > 0;)
+                                    cursor[d] = rem % c.extents[d], rem /= c.extents[d];
+                                for_each_run(g, base, first, last, [&](T *q, size_t len, size_t stride)
+                                             {
+                                                 local.seek(cursor);
+                                                 const size_t j0 = cursor[N - 1];
+                                                 if (stride == 1)
+                                                 {
+#pragma omp simd
+                                                     for (size_t j = 0; j < len; ++j)
+                                                         q[j] = T(local.inner(j0 + j));
+                                                 }
+                                                 else
+                                                     for (size_t j = 0; j < len; ++j)
+                                                         q[j * stride] = T(local.inner(j0 + j));
+                                                 cursor[N - 1] += len;
+                                                 for (size_t d = N - 1; d > 0 && cursor[d] == c.extents[d]; --d)
+                                                     cursor[d] = 0, ++cursor[d - 1]; }); });
+        }
+    };
+
+    // ------------------------------
+    // Element-wise operators
+
+    template <typename L, typename R>
+    typename Matrix_impl::Binary_result<std::plus<>, L, R>::type operator+(const L &l, const R &r)
+    {
+        return Matrix_impl::Binary_result<std::plus<>, L, R>::make(l, r);
+    }
+
+    template <typename L, typename R>
+    typename Matrix_impl::Binary_result<std::minus<>, L, R>::type operator-(const L &l, const R &r)
+    {
+        return Matrix_impl::Binary_result<std::minus<>, L, R>::make(l, r);
+    }
+
+    template <typename L, typename R>
+    typename Matrix_impl::Scaling_result<L, R>::type operator*(const L &l, const R &r)
+    {
+        return Matrix_impl::Scaling_result<L, R>::make(l, r);
+    }
+
+    template <typename L, typename R>
+    typename Matrix_impl::Binary_result<std::divides<>, L, R>::type operator/(const L &l, const R &r)
+    {
+        return Matrix_impl::Binary_result<std::divides<>, L, R>::make(l, r);
+    }
+
+    template <typename L, typename R>
+    typename Matrix_impl::Binary_result<std::modulus<>, L, R>::type operator%(const L &l, const R &r)
+    {
+        return Matrix_impl::Binary_result<std::modulus<>, L, R>::make(l, r);
+    }
+
+    template <typename X>
+    Matrix_impl::Expr_unary<std::negate<>, typename Matrix_impl::Operand<X>::type> operator-(const X &x)
+    {
+        return Matrix_impl::Expr_unary<std::negate<>, typename Matrix_impl::Operand<X>::type>(Matrix_impl::Operand<X>::make(x));
+    }
+
+    /**
+     * @brief Element-wise (Hadamard) product of two matrices of the same extents.
+     *
+     */
+    template <typename L, typename R>
+    typename Matrix_impl::Binary_result<std::multiplies<>, L, R, true, true>::type hadamard(const L &l, const R &r)
+    {
+        return Matrix_impl::Binary_result<std::multiplies<>, L, R, true, true>::make(l, r);
+    }
+
+    // ------------------------------
+    // Operators that reuse the buffer of an rvalue `Matrix`, so that `std::move(m) * 3 + 1` never allocates.
+    // They assign through `Matrix::operator=`, so an operand reading `m` through a view of another layout, such as
+    // `transpose(m)`, is evaluated into a new buffer instead (see `aliases_destination`).
+
+    namespace Matrix_impl
+    {
+        template <typename S, typename T>
+        using Is_scalar_for = std::integral_constant<bool, !Operand<S>::value && Convertible<S, T>::value>;
+
+        template <typename S, typename T, size_t N, typename A>
+        using Rvalue_scalar_result = Enable_if<(N > 0) && Is_scalar_for<S, T>::value, Matrix<T, N, A>>;
+
+        template <typename X, typename = void>
+        struct Operand_order : std::integral_constant<size_t, 0>
+        {
+        };
+
+        template <typename X>
+        struct Operand_order<X, Enable_if<Operand<X>::value, void>> : std::integral_constant<size_t, Operand<X>::type::order>
+        {
+        };
+
+        // the result must have the order of `m` to reuse it; one of other extents is evaluated by `Matrix::operator=`
+        template <typename X, size_t N, typename T, typename A>
+        using Rvalue_operand_result = Enable_if<(N > 0) && Operand<X>::value && Operand_order<X>::value <= N, Matrix<T, N, A>>;
+    };
+
+    template <typename T, size_t N, typename A, typename S>
+    Matrix_impl::Rvalue_scalar_result<S, T, N, A> operator+(Matrix<T, N, A> &&m, const S &val)
+    {
+        m += T(val);
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A, typename S>
+    Matrix_impl::Rvalue_scalar_result<S, T, N, A> operator+(const S &val, Matrix<T, N, A> &&m)
+    {
+        m += T(val);
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A, typename S>
+    Matrix_impl::Rvalue_scalar_result<S, T, N, A> operator-(Matrix<T, N, A> &&m, const S &val)
+    {
+        m -= T(val);
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A, typename S>
+    Matrix_impl::Rvalue_scalar_result<S, T, N, A> operator-(const S &val, Matrix<T, N, A> &&m)
+    {
+        m = T(val) - m;
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A, typename S>
+    Matrix_impl::Rvalue_scalar_result<S, T, N, A> operator*(Matrix<T, N, A> &&m, const S &val)
+    {
+        m *= T(val);
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A, typename S>
+    Matrix_impl::Rvalue_scalar_result<S, T, N, A> operator*(const S &val, Matrix<T, N, A> &&m)
+    {
+        m *= T(val);
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A, typename S>
+    Matrix_impl::Rvalue_scalar_result<S, T, N, A> operator/(Matrix<T, N, A> &&m, const S &val)
+    {
+        m /= T(val);
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A, typename S>
+    Matrix_impl::Rvalue_scalar_result<S, T, N, A> operator/(const S &val, Matrix<T, N, A> &&m)
+    {
+        m = T(val) / m;
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A, typename S>
+    Matrix_impl::Rvalue_scalar_result<S, T, N, A> operator%(Matrix<T, N, A> &&m, const S &val)
+    {
+        m %= T(val);
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A, typename S>
+    Matrix_impl::Rvalue_scalar_result<S, T, N, A> operator%(const S &val, Matrix<T, N, A> &&m)
+    {
+        m = T(val) % m;
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A>
+    Enable_if<(N > 0), Matrix<T, N, A>> operator-(Matrix<T, N, A> &&m)
+    {
+        m = -m;
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A, typename X>
+    Matrix_impl::Rvalue_operand_result<X, N, T, A> operator+(Matrix<T, N, A> &&m, const X &x)
+    {
+        m = m + x;
+        return std::move(m);
+    }
+
+    template <typename X, typename T, size_t N, typename A>
+    Matrix_impl::Rvalue_operand_result<X, N, T, A> operator+(const X &x, Matrix<T, N, A> &&m)
+    {
+        m = x + m;
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A>
+    Enable_if<(N > 0), Matrix<T, N, A>> operator+(Matrix<T, N, A> &&a, Matrix<T, N, A> &&b)
+    {
+        a = a + b;
+        return std::move(a);
+    }
+
+    template <typename T, size_t N, typename A, typename X>
+    Matrix_impl::Rvalue_operand_result<X, N, T, A> operator-(Matrix<T, N, A> &&m, const X &x)
+    {
+        m = m - x;
+        return std::move(m);
+    }
+
+    template <typename X, typename T, size_t N, typename A>
+    Matrix_impl::Rvalue_operand_result<X, N, T, A> operator-(const X &x, Matrix<T, N, A> &&m)
+    {
+        m = x - m;
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A>
+    Enable_if<(N > 0), Matrix<T, N, A>> operator-(Matrix<T, N, A> &&a, Matrix<T, N, A> &&b)
+    {
+        a = a - b;
+        return std::move(a);
+    }
+
+    template <typename T, size_t N, typename A, typename X>
+    Matrix_impl::Rvalue_operand_result<X, N, T, A> hadamard(Matrix<T, N, A> &&m, const X &x)
+    {
+        m = hadamard(m, x);
+        return std::move(m);
+    }
+
+    template <typename X, typename T, size_t N, typename A>
+    Matrix_impl::Rvalue_operand_result<X, N, T, A> hadamard(const X &x, Matrix<T, N, A> &&m)
+    {
+        m = hadamard(x, m);
+        return std::move(m);
+    }
+
+    template <typename T, size_t N, typename A>
+    Enable_if<(N > 0), Matrix<T, N, A>> hadamard(Matrix<T, N, A> &&a, Matrix<T, N, A> &&b)
+    {
+        a = hadamard(a, b);
+        return std::move(a);
+    }
+
+    namespace Matrix_impl
+    {
+        template <typename E>
+        auto product_operand(const E &e, std::true_type) { return e.eval(); }
+
+        template <typename M>
+        const M &product_operand(const M &m, std::false_type) { return m; }
+    };
+
+    /**
+     * @brief Matrix product where an operand is an expression: the expression is evaluated first.
+     *
+     */
+    template <typename L, typename R>
+    Enable_if<(Matrix_impl::Is_expr<L>::value || Matrix_impl::Is_expr<R>::value) &&
+                  Matrix_impl::Operand<L>::type::order == 2 && Matrix_impl::Operand<R>::type::order == 2,
+              Matrix<typename Matrix_impl::Operand<L>::type::value_type, 2>>
+    operator*(const L &l, const R &r)
+    {
+        return Matrix_impl::product_operand(l, Matrix_impl::Is_expr<L>()) * Matrix_impl::product_operand(r, Matrix_impl::Is_expr<R>());
+    }
+
+    /**
+     * @brief A view of `m` repeated to `extents` following the broadcasting rules of the element-wise operators,
+     *        with a stride of 0 along the repeated dimensions. Several positions of the view share an element, so it
+     *        is meant to be read.
+     *
+     */
+    template <size_t M, typename T, size_t N>
+    Matrix_ref<T, M> broadcast_to(Matrix_base<T, N> &m, const std::array<size_t, M> &extents)
+    {
+        assert(Matrix_impl::broadcast_extents(m.descriptor().extents, extents) == extents);
+        return Matrix_ref<T, M>(Matrix_impl::broadcast_slice(m.descriptor(), extents), m.data());
+    }
+
+    /**
+     * @brief Evaluate an expression into a new `Matrix`.
+     *
+     */
+    template <typename E>
+    Enable_if<Matrix_impl::Is_expr<E>::value, Matrix<typename E::value_type, E::order>> eval(const E &e)
+    {
+        return e.eval();
+    }
+};
+
+#endif
@@ -0,0 +1,726 @@
+/**
+ * @file mat_gemm.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the general matrix multiplication (GEMM) routines for `Matrix<T, 2>`, and the batched
+ *        products of `Matrix<T, 3>`. The design follows the packed, cache-blocked scheme of GotoBLAS/BLIS: operands
+ *        are packed into contiguous panels, tiled for L1/L2/L3, and multiplied by a register-blocked micro-kernel.
+ *        Small products skip the packing and accumulate rows of the result in registers directly.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_GEMM_H
+#define MAT_GEMM_H
+
+#include "mat.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define MAT_GEMM_X86 1
+#endif
+
+// Cache sizes used to derive the blocking parameters. Define them before including this file to tune for a machine.
+#ifndef MAT_GEMM_L1_BYTES
+#define MAT_GEMM_L1_BYTES (32 * 1024)
+#endif
+#ifndef MAT_GEMM_L2_BYTES
+#define MAT_GEMM_L2_BYTES (1024 * 1024)
+#endif
+#ifndef MAT_GEMM_L3_BYTES
+#define MAT_GEMM_L3_BYTES (8 * 1024 * 1024)
+#endif
+
+namespace utils
+{
+    namespace Matrix_impl
+    {
+        /**
+         * @brief A micro-kernel computes the `mr * nr` product of a packed `A` micro-panel (`kc * mr`) and
+         *        a packed `B` micro-panel (`kc * nr`), and stores it column-major into `ab`.
+         *
+         */
+        template <typename T>
+        using Gemm_micro_kernel = void (*)(size_t kc, const T *a, const T *b, T *ab);
+
+        template <typename T>
+        struct Gemm_kernel
+        {
+            size_t mr;
+            size_t nr;
+            Gemm_micro_kernel<T> run;
+        };
+
+        /**
+         * @brief Blocking parameters: `kc` keeps a `B` micro-panel in L1, `mc` keeps the packed `A` block in L2,
+         *        and `nc` keeps the packed `B` block in L3.
+         *
+         */
+        struct Gemm_blocking
+        {
+            size_t mc;
+            size_t kc;
+            size_t nc;
+        };
+
+        inline size_t round_down(size_t x, size_t m) { return std::max(m, x / m * m); }
+
+        template <typename T>
+        Gemm_blocking gemm_blocking(const Gemm_kernel<T> &ker)
+        {
+            Gemm_blocking blk;
+            blk.kc = std::min<size_t>(std::max<size_t>(MAT_GEMM_L1_BYTES / (2 * ker.nr * sizeof(T)), 64), 512);
+            blk.kc = round_down(blk.kc, 8);
+            blk.mc = round_down(MAT_GEMM_L2_BYTES / (2 * blk.kc * sizeof(T)), ker.mr);
+            blk.nc = round_down(MAT_GEMM_L3_BYTES / (2 * blk.kc * sizeof(T)), ker.nr);
+            return blk;
+        }
+
+        /**
+         * @brief Portable micro-kernel. The fixed trip counts let the compiler keep the tile in registers.
+         *
+         */
+        template <typename T, size_t MR, size_t NR>
+        void gemm_kernel_generic(size_t kc, const T *a, const T *b, T *ab)
+        {
+            T acc[MR * NR]{};
+            for (size_t p = 0; p < kc; ++p, a += MR, b += NR)
+                for (size_t j = 0; j < NR; ++j)
+                    for (size_t i = 0; i < MR; ++i)
+                        acc[j * MR + i] += a[i] * b[j];
+            std::copy(acc, acc + MR * NR, ab);
+        }
+
+#ifdef MAT_GEMM_X86
+        template <size_t NR>
+        __attribute__((target("avx2,fma"))) void gemm_kernel_avx2_f64(size_t kc, const double *a, const double *b, double *ab)
+        {
+            __m256d c[NR][2];
+            for (size_t j = 0; j < NR; ++j)
+                c[j][0] = c[j][1] = _mm256_setzero_pd();
+            for (size_t p = 0; p < kc; ++p, a += 8, b += NR)
+            {
+                __m256d a0 = _mm256_loadu_pd(a), a1 = _mm256_loadu_pd(a + 4);
+                for (size_t j = 0; j < NR; ++j)
+                {
+                    __m256d bj = _mm256_broadcast_sd(b + j);
+                    c[j][0] = _mm256_fmadd_pd(a0, bj, c[j][0]);
+                    c[j][1] = _mm256_fmadd_pd(a1, bj, c[j][1]);
+                }
+            }
+            for (size_t j = 0; j < NR; ++j)
+            {
+                _mm256_storeu_pd(ab + j * 8, c[j][0]);
+                _mm256_storeu_pd(ab + j * 8 + 4, c[j][1]);
+            }
+        }
+
+        template <size_t NR>
+        __attribute__((target("avx2,fma"))) void gemm_kernel_avx2_f32(size_t kc, const float *a, const float *b, float *ab)
+        {
+            __m256 c[NR][2];
+            for (size_t j = 0; j < NR; ++j)
+                c[j][0] = c[j][1] = _mm256_setzero_ps();
+            for (size_t p = 0; p < kc; ++p, a += 16, b += NR)
+            {
+                __m256 a0 = _mm256_loadu_ps(a), a1 = _mm256_loadu_ps(a + 8);
+                for (size_t j = 0; j < NR; ++j)
+                {
+                    __m256 bj = _mm256_broadcast_ss(b + j);
+                    c[j][0] = _mm256_fmadd_ps(a0, bj, c[j][0]);
+                    c[j][1] = _mm256_fmadd_ps(a1, bj, c[j][1]);
+                }
+            }
+            for (size_t j = 0; j < NR; ++j)
+            {
+                _mm256_storeu_ps(ab + j * 16, c[j][0]);
+                _mm256_storeu_ps(ab + j * 16 + 8, c[j][1]);
+            }
+        }
+
+        template <size_t NR>
+        __attribute__((target("avx512f"))) void gemm_kernel_avx512_f64(size_t kc, const double *a, const double *b, double *ab)
+        {
+            __m512d c[NR][2];
+            for (size_t j = 0; j < NR; ++j)
+                c[j][0] = c[j][1] = _mm512_setzero_pd();
+            for (size_t p = 0; p < kc; ++p, a += 16, b += NR)
+            {
+                __m512d a0 = _mm512_loadu_pd(a), a1 = _mm512_loadu_pd(a + 8);
+                for (size_t j = 0; j < NR; ++j)
+                {
+                    __m512d bj = _mm512_set1_pd(b[j]);
+                    c[j][0] = _mm512_fmadd_pd(a0, bj, c[j][0]);
+                    c[j][1] = _mm512_fmadd_pd(a1, bj, c[j][1]);
+                }
+            }
+            for (size_t j = 0; j < NR; ++j)
+            {
+                _mm512_storeu_pd(ab + j * 16, c[j][0]);
+                _mm512_storeu_pd(ab + j * 16 + 8, c[j][1]);
+            }
+        }
+
+        template <size_t NR>
+        __attribute__((target("avx512f"))) void gemm_kernel_avx512_f32(size_t kc, const float *a, const float *b, float *ab)
+        {
+            __m512 c[NR][2];
+            for (size_t j = 0; j < NR; ++j)
+                c[j][0] = c[j][1] = _mm512_setzero_ps();
+            for (size_t p = 0; p < kc; ++p, a += 32, b += NR)
+            {
+                __m512 a0 = _mm512_loadu_ps(a), a1 = _mm512_loadu_ps(a + 16);
+                for (size_t j = 0; j < NR; ++j)
+                {
+                    __m512 bj = _mm512_set1_ps(b[j]);
+                    c[j][0] = _mm512_fmadd_ps(a0, bj, c[j][0]);
+                    c[j][1] = _mm512_fmadd_ps(a1, bj, c[j][1]);
+                }
+            }
+            for (size_t j = 0; j < NR; ++j)
+            {
+                _mm512_storeu_ps(ab + j * 32, c[j][0]);
+                _mm512_storeu_ps(ab + j * 32 + 16, c[j][1]);
+            }
+        }
+#endif
+
+        /**
+         * @brief Select the micro-kernel once, according to the instruction sets of the running CPU.
+         *
+         */
+        template <typename T>
+        const Gemm_kernel<T> &gemm_select_kernel()
+        {
+            static const Gemm_kernel<T> ker{4, 4, gemm_kernel_generic<T, 4, 4>};
+            return ker;
+        }
+
+        template <>
+        inline const Gemm_kernel<double> &gemm_select_kernel<double>()
+        {
+            static const Gemm_kernel<double> ker = []() -> Gemm_kernel<double>
+            {
+#ifdef MAT_GEMM_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx512f"))
+                    return {16, 12, gemm_kernel_avx512_f64<12>};
+                if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                    return {8, 6, gemm_kernel_avx2_f64<6>};
+#endif
+                return {8, 4, gemm_kernel_generic<double, 8, 4>};
+            }();
+            return ker;
+        }
+
+        template <>
+        inline const Gemm_kernel<float> &gemm_select_kernel<float>()
+        {
+            static const Gemm_kernel<float> ker = []() -> Gemm_kernel<float>
+            {
+#ifdef MAT_GEMM_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx512f"))
+                    return {32, 12, gemm_kernel_avx512_f32<12>};
+                if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                    return {16, 6, gemm_kernel_avx2_f32<6>};
+#endif
+                return {16, 4, gemm_kernel_generic<float, 16, 4>};
+            }();
+            return ker;
+        }
+
+        constexpr size_t gemm_small_max = 128; // largest side of a product run without packing
+
+        /**
+         * @brief `C = alpha * A * B + beta * C` for the columns `[0, NV * L)` of a small product, with `B` and `C`
+         *        row-major: four rows of `C` are accumulated in registers as `NV` vectors each, from rows of `B`
+         *        loaded directly and broadcast elements of `A`. Inlined into each target-specific kernel below.
+         *
+         */
+        template <size_t Bytes, size_t NV, typename T>
+        __attribute__((always_inline)) inline void gemm_small_panel(size_t m, size_t k, T alpha, const T *a, ptrdiff_t rsa,
+                                                                   ptrdiff_t csa, const T *b, ptrdiff_t rsb, T beta,
+                                                                   T *c, ptrdiff_t rsc)
+        {
+            using V = typename Simd_vector<T, Bytes>::type;
+            constexpr size_t L = Bytes / sizeof(T);
+            constexpr size_t MB = 4;
+            auto store = [&](T *row, V *acc)
+            {
+#pragma GCC unroll 16
+                for (size_t v = 0; v < NV; ++v)
+                {
+                    V x = alpha * acc[v];
+                    if (beta != T(0))
+                    {
+                        V y;
+                        std::memcpy(&y, row + v * L, Bytes);
+                        x += beta * y;
+                    }
+                    std::memcpy(row + v * L, &x, Bytes);
+                }
+            };
+            size_t i = 0;
+            for (; i + MB <= m; i += MB)
+            {
+                V acc[MB][NV] = {};
+                const T *ai = a + ptrdiff_t(i) * rsa;
+                for (size_t p = 0; p < k; ++p)
+                {
+                    V bv[NV];
+#pragma GCC unroll 16
+                    for (size_t v = 0; v < NV; ++v)
+                        std::memcpy(&bv[v], b + ptrdiff_t(p) * rsb + ptrdiff_t(v * L), Bytes);
+#pragma GCC unroll 16
+                    for (size_t r = 0; r < MB; ++r)
+                    {
+                        const V av = V{} + ai[ptrdiff_t(r) * rsa + ptrdiff_t(p) * csa];
+#pragma GCC unroll 16
+                        for (size_t v = 0; v < NV; ++v)
+                            acc[r][v] += av * bv[v];
+                    }
+                }
+#pragma GCC unroll 16
+                for (size_t r = 0; r < MB; ++r)
+                    store(c + ptrdiff_t(i + r) * rsc, acc[r]);
+            }
+            for (; i < m; ++i)
+            {
+                V acc[NV] = {};
+                for (size_t p = 0; p < k; ++p)
+                {
+                    const V av = V{} + a[ptrdiff_t(i) * rsa + ptrdiff_t(p) * csa];
+#pragma GCC unroll 16
+                    for (size_t v = 0; v < NV; ++v)
+                    {
+                        V bv;
+                        std::memcpy(&bv, b + ptrdiff_t(p) * rsb + ptrdiff_t(v * L), Bytes);
+                        acc[v] += av * bv;
+                    }
+                }
+                store(c + ptrdiff_t(i) * rsc, acc);
+            }
+        }
+
+        /**
+         * @brief The last columns, narrower than a vector: when `C` is only written, the last vector of columns is
+         *        computed again in full, otherwise they are computed one by one.
+         *
+         */
+        template <size_t Bytes, typename T>
+        __attribute__((always_inline)) inline void gemm_small_columns(std::integral_constant<size_t, 0>, size_t j, size_t m,
+                                                                     size_t n, size_t k, T alpha, const T *a, ptrdiff_t rsa,
+                                                                     ptrdiff_t csa, const T *b, ptrdiff_t rsb, T beta,
+                                                                     T *c, ptrdiff_t rsc)
+        {
+            constexpr size_t L = Bytes / sizeof(T);
+            if (j == n)
+                return;
+            if (n >= L && beta == T(0))
+            {
+                gemm_small_panel<Bytes, 1>(m, k, alpha, a, rsa, csa, b + (n - L), rsb, beta, c + (n - L), rsc);
+                return;
+            }
+            for (; j < n; ++j)
+                for (size_t i = 0; i < m; ++i)
+                {
+                    T acc = T();
+                    for (size_t p = 0; p < k; ++p)
+                        acc += a[ptrdiff_t(i) * rsa + ptrdiff_t(p) * csa] * b[ptrdiff_t(p) * rsb + ptrdiff_t(j)];
+                    T &x = c[ptrdiff_t(i) * rsc + ptrdiff_t(j)];
+                    x = (beta == T(0)) ? alpha * acc : alpha * acc + beta * x;
+                }
+        }
+
+        /**
+         * @brief The columns `[j, n)` of a small product with row-major `B` and `C`, in panels of `NV` vectors, then
+         *        of half as many, down to single vectors.
+         *
+         */
+        template <size_t Bytes, size_t NV, typename T>
+        __attribute__((always_inline)) inline void gemm_small_columns(std::integral_constant<size_t, NV>, size_t j, size_t m,
+                                                                     size_t n, size_t k, T alpha, const T *a, ptrdiff_t rsa,
+                                                                     ptrdiff_t csa, const T *b, ptrdiff_t rsb, T beta,
+                                                                     T *c, ptrdiff_t rsc)
+        {
+            constexpr size_t L = Bytes / sizeof(T);
+            for (; j + NV * L <= n; j += NV * L)
+                gemm_small_panel<Bytes, NV>(m, k, alpha, a, rsa, csa, b + j, rsb, beta, c + j, rsc);
+            gemm_small_columns<Bytes>(std::integral_constant<size_t, NV / 2>(), j, m, n, k, alpha, a, rsa, csa, b, rsb,
+                                      beta, c, rsc);
+        }
+
+        template <size_t Bytes, size_t NV, typename T>
+        __attribute__((always_inline)) inline void gemm_small_loop(size_t m, size_t n, size_t k, T alpha, const T *a,
+                                                                  ptrdiff_t rsa, ptrdiff_t csa, const T *b, ptrdiff_t rsb,
+                                                                  T beta, T *c, ptrdiff_t rsc)
+        {
+            gemm_small_columns<Bytes>(std::integral_constant<size_t, NV>(), 0, m, n, k, alpha, a, rsa, csa, b, rsb,
+                                      beta, c, rsc);
+        }
+
+        template <typename T>
+        using Gemm_small_kernel = void (*)(size_t m, size_t n, size_t k, T alpha, const T *a, ptrdiff_t rsa, ptrdiff_t csa,
+                                           const T *b, ptrdiff_t rsb, T beta, T *c, ptrdiff_t rsc);
+
+        template <typename T>
+        void gemm_small_generic(size_t m, size_t n, size_t k, T alpha, const T *a, ptrdiff_t rsa, ptrdiff_t csa,
+                                const T *b, ptrdiff_t rsb, T beta, T *c, ptrdiff_t rsc)
+        {
+            gemm_small_loop<16, 2>(m, n, k, alpha, a, rsa, csa, b, rsb, beta, c, rsc);
+        }
+
+#ifdef MAT_GEMM_X86
+        // 4 x 4 zmm accumulators, and 4 x 2 ymm ones, leave room for the rows of B within the register file
+        template <typename T>
+        __attribute__((target("avx512f"))) void gemm_small_avx512(size_t m, size_t n, size_t k, T alpha, const T *a,
+                                                                  ptrdiff_t rsa, ptrdiff_t csa, const T *b, ptrdiff_t rsb,
+                                                                  T beta, T *c, ptrdiff_t rsc)
+        {
+            gemm_small_loop<64, 4>(m, n, k, alpha, a, rsa, csa, b, rsb, beta, c, rsc);
+        }
+
+        template <typename T>
+        __attribute__((target("avx2,fma"))) void gemm_small_avx2(size_t m, size_t n, size_t k, T alpha, const T *a,
+                                                                 ptrdiff_t rsa, ptrdiff_t csa, const T *b, ptrdiff_t rsb,
+                                                                 T beta, T *c, ptrdiff_t rsc)
+        {
+            gemm_small_loop<32, 2>(m, n, k, alpha, a, rsa, csa, b, rsb, beta, c, rsc);
+        }
+#endif
+
+        template <typename T>
+        Gemm_small_kernel<T> gemm_select_small(std::false_type)
+        {
+            return nullptr;
+        }
+
+        template <typename T>
+        Gemm_small_kernel<T> gemm_select_small(std::true_type)
+        {
+            static const Gemm_small_kernel<T> ker = []() -> Gemm_small_kernel<T>
+            {
+#ifdef MAT_GEMM_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx512f"))
+                    return gemm_small_avx512<T>;
+                if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                    return gemm_small_avx2<T>;
+#endif
+                return gemm_small_generic<T>;
+            }();
+            return ker;
+        }
+
+        /**
+         * @brief The small-product kernel for the running CPU; null except for `float` and `double`.
+         *
+         */
+        template <typename T>
+        Gemm_small_kernel<T> gemm_select_small()
+        {
+            return gemm_select_small<T>(std::integral_constant<bool, std::is_same<T, float>::value ||
+                                                                      std::is_same<T, double>::value>());
+        }
+
+        /**
+         * @brief Pack an `mc * kc` block of `A` into micro-panels of `mr` rows, zero-padding the last panel.
+         *
+         */
+        template <typename T>
+        void gemm_pack_a(size_t mc, size_t kc, const T *a, ptrdiff_t rsa, ptrdiff_t csa, size_t mr, T *buf)
+        {
+            for (size_t i = 0; i < mc; i += mr, buf += mr * kc)
+            {
+                size_t ib = std::min(mr, mc - i);
+                const T *src = a + ptrdiff_t(i) * rsa;
+                if (csa == 1)
+                {
+                    for (size_t ii = 0; ii < ib; ++ii)
+                        for (size_t p = 0; p < kc; ++p)
+                            buf[p * mr + ii] = src[ptrdiff_t(ii) * rsa + ptrdiff_t(p)];
+                }
+                else
+                {
+                    for (size_t p = 0; p < kc; ++p)
+                        for (size_t ii = 0; ii < ib; ++ii)
+                            buf[p * mr + ii] = src[ptrdiff_t(ii) * rsa + ptrdiff_t(p) * csa];
+                }
+                for (size_t p = 0; ib < mr && p < kc; ++p)
+                    std::fill(buf + p * mr + ib, buf + (p + 1) * mr, T());
+            }
+        }
+
+        /**
+         * @brief Pack a `kc * nc` block of `B` into micro-panels of `nr` columns, zero-padding the last panel.
+         *
+         */
+        template <typename T>
+        void gemm_pack_b(size_t kc, size_t nc, const T *b, ptrdiff_t rsb, ptrdiff_t csb, size_t nr, T *buf)
+        {
+            for (size_t j = 0; j < nc; j += nr, buf += nr * kc)
+            {
+                size_t jb = std::min(nr, nc - j);
+                const T *src = b + ptrdiff_t(j) * csb;
+                if (csb == 1)
+                {
+                    for (size_t p = 0; p < kc; ++p)
+                        for (size_t jj = 0; jj < jb; ++jj)
+                            buf[p * nr + jj] = src[ptrdiff_t(p) * rsb + ptrdiff_t(jj)];
+                }
+                else
+                {
+                    for (size_t jj = 0; jj < jb; ++jj)
+                        for (size_t p = 0; p < kc; ++p)
+                            buf[p * nr + jj] = src[ptrdiff_t(p) * rsb + ptrdiff_t(jj) * csb];
+                }
+                for (size_t p = 0; jb < nr && p < kc; ++p)
+                    std::fill(buf + p * nr + jb, buf + (p + 1) * nr, T());
+            }
+        }
+
+        /**
+         * @brief `C = alpha * AB + beta * C` on an `m * n` tile. `C` is not read when `beta` is zero.
+         *
+         */
+        template <typename T>
+        void gemm_update_tile(size_t m, size_t n, const T &alpha, const T *ab, size_t ldab, const T &beta,
+                              T *c, ptrdiff_t rsc, ptrdiff_t csc)
+        {
+            for (size_t j = 0; j < n; ++j)
+            {
+                T *cj = c + ptrdiff_t(j) * csc;
+                const T *abj = ab + j * ldab;
+                if (beta == T(0))
+                    for (size_t i = 0; i < m; ++i)
+                        cj[ptrdiff_t(i) * rsc] = alpha * abj[i];
+                else
+                    for (size_t i = 0; i < m; ++i)
+                        cj[ptrdiff_t(i) * rsc] = alpha * abj[i] + beta * cj[ptrdiff_t(i) * rsc];
+            }
+        }
+
+        template <typename T>
+        void gemm_scale(size_t m, size_t n, const T &beta, T *c, ptrdiff_t rsc, ptrdiff_t csc)
+        {
+            for (size_t i = 0; i < m; ++i)
+                for (size_t j = 0; j < n; ++j)
+                {
+                    T &x = c[ptrdiff_t(i) * rsc + ptrdiff_t(j) * csc];
+                    x = (beta == T(0)) ? T() : beta * x;
+                }
+        }
+
+        /**
+         * @brief Per-thread packing buffers, reused across calls so that repeated products do not allocate.
+         *
+         */
+        template <typename T>
+        T *gemm_workspace(size_t which, size_t n)
+        {
+            thread_local std::vector<T> buf[2];
+            if (buf[which].size() < n)
+                buf[which].resize(n);
+            return buf[which].data();
+        }
+
+        /**
+         * @brief `C = alpha * A * B + beta * C` on raw strided storage. `A` is `m * k`, `B` is `k * n`, `C` is `m * n`,
+         *        and element `(i, j)` of a operand `X` lives at `x + i * rsx + j * csx`.
+         * @note `C` must not alias `A` or `B`.
+         */
+        template <typename T>
+        void gemm_strided(size_t m, size_t n, size_t k, const T &alpha,
+                          const T *a, ptrdiff_t rsa, ptrdiff_t csa,
+                          const T *b, ptrdiff_t rsb, ptrdiff_t csb,
+                          const T &beta, T *c, ptrdiff_t rsc, ptrdiff_t csc)
+        {
+            if (m == 0 || n == 0)
+                return;
+            if (k == 0 || alpha == T(0))
+            {
+                gemm_scale(m, n, beta, c, rsc, csc);
+                return;
+            }
+
+            // Small products with row-major B and C are computed in registers without packing.
+            if (csc == 1 && csb == 1 && std::max({m, n, k}) <= gemm_small_max)
+                if (Gemm_small_kernel<T> small = gemm_select_small<T>())
+                {
+                    small(m, n, k, alpha, a, rsa, csa, b, rsb, beta, c, rsc);
+                    return;
+                }
+
+            // The micro-tile is written along its rows, so a row-major C is handled as C^T = B^T * A^T.
+            if (csc == 1 && rsc != 1)
+            {
+                std::swap(m, n);
+                std::swap(a, b);
+                std::swap(rsa, csb);
+                std::swap(csa, rsb);
+                std::swap(rsc, csc);
+            }
+
+            // Small products are not worth packing.
+            if (m * n * k <= 16 * 16 * 16)
+            {
+                for (size_t j = 0; j < n; ++j)
+                    for (size_t i = 0; i < m; ++i)
+                    {
+                        T acc = T();
+                        for (size_t p = 0; p < k; ++p)
+                            acc += a[ptrdiff_t(i) * rsa + ptrdiff_t(p) * csa] * b[ptrdiff_t(p) * rsb + ptrdiff_t(j) * csb];
+                        T &x = c[ptrdiff_t(i) * rsc + ptrdiff_t(j) * csc];
+                        x = (beta == T(0)) ? alpha * acc : alpha * acc + beta * x;
+                    }
+                return;
+            }
+
+            const Gemm_kernel<T> &ker = gemm_select_kernel<T>();
+            const Gemm_blocking blk = gemm_blocking(ker);
+            const size_t mr = ker.mr, nr = ker.nr;
+
+            T *bp = gemm_workspace<T>(0, blk.kc * (std::min(blk.nc, n) + nr));
+            T *ap = gemm_workspace<T>(1, blk.kc * (std::min(blk.mc, m) + mr));
+            T ab[32 * 12]; // large enough for every registered micro-kernel
+
+            for (size_t jc = 0; jc < n; jc += blk.nc)
+            {
+                size_t nc = std::min(blk.nc, n - jc);
+                for (size_t pc = 0; pc < k; pc += blk.kc)
+                {
+                    size_t kc = std::min(blk.kc, k - pc);
+                    T beta_p = (pc == 0) ? beta : T(1);
+                    gemm_pack_b(kc, nc, b + ptrdiff_t(pc) * rsb + ptrdiff_t(jc) * csb, rsb, csb, nr, bp);
+
+                    for (size_t ic = 0; ic < m; ic += blk.mc)
+                    {
+                        size_t mc = std::min(blk.mc, m - ic);
+                        gemm_pack_a(mc, kc, a + ptrdiff_t(ic) * rsa + ptrdiff_t(pc) * csa, rsa, csa, mr, ap);
+
+                        for (size_t jr = 0; jr < nc; jr += nr)
+                            for (size_t ir = 0; ir < mc; ir += mr)
+                            {
+                                ker.run(kc, ap + ir * kc, bp + jr * kc, ab);
+                                gemm_update_tile(std::min(mr, mc - ir), std::min(nr, nc - jr), alpha, ab, mr, beta_p,
+                                                 c + ptrdiff_t(ic + ir) * rsc + ptrdiff_t(jc + jr) * csc, rsc, csc);
+                            }
+                    }
+                }
+            }
+        }
+    };
+
+    /**
+     * @brief General matrix multiplication, `C = alpha * A * B + beta * C`.
+     *        Each operand may be a `Matrix` or a `Matrix_ref` with arbitrary strides.
+     *
+     * @tparam T
+     * @param alpha
+     * @param a `m * k`
+     * @param b `k * n`
+     * @param beta
+     * @param c `m * n`, must not alias `a` or `b`.
+     */
+    template <typename T>
+    void gemm(const Non_deduced<T> &alpha, const Matrix_base<T, 2> &a, const Matrix_base<T, 2> &b,
+              const Non_deduced<T> &beta, Matrix_base<T, 2> &c)
+    {
+        const Matrix_slice<2> &da = a.descriptor(), &db = b.descriptor(), &dc = c.descriptor();
+        MAT_TELEMETRY_SCOPE(gemm, {dc.extents[0], dc.extents[1], da.extents[1]}, dc.size,
+                            (da.size + db.size + dc.size) * sizeof(T));
+        assert(da.extents[1] == db.extents[0]);
+        assert(dc.extents[0] == da.extents[0] && dc.extents[1] == db.extents[1]);
+        Matrix_impl::gemm_strided(dc.extents[0], dc.extents[1], da.extents[1], T(alpha),
+                                  a.data() + da.start, ptrdiff_t(da.strides[0]), ptrdiff_t(da.strides[1]),
+                                  b.data() + db.start, ptrdiff_t(db.strides[0]), ptrdiff_t(db.strides[1]),
+                                  T(beta), c.data() + dc.start, ptrdiff_t(dc.strides[0]), ptrdiff_t(dc.strides[1]));
+    }
+
+    template <typename T>
+    void gemm(const Non_deduced<T> &alpha, const Matrix_base<T, 2> &a, const Matrix_base<T, 2> &b,
+              const Non_deduced<T> &beta, Matrix_base<T, 2> &&c)
+    {
+        gemm(alpha, a, b, beta, c);
+    }
+
+    /**
+     * @brief Matrix product of two 2-dimensional matrices.
+     *
+     */
+    template <typename T>
+    Matrix<T, 2> operator*(const Matrix_base<T, 2> &a, const Matrix_base<T, 2> &b)
+    {
+        assert(a.columns() == b.rows());
+        MAT_TELEMETRY_SCOPE(gemm, {a.rows(), b.columns(), a.columns()}, a.rows() * b.columns(),
+                            (a.size() + b.size() + a.rows() * b.columns()) * sizeof(T));
+        Matrix<T, 2> res(a.rows(), b.columns());
+        gemm(T(1), a, b, T(0), res);
+        return res;
+    }
+
+    /**
+     * @brief Batched GEMM, `C[i] = alpha * A[i] * B[i] + beta * C[i]` for every index `i` of the leading axis.
+     *        The batch is split across threads, each product running on one thread, so that many small products
+     *        keep every core busy.
+     *
+     * @param a `batch * m * k`
+     * @param b `batch * k * n`
+     * @param c `batch * m * n`, must not alias `a` or `b`.
+     */
+    template <typename T>
+    void batched_gemm(const Non_deduced<T> &alpha, const Matrix_base<T, 3> &a, const Matrix_base<T, 3> &b,
+                      const Non_deduced<T> &beta, Matrix_base<T, 3> &c, const Execution_policy &policy = execution::par)
+    {
+        const Matrix_slice<3> &da = a.descriptor(), &db = b.descriptor(), &dc = c.descriptor();
+        const size_t batch = dc.extents[0], m = dc.extents[1], n = dc.extents[2], k = da.extents[2];
+        MAT_TELEMETRY_SCOPE(gemm, {batch, m, n, k}, dc.size, (da.size + db.size + dc.size) * sizeof(T));
+        assert(da.extents[0] == batch && db.extents[0] == batch);
+        assert(db.extents[1] == k && da.extents[1] == m && db.extents[2] == n);
+
+        const T *pa = a.data() + da.start, *pb = b.data() + db.start;
+        T *pc = c.data() + dc.start;
+        auto body = [&](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+                Matrix_impl::gemm_strided(m, n, k, T(alpha),
+                                          pa + i * da.strides[0], ptrdiff_t(da.strides[1]), ptrdiff_t(da.strides[2]),
+                                          pb + i * db.strides[0], ptrdiff_t(db.strides[1]), ptrdiff_t(db.strides[2]),
+                                          T(beta), pc + i * dc.strides[0], ptrdiff_t(dc.strides[1]), ptrdiff_t(dc.strides[2]));
+        };
+        // the grain of the policy counts multiply-adds here, so that a chunk holds enough small products
+        const size_t work = std::max<size_t>(m * n * k, 1);
+        Matrix_impl::parallel_chunks(policy.grained(std::max<size_t>(policy.grain / work, 1)), batch, body);
+    }
+
+    template <typename T>
+    void batched_gemm(const Non_deduced<T> &alpha, const Matrix_base<T, 3> &a, const Matrix_base<T, 3> &b,
+                      const Non_deduced<T> &beta, Matrix_base<T, 3> &&c, const Execution_policy &policy = execution::par)
+    {
+        batched_gemm(alpha, a, b, beta, c, policy);
+    }
+
+    /**
+     * @brief The products of the matrices along the leading axis of `a` (`batch * m * k`) and `b` (`batch * k * n`).
+     *        Either may be a strided view, such as a slice or a permutation of a larger tensor.
+     *
+     */
+    template <typename T>
+    Matrix<T, 3> batched_matmul(const Matrix_base<T, 3> &a, const Matrix_base<T, 3> &b,
+                                const Execution_policy &policy = execution::par)
+    {
+        assert(a.extent(0) == b.extent(0) && a.extent(2) == b.extent(1));
+        Matrix<T, 3> res(a.extent(0), a.extent(1), b.extent(2));
+        batched_gemm(T(1), a, b, T(0), res, policy);
+        return res;
+    }
+};
+
+#endif
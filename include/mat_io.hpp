@@ -0,0 +1,279 @@
+/**
+ * @file mat_io.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the binary tensor file format of `Matrix`. A file is a fixed header holding the element
+ *        type, byte order and `Matrix_slice` of the payload, followed by the raw elements at an aligned offset, so a
+ *        file can be read with a few large reads, or mapped and used in place without any parsing.
+ *
+ *        Layout (all header fields in the byte order of the writer):
+ *        @code
+ *            Tensor_header                     64 bytes
+ *            extents[order], strides[order]    uint64 each
+ *            padding                           up to `payload_offset`, a multiple of `alignment`
+ *            payload                           `payload_bytes` bytes of elements, addressed by `start` and `strides`
+ *        @endcode
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_IO_H
+#define MAT_IO_H
+
+#include "mat.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace utils
+{
+    enum class Tensor_type : uint32_t
+    {
+        int8 = 1,
+        uint8,
+        int16,
+        uint16,
+        int32,
+        uint32,
+        int64,
+        uint64,
+        float32,
+        float64
+    };
+
+    struct Tensor_header
+    {
+        char magic[4];           // "MATX"
+        uint32_t version;        // 1
+        uint32_t byte_order;     // `native_byte_order` as written by the writer
+        uint32_t type;           // a `Tensor_type`
+        uint32_t element_size;   // bytes
+        uint32_t order;          // N
+        uint64_t alignment;      // of the payload offset
+        uint64_t payload_offset; // bytes from the start of the file
+        uint64_t payload_bytes;
+        uint64_t start;    // of the first element, in elements from the start of the payload
+        uint64_t reserved; // zero
+    };
+    static_assert(sizeof(Tensor_header) == 64, "Tensor_header must be packed to 64 bytes.");
+
+    namespace Matrix_impl
+    {
+        constexpr uint32_t tensor_version = 1;
+        constexpr uint32_t native_byte_order = 0x01020304;
+        constexpr size_t tensor_io_block = size_t(4) << 20; // bytes per buffered read/write
+
+        template <typename T, typename = void>
+        struct Tensor_type_of; // undefined for unsupported element types
+
+        template <typename T>
+        struct Tensor_type_of<T, Enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, void>>
+        {
+            static constexpr Tensor_type value =
+                Tensor_type(uint32_t(Tensor_type::int8) + 2 * (sizeof(T) == 2 ? 1 : sizeof(T) == 4 ? 2 : sizeof(T) == 8 ? 3 : 0) +
+                            (std::is_signed<T>::value ? 0 : 1));
+        };
+
+        template <>
+        struct Tensor_type_of<float>
+        {
+            static constexpr Tensor_type value = Tensor_type::float32;
+        };
+
+        template <>
+        struct Tensor_type_of<double>
+        {
+            static constexpr Tensor_type value = Tensor_type::float64;
+        };
+
+        inline uint32_t byteswap(uint32_t x) { return __builtin_bswap32(x); }
+        inline uint64_t byteswap(uint64_t x) { return __builtin_bswap64(x); }
+
+        inline void byteswap_elements(char *p, size_t count, size_t element_size)
+        {
+            for (size_t i = 0; i < count; ++i, p += element_size)
+                std::reverse(p, p + element_size);
+        }
+
+        [[noreturn]] inline void tensor_error(const std::string &what, const std::string &path)
+        {
+            throw std::runtime_error("tensor file " + path + ": " + what);
+        }
+
+        /**
+         * @brief Read and validate the header and the slice of a tensor file of `T` and order `N`.
+         *        Returns whether the file was written with the other byte order.
+         *
+         */
+        template <typename T, size_t N>
+        bool read_tensor_header(std::istream &in, const std::string &path, Tensor_header &h, Matrix_slice<N> &s)
+        {
+            if (!in.read(reinterpret_cast<char *>(&h), sizeof(h)) || std::memcmp(h.magic, "MATX", 4) != 0)
+                tensor_error("not a tensor file", path);
+            const bool swapped = h.byte_order != native_byte_order;
+            if (swapped)
+            {
+                if (byteswap(h.byte_order) != native_byte_order)
+                    tensor_error("corrupted byte order marker", path);
+                for (uint32_t *f : {&h.version, &h.byte_order, &h.type, &h.element_size, &h.order})
+                    *f = byteswap(*f);
+                for (uint64_t *f : {&h.alignment, &h.payload_offset, &h.payload_bytes, &h.start})
+                    *f = byteswap(*f);
+            }
+            if (h.version != tensor_version)
+                tensor_error("unsupported version " + std::to_string(h.version), path);
+            if (h.type != uint32_t(Tensor_type_of<T>::value) || h.element_size != sizeof(T))
+                tensor_error("element type mismatch", path);
+            if (h.order != N)
+                tensor_error("expected order " + std::to_string(N) + ", found " + std::to_string(h.order), path);
+
+            std::array<uint64_t, 2 * N> dims;
+            if (!in.read(reinterpret_cast<char *>(dims.data()), sizeof(dims)))
+                tensor_error("truncated header", path);
+            for (size_t d = 0; d < N; ++d)
+            {
+                s.extents[d] = size_t(swapped ? byteswap(dims[d]) : dims[d]);
+                s.strides[d] = size_t(swapped ? byteswap(dims[N + d]) : dims[N + d]);
+            }
+            s.start = size_t(h.start);
+            s.recalc_size();
+            if (span(s) * sizeof(T) > h.payload_bytes)
+                tensor_error("payload too short for its extents", path);
+            return swapped;
+        }
+    };
+
+    /**
+     * @brief Write `m` to the tensor file at `path`. The payload is written densely in row-major order, starting at
+     *        an offset aligned to `alignment` bytes (a page by default, so that it can be mapped).
+     *
+     * @throw std::runtime_error on I/O errors.
+     */
+    template <typename T, size_t N>
+    void save(const std::string &path, const Matrix_base<T, N> &m, size_t alignment = Matrix_impl::page_bytes)
+    {
+        assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+        const Matrix_slice<N> dense(m.descriptor().extents);
+        const size_t prefix = sizeof(Tensor_header) + 2 * N * sizeof(uint64_t);
+
+        Tensor_header h{};
+        std::memcpy(h.magic, "MATX", 4);
+        h.version = Matrix_impl::tensor_version;
+        h.byte_order = Matrix_impl::native_byte_order;
+        h.type = uint32_t(Matrix_impl::Tensor_type_of<T>::value);
+        h.element_size = sizeof(T);
+        h.order = uint32_t(N);
+        h.alignment = alignment;
+        h.payload_offset = (prefix + alignment - 1) / alignment * alignment;
+        h.payload_bytes = dense.size * sizeof(T);
+        h.start = 0;
+
+        std::array<uint64_t, 2 * N> dims;
+        for (size_t d = 0; d < N; ++d)
+            dims[d] = dense.extents[d], dims[N + d] = dense.strides[d];
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            Matrix_impl::tensor_error("cannot open for writing", path);
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char *>(dims.data()), sizeof(dims));
+        const std::vector<char> padding(h.payload_offset - prefix, 0);
+        out.write(padding.data(), std::streamsize(padding.size()));
+
+        const Matrix_slice<N> &s = m.descriptor();
+        if (Matrix_impl::is_contiguous(s))
+        {
+            out.write(reinterpret_cast<const char *>(m.data() + s.start), std::streamsize(h.payload_bytes));
+        }
+        else
+        {
+            // stage the strided elements through a buffer, one block at a time
+            const Matrix_impl::Segments<N> g(s);
+            const size_t block = std::max<size_t>(Matrix_impl::tensor_io_block / sizeof(T), 1);
+            std::vector<T> buf(std::min(block, s.size));
+            for (size_t first = 0; first < s.size && out; first += block)
+            {
+                const size_t last = std::min(s.size, first + block);
+                T *q = buf.data();
+                Matrix_impl::for_each_run(g, m.data(), first, last, [&](const T *p, size_t len, size_t stride)
+                                          {
+                                              for (size_t i = 0; i < len; ++i)
+                                                  *q++ = p[i * stride]; });
+                out.write(reinterpret_cast<const char *>(buf.data()), std::streamsize((last - first) * sizeof(T)));
+            }
+        }
+        if (!out.flush())
+            Matrix_impl::tensor_error("write failed", path);
+    }
+
+    /**
+     * @brief Read the tensor file at `path` into a new `Matrix`. Files of the other byte order are converted.
+     *
+     * @throw std::runtime_error if the file cannot be read, or its type, order or size do not match.
+     */
+    template <typename T, size_t N>
+    Matrix<T, N> load(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            Matrix_impl::tensor_error("cannot open", path);
+        Tensor_header h;
+        Matrix_slice<N> s;
+        const bool swapped = Matrix_impl::read_tensor_header<T, N>(in, path, h, s);
+
+        Matrix<T, N> m(s.extents);
+        in.seekg(std::streamoff(h.payload_offset));
+        if (Matrix_impl::is_contiguous(s))
+        {
+            // straight into the elements, in large reads
+            char *p = reinterpret_cast<char *>(m.data());
+            in.seekg(std::streamoff(h.payload_offset + s.start * sizeof(T)));
+            for (size_t done = 0, bytes = s.size * sizeof(T); done < bytes && in;)
+            {
+                const size_t n = std::min(Matrix_impl::tensor_io_block, bytes - done);
+                in.read(p + done, std::streamsize(n));
+                done += n;
+            }
+        }
+        else
+        {
+            std::vector<T> raw(Matrix_impl::span(s));
+            in.read(reinterpret_cast<char *>(raw.data()), std::streamsize(raw.size() * sizeof(T)));
+            Matrix_impl::gather(s, raw.data(), m.data());
+        }
+        if (!in)
+            Matrix_impl::tensor_error("truncated payload", path);
+        if (swapped)
+            Matrix_impl::byteswap_elements(reinterpret_cast<char *>(m.data()), m.size(), sizeof(T));
+        return m;
+    }
+
+#ifdef MAT_HAS_MMAP
+    /**
+     * @brief Map the payload of the tensor file at `path` in place: only the header is read, and the elements are
+     *        paged in on access with the strides and start recorded in the file.
+     *
+     * @throw std::runtime_error if the file cannot be read or mapped, its type or order do not match, or it was
+     *        written with the other byte order.
+     */
+    template <typename T, size_t N>
+    Mapped_matrix<T, N> map_tensor(const std::string &path, Map_mode mode = Map_mode::read_only,
+                                   Access_pattern pattern = Access_pattern::normal)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            Matrix_impl::tensor_error("cannot open", path);
+        Tensor_header h;
+        Matrix_slice<N> s;
+        if (Matrix_impl::read_tensor_header<T, N>(in, path, h, s))
+            Matrix_impl::tensor_error("written with the other byte order, use load() instead", path);
+        in.close();
+        return Mapped_matrix<T, N>(path, s, size_t(h.payload_offset), mode, pattern);
+    }
+#endif
+};
+
+#endif
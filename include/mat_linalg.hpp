@@ -0,0 +1,405 @@
+/**
+ * @file mat_linalg.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the dense factorizations of square `Matrix<T, 2>`: LU with partial pivoting and Cholesky,
+ *        both in place, and `Lu_factorization` and `Cholesky_factorization`, which keep the factors to solve any
+ *        number of systems. The factorizations are blocked and right-looking: a narrow panel is factored column by
+ *        column, and the rest of the matrix is updated with it through the GEMM of `mat_gemm.hpp`, split across
+ *        threads. The triangular solves are blocked likewise.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_LINALG_H
+#define MAT_LINALG_H
+
+#include "mat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace utils
+{
+    namespace Matrix_impl
+    {
+        constexpr size_t factor_block = 64; // columns of a panel, also the depth of the trailing GEMM
+        constexpr size_t factor_rows = 128; // rows of the trailing update handed to a thread at once
+        constexpr size_t factor_rhs = 32;   // right-hand sides solved by a thread at once
+
+        /**
+         * @brief Solve `A X = B` in place of the `n * r` block `B`, row `i` at `b + i * ldb` with contiguous columns.
+         *        `A` is lower (or upper) triangular with element `(i, j)` at `a[i * rsa + j * csa]`, and a unit
+         *        diagonal if `unit`. Each diagonal block is solved by row operations, then removed from the remaining
+         *        rows by GEMM.
+         *
+         */
+        template <typename T>
+        void trsm(bool lower, bool unit, size_t n, size_t r, const T *a, ptrdiff_t rsa, ptrdiff_t csa, T *b, size_t ldb)
+        {
+            auto at = [&](size_t i, size_t j)
+            { return a[ptrdiff_t(i) * rsa + ptrdiff_t(j) * csa]; };
+            auto finish = [&](size_t i)
+            {
+                if (unit)
+                    return;
+                const T inv = T(1) / at(i, i);
+                for (size_t j = 0; j < r; ++j)
+                    b[i * ldb + j] *= inv;
+            };
+            for (size_t s = 0; s < n; s += factor_block)
+            {
+                const size_t kb = std::min(factor_block, n - s), k0 = lower ? s : n - s - kb, k1 = k0 + kb;
+                if (lower)
+                    for (size_t i = k0; i < k1; ++i)
+                    {
+                        for (size_t p = k0; p < i; ++p)
+                            simd_axpy(b + i * ldb, b + p * ldb, r, T(-at(i, p)));
+                        finish(i);
+                    }
+                else
+                    for (size_t i = k1; i-- > k0;)
+                    {
+                        for (size_t p = i + 1; p < k1; ++p)
+                            simd_axpy(b + i * ldb, b + p * ldb, r, T(-at(i, p)));
+                        finish(i);
+                    }
+
+                if (lower && k1 < n)
+                    gemm_strided<T>(n - k1, r, kb, T(-1), a + ptrdiff_t(k1) * rsa + ptrdiff_t(k0) * csa, rsa, csa,
+                                    b + k0 * ldb, ptrdiff_t(ldb), 1, T(1), b + k1 * ldb, ptrdiff_t(ldb), 1);
+                if (!lower && k0 > 0)
+                    gemm_strided<T>(k0, r, kb, T(-1), a + ptrdiff_t(k0) * csa, rsa, csa,
+                                    b + k0 * ldb, ptrdiff_t(ldb), 1, T(1), b, ptrdiff_t(ldb), 1);
+            }
+        }
+
+        /**
+         * @brief `trsm` on the right-hand sides split across threads by columns.
+         *
+         */
+        template <typename T>
+        void parallel_trsm(bool lower, bool unit, size_t n, size_t r, const T *a, ptrdiff_t rsa, ptrdiff_t csa, T *b,
+                           size_t ldb, const Execution_policy &policy)
+        {
+            parallel_chunks(policy.grained(factor_rhs), r, [&](size_t c0, size_t c1)
+                            { trsm(lower, unit, n, c1 - c0, a, rsa, csa, b + c0, ldb); });
+        }
+
+        /**
+         * @brief Factor the panel of columns `[k0, k0 + kb)` and rows `[k0, n)` of `a` with partial pivoting. The
+         *        pivot rows are swapped across the whole width of the matrix.
+         *
+         */
+        template <typename T>
+        void lu_panel(size_t n, size_t k0, size_t kb, T *a, size_t lda, size_t *piv)
+        {
+            using std::abs;
+            for (size_t j = k0; j < k0 + kb; ++j)
+            {
+                size_t p = j;
+                for (size_t i = j + 1; i < n; ++i)
+                    if (abs(a[i * lda + j]) > abs(a[p * lda + j]))
+                        p = i;
+                piv[j] = p;
+                if (p != j)
+                    std::swap_ranges(a + j * lda, a + j * lda + n, a + p * lda);
+                if (a[j * lda + j] == T(0))
+                    continue; // nothing to eliminate below an exact zero column
+                const T inv = T(1) / a[j * lda + j];
+                const T *rj = a + j * lda;
+                for (size_t i = j + 1; i < n; ++i)
+                {
+                    T *ri = a + i * lda;
+                    const T l = ri[j] *= inv;
+                    simd_axpy(ri + j + 1, rj + j + 1, k0 + kb - j - 1, T(-l));
+                }
+            }
+        }
+
+        /**
+         * @brief Blocked right-looking LU of the `n * n` row-major `a`: `P A = L U`.
+         *
+         */
+        template <typename T>
+        void lu_blocked(size_t n, T *a, size_t lda, size_t *piv, const Execution_policy &policy)
+        {
+            for (size_t k0 = 0; k0 < n; k0 += factor_block)
+            {
+                const size_t kb = std::min(factor_block, n - k0), k1 = k0 + kb, rest = n - k1;
+                lu_panel(n, k0, kb, a, lda, piv);
+                if (rest == 0)
+                    break;
+                // U12 = L11^-1 A12, then A22 -= L21 U12
+                parallel_trsm(true, true, kb, rest, a + k0 * lda + k0, ptrdiff_t(lda), 1, a + k0 * lda + k1, lda, policy);
+                parallel_chunks(policy.grained(factor_rows), rest, [&](size_t i0, size_t i1)
+                                { gemm_strided<T>(i1 - i0, rest, kb, T(-1), a + (k1 + i0) * lda + k0, ptrdiff_t(lda), 1,
+                                                  a + k0 * lda + k1, ptrdiff_t(lda), 1,
+                                                  T(1), a + (k1 + i0) * lda + k1, ptrdiff_t(lda), 1); });
+            }
+        }
+
+        /**
+         * @brief Blocked right-looking Cholesky of the `n * n` row-major `a`: `A = L L^T`, reading and writing the
+         *        lower triangle only.
+         *
+         */
+        template <typename T>
+        void cholesky_blocked(size_t n, T *a, size_t lda, const Execution_policy &policy)
+        {
+            using std::sqrt;
+            for (size_t k0 = 0; k0 < n; k0 += factor_block)
+            {
+                const size_t kb = std::min(factor_block, n - k0), k1 = k0 + kb, rest = n - k1;
+                // L11, unblocked; the columns left of the block were already subtracted
+                for (size_t j = k0; j < k1; ++j)
+                {
+                    T *rj = a + j * lda;
+                    T d = rj[j];
+                    for (size_t p = k0; p < j; ++p)
+                        d -= rj[p] * rj[p];
+                    if (!(d > T(0)))
+                        throw std::runtime_error("cholesky: the matrix is not positive definite");
+                    rj[j] = sqrt(d);
+                    for (size_t i = j + 1; i < k1; ++i)
+                    {
+                        T *ri = a + i * lda;
+                        T x = ri[j];
+                        for (size_t p = k0; p < j; ++p)
+                            x -= ri[p] * rj[p];
+                        ri[j] = x / rj[j];
+                    }
+                }
+                if (rest == 0)
+                    break;
+                // L21 = A21 L11^-T, row by row
+                parallel_chunks(policy.grained(factor_rows), rest, [&](size_t i0, size_t i1)
+                                {
+                                    for (size_t i = k1 + i0; i < k1 + i1; ++i)
+                                    {
+                                        T *ri = a + i * lda;
+                                        for (size_t j = k0; j < k1; ++j)
+                                        {
+                                            const T *rj = a + j * lda;
+                                            T x = ri[j];
+                                            for (size_t p = k0; p < j; ++p)
+                                                x -= ri[p] * rj[p];
+                                            ri[j] = x / rj[j];
+                                        }
+                                    } });
+                // A22 -= L21 L21^T on the lower triangle, in blocks of rows ending at the diagonal
+                parallel_chunks(policy.grained(factor_rows).scheduled(Execution_policy::guided_schedule), rest, [&](size_t i0, size_t i1)
+                                {
+                                    for (size_t i = i0; i < i1; i += factor_rows)
+                                    {
+                                        const size_t m = std::min(factor_rows, i1 - i);
+                                        gemm_strided<T>(m, i + m, kb, T(-1), a + (k1 + i) * lda + k0, ptrdiff_t(lda), 1,
+                                                        a + k1 * lda + k0, 1, ptrdiff_t(lda),
+                                                        T(1), a + (k1 + i) * lda + k1, ptrdiff_t(lda), 1);
+                                    } });
+            }
+        }
+
+        /**
+         * @brief Run `f(n, a, lda)` on the storage of `m` if its rows are contiguous, otherwise on a contiguous copy
+         *        written back afterwards.
+         *
+         */
+        template <typename T, typename F>
+        void with_contiguous_rows(Matrix_base<T, 2> &m, const Execution_policy &policy, F f)
+        {
+            const Matrix_slice<2> &s = m.descriptor();
+            assert(s.extents[0] == s.extents[1]);
+            if (s.strides[1] == 1)
+            {
+                f(s.extents[0], m.data() + s.start, s.strides[0]);
+                return;
+            }
+            Matrix<T, 2> tmp = materialize(m, policy);
+            f(s.extents[0], tmp.data(), s.extents[0]);
+            for (size_t i = 0; i < s.extents[0]; ++i)
+                for (size_t j = 0; j < s.extents[1]; ++j)
+                    m.data()[s.start + i * s.strides[0] + j * s.strides[1]] = tmp(i, j);
+        }
+    };
+
+    /**
+     * @brief LU factorization with partial pivoting, in place: `a` is overwritten with `L` below its diagonal (the
+     *        unit diagonal of `L` is not stored) and `U` on and above it, such that `P A = L U`.
+     *
+     * @return the pivots: row `i` was swapped with row `pivots[i]` at step `i`, in increasing order of `i`.
+     *         A zero on the diagonal of `U` means `a` is singular.
+     */
+    template <typename T>
+    std::vector<size_t> lu(Matrix_base<T, 2> &a, const Execution_policy &policy = execution::par)
+    {
+        MAT_TELEMETRY_SCOPE(factorize, {a.rows(), a.columns()}, a.size(), a.size() * sizeof(T));
+        std::vector<size_t> piv(a.rows());
+        Matrix_impl::with_contiguous_rows(a, policy, [&](size_t n, T *p, size_t lda)
+                                    { Matrix_impl::lu_blocked(n, p, lda, piv.data(), policy); });
+        return piv;
+    }
+
+    template <typename T>
+    std::vector<size_t> lu(Matrix_base<T, 2> &&a, const Execution_policy &policy = execution::par)
+    {
+        return lu(a, policy);
+    }
+
+    /**
+     * @brief Cholesky factorization of the symmetric positive definite `a`, in place: `a` is overwritten with the
+     *        lower triangular `L` such that `A = L L^T`, and zeros above the diagonal. Only the lower triangle of
+     *        `a` is read.
+     *
+     * @throw std::runtime_error if `a` is not positive definite.
+     */
+    template <typename T>
+    void cholesky(Matrix_base<T, 2> &a, const Execution_policy &policy = execution::par)
+    {
+        MAT_TELEMETRY_SCOPE(factorize, {a.rows(), a.columns()}, a.size(), a.size() * sizeof(T));
+        Matrix_impl::with_contiguous_rows(a, policy, [&](size_t n, T *p, size_t lda)
+                                    {
+                                        Matrix_impl::cholesky_blocked(n, p, lda, policy);
+                                        for (size_t i = 0; i < n; ++i)
+                                            std::fill(p + i * lda + i + 1, p + i * lda + n, T()); });
+    }
+
+    template <typename T>
+    void cholesky(Matrix_base<T, 2> &&a, const Execution_policy &policy = execution::par)
+    {
+        cholesky(a, policy);
+    }
+
+    /**
+     * @brief The LU factorization of a square matrix, kept to solve `A X = B` for any number of `B`.
+     *
+     */
+    template <typename T>
+    class Lu_factorization
+    {
+    public:
+        explicit Lu_factorization(Matrix<T, 2> a, const Execution_policy &policy = execution::par)
+            : f(std::move(a)), piv(lu(f, policy)) {}
+
+        // the packed factors and the pivots, as returned by `lu`
+        const Matrix<T, 2> &factors() const { return f; }
+        const std::vector<size_t> &pivots() const { return piv; }
+
+        size_t size() const { return f.rows(); }
+
+        bool singular() const
+        {
+            for (size_t i = 0; i < size(); ++i)
+                if (f.data()[i * size() + i] == T(0))
+                    return true;
+            return false;
+        }
+
+        T determinant() const
+        {
+            T det = T(1);
+            for (size_t i = 0; i < size(); ++i)
+                det *= piv[i] == i ? f.data()[i * size() + i] : -f.data()[i * size() + i];
+            return det;
+        }
+
+        /**
+         * @brief The solution `X` of `A X = B`, the columns of `B` being solved in parallel.
+         *
+         * @throw std::runtime_error if `A` is singular.
+         */
+        Matrix<T, 2> solve(const Matrix_base<T, 2> &b, const Execution_policy &policy = execution::par) const
+        {
+            assert(b.rows() == size());
+            Matrix<T, 2> x = materialize(b, policy);
+            solve_in_place(x.data(), b.columns(), b.columns(), policy);
+            return x;
+        }
+
+        Matrix<T, 1> solve(const Matrix_base<T, 1> &b) const
+        {
+            assert(b.size() == size());
+            Matrix<T, 1> x = materialize(b, execution::seq);
+            solve_in_place(x.data(), 1, 1, execution::seq);
+            return x;
+        }
+
+    private:
+        Matrix<T, 2> f;
+        std::vector<size_t> piv;
+
+        void solve_in_place(T *x, size_t r, size_t ldx, const Execution_policy &policy) const
+        {
+            if (singular())
+                throw std::runtime_error("lu: the matrix is singular");
+            const size_t n = size();
+            for (size_t i = 0; i < n; ++i)
+                if (piv[i] != i)
+                    std::swap_ranges(x + i * ldx, x + i * ldx + r, x + piv[i] * ldx);
+            Matrix_impl::parallel_chunks(policy.grained(Matrix_impl::factor_rhs), r, [&](size_t c0, size_t c1)
+                                         {
+                                             Matrix_impl::trsm(true, true, n, c1 - c0, f.data(), ptrdiff_t(n), 1, x + c0, ldx);
+                                             Matrix_impl::trsm(false, false, n, c1 - c0, f.data(), ptrdiff_t(n), 1, x + c0, ldx); });
+        }
+    };
+
+    /**
+     * @brief The Cholesky factorization of a symmetric positive definite matrix, kept to solve `A X = B` for any
+     *        number of `B`.
+     *
+     * @throw std::runtime_error from the constructor if the matrix is not positive definite.
+     */
+    template <typename T>
+    class Cholesky_factorization
+    {
+    public:
+        explicit Cholesky_factorization(Matrix<T, 2> a, const Execution_policy &policy = execution::par)
+            : l(std::move(a))
+        {
+            cholesky(l, policy);
+        }
+
+        // the lower triangular factor
+        const Matrix<T, 2> &factor() const { return l; }
+
+        size_t size() const { return l.rows(); }
+
+        /**
+         * @brief The solution `X` of `A X = B`, through `L Y = B` and `L^T X = Y`, the columns of `B` being solved
+         *        in parallel.
+         *
+         */
+        Matrix<T, 2> solve(const Matrix_base<T, 2> &b, const Execution_policy &policy = execution::par) const
+        {
+            assert(b.rows() == size());
+            Matrix<T, 2> x = materialize(b, policy);
+            solve_in_place(x.data(), b.columns(), b.columns(), policy);
+            return x;
+        }
+
+        Matrix<T, 1> solve(const Matrix_base<T, 1> &b) const
+        {
+            assert(b.size() == size());
+            Matrix<T, 1> x = materialize(b, execution::seq);
+            solve_in_place(x.data(), 1, 1, execution::seq);
+            return x;
+        }
+
+    private:
+        Matrix<T, 2> l;
+
+        void solve_in_place(T *x, size_t r, size_t ldx, const Execution_policy &policy) const
+        {
+            const size_t n = size();
+            Matrix_impl::parallel_chunks(policy.grained(Matrix_impl::factor_rhs), r, [&](size_t c0, size_t c1)
+                                         {
+                                             Matrix_impl::trsm(true, false, n, c1 - c0, l.data(), ptrdiff_t(n), 1, x + c0, ldx);
+                                             Matrix_impl::trsm(false, false, n, c1 - c0, l.data(), 1, ptrdiff_t(n), x + c0, ldx); });
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,240 @@
+/**
+ * @file mat_mmap.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains `Mapped_matrix`, a matrix whose elements are a memory mapping of a file instead of a
+ *        heap buffer. Pages are read on first touch and shared with the page cache, so opening a huge tensor is
+ *        immediate and never holds a second copy of it in memory.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_MMAP_H
+#define MAT_MMAP_H
+
+#include "mat.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAT_HAS_MMAP 1
+#endif
+
+#ifdef MAT_HAS_MMAP
+namespace utils
+{
+    enum class Map_mode
+    {
+        read_only,     // the file must exist; writing to the elements faults
+        read_write,    // the file is created or grown as needed and writes reach it
+        copy_on_write  // writes stay private to this mapping
+    };
+
+    enum class Access_pattern
+    {
+        normal,
+        sequential, // aggressive read-ahead, pages dropped behind
+        random,     // no read-ahead
+        will_need,  // start reading the whole mapping now
+        dont_need   // the pages may be dropped from memory; refused for `copy_on_write`, whose writes would be lost
+    };
+
+    namespace Matrix_impl
+    {
+        [[noreturn]] inline void mmap_error(const std::string &what, const std::string &path)
+        {
+            throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+        }
+
+        inline void check_advice(Map_mode mode, Access_pattern p)
+        {
+            // dropping the pages of a private mapping discards its writes, which are in no file to be read back from
+            if (mode == Map_mode::copy_on_write && p == Access_pattern::dont_need)
+                throw std::invalid_argument("cannot advise dont_need on a copy_on_write mapping");
+        }
+
+        inline int madvise_flag(Access_pattern p)
+        {
+            switch (p)
+            {
+            case Access_pattern::sequential:
+                return MADV_SEQUENTIAL;
+            case Access_pattern::random:
+                return MADV_RANDOM;
+            case Access_pattern::will_need:
+                return MADV_WILLNEED;
+            case Access_pattern::dont_need:
+                return MADV_DONTNEED;
+            default:
+                return MADV_NORMAL;
+            }
+        }
+    };
+
+    /**
+     * @brief A matrix of the elements stored in row-major order in a file from byte `offset` on, mapped into memory.
+     *        It has the interface of `Matrix_ref` (`data`, `row`, `column`, `operator()`, `apply`, iterators and the
+     *        scalar operators) and owns the mapping, which is released on destruction.
+     *
+     * @tparam T a trivially copyable type
+     * @tparam N
+     */
+    template <typename T, size_t N>
+    class Mapped_matrix : public Matrix_ref<T, N>
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Mapped_matrix: elements must be trivially copyable.");
+
+    public:
+        using Matrix_ref<T, N>::operator=; // evaluate expressions into the mapping
+
+        Mapped_matrix() : Matrix_ref<T, N>(Matrix_slice<N>(std::array<size_t, N>{}), nullptr) {}
+        Mapped_matrix(const Mapped_matrix &) = delete;
+        Mapped_matrix &operator=(const Mapped_matrix &) = delete;
+
+        Mapped_matrix(Mapped_matrix &&x) noexcept : Matrix_ref<T, N>(std::move(x)) { take(x); }
+        Mapped_matrix &operator=(Mapped_matrix &&x) noexcept
+        {
+            if (this != &x)
+            {
+                unmap();
+                Matrix_ref<T, N>::operator=(std::move(x));
+                take(x);
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Map a matrix of the given extents stored at byte `offset` of the file at `path`.
+         *
+         * @throw std::runtime_error if the file cannot be opened, grown, mapped or advised, or is too short for a
+         *        read-only or copy-on-write mapping.
+         * @throw std::invalid_argument if `pattern` is `dont_need` on a `copy_on_write` mapping.
+         */
+        Mapped_matrix(const std::string &path, Map_mode mode, const std::array<size_t, N> &extents, size_t offset = 0,
+                      Access_pattern pattern = Access_pattern::normal)
+            : Mapped_matrix(path, Matrix_slice<N>(extents), offset, mode, pattern)
+        {
+        }
+
+        /**
+         * @brief Map the elements described by `s`, relative to byte `offset` of the file at `path`. The strides and
+         *        start of `s` are kept, so padded or otherwise strided layouts are mapped as they are.
+         *
+         */
+        Mapped_matrix(const std::string &path, const Matrix_slice<N> &s, size_t offset, Map_mode mode,
+                      Access_pattern pattern = Access_pattern::normal)
+            : mode_(mode)
+        {
+            assert(offset % alignof(T) == 0);
+            Matrix_impl::check_advice(mode, pattern);
+            const size_t bytes = Matrix_impl::span(s) * sizeof(T);
+
+            fd = ::open(path.c_str(), mode == Map_mode::read_write ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+            if (fd < 0)
+                Matrix_impl::mmap_error("cannot open", path);
+
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+                fail("cannot stat", path);
+            if (size_t(st.st_size) < offset + bytes)
+            {
+                if (mode != Map_mode::read_write)
+                {
+                    errno = EINVAL;
+                    fail("file too short for the requested extents:", path);
+                }
+                if (::ftruncate(fd, off_t(offset + bytes)) != 0)
+                    fail("cannot grow", path);
+            }
+
+            const size_t page = size_t(::sysconf(_SC_PAGESIZE));
+            const size_t head = offset % page; // mmap offsets must be page aligned
+            length = head + bytes;
+            if (length > 0)
+            {
+                const int prot = mode == Map_mode::read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+                const int flags = mode == Map_mode::copy_on_write ? MAP_PRIVATE : MAP_SHARED;
+                base = ::mmap(nullptr, length, prot, flags, fd, off_t(offset - head));
+                if (base == MAP_FAILED)
+                {
+                    base = nullptr;
+                    fail("cannot map", path);
+                }
+            }
+            T *p = base ? reinterpret_cast<T *>(static_cast<char *>(base) + head) : nullptr;
+            Matrix_ref<T, N>::operator=(Matrix_ref<T, N>(s, p));
+            if (base && ::madvise(base, length, Matrix_impl::madvise_flag(pattern)) != 0)
+                fail("cannot advise the mapping of", path);
+        }
+
+        ~Mapped_matrix() { unmap(); }
+
+        Map_mode mode() const { return mode_; }
+
+        /**
+         * @brief Hint the kernel about how the elements are going to be accessed.
+         *
+         * @throw std::invalid_argument if `pattern` is `dont_need` on a `copy_on_write` mapping.
+         * @throw std::runtime_error on failure.
+         */
+        void advise(Access_pattern pattern)
+        {
+            Matrix_impl::check_advice(mode_, pattern);
+            if (base && ::madvise(base, length, Matrix_impl::madvise_flag(pattern)) != 0)
+                throw std::runtime_error(std::string("cannot advise mapping: ") + std::strerror(errno));
+        }
+
+        /**
+         * @brief Write the modified pages of a `read_write` mapping back to the file.
+         *
+         * @throw std::runtime_error on failure.
+         */
+        void sync()
+        {
+            if (base && mode_ == Map_mode::read_write && ::msync(base, length, MS_SYNC) != 0)
+                throw std::runtime_error(std::string("cannot sync mapping: ") + std::strerror(errno));
+        }
+
+    private:
+        [[noreturn]] void fail(const std::string &what, const std::string &path)
+        {
+            const int err = errno;
+            unmap();
+            errno = err;
+            Matrix_impl::mmap_error(what, path);
+        }
+
+        void unmap()
+        {
+            if (base)
+                ::munmap(base, length);
+            if (fd >= 0)
+                ::close(fd);
+            base = nullptr;
+            length = 0;
+            fd = -1;
+        }
+
+        void take(Mapped_matrix &x)
+        {
+            base = x.base, length = x.length, fd = x.fd, mode_ = x.mode_;
+            x.base = nullptr, x.length = 0, x.fd = -1;
+            static_cast<Matrix_ref<T, N> &>(x) = Matrix_ref<T, N>(Matrix_slice<N>(std::array<size_t, N>{}), nullptr);
+        }
+
+        void *base = nullptr;
+        size_t length = 0;
+        int fd = -1;
+        Map_mode mode_ = Map_mode::read_only;
+    };
+};
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+/**
+ * @file mat_permute.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the axis-permuting views of `Matrix` (`transpose` and `permute`), which only reorder the
+ *        extents and strides of the descriptor, and `materialize`, which copies such a view into a new contiguous
+ *        `Matrix` with a cache-oblivious blocked transposition instead of walking the input with a large stride.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_PERMUTE_H
+#define MAT_PERMUTE_H
+
+#include "mat.hpp"
+
+namespace utils
+{
+    namespace Matrix_impl
+    {
+        constexpr size_t transpose_tile = 32; // edge of the tiles copied directly, a few KiB of each side
+        constexpr size_t transpose_band = 64; // rows of the input axis handed to a thread at once
+
+        /**
+         * @brief Copy a `rows * cols` block from `src` to `dst`, element `(i, j)` being at `src[i * srs + j * scs]`
+         *        and `dst[i * drs + j]`, halving the longer side until a tile fits in L1.
+         *
+         */
+        template <typename T, typename U>
+        void transpose_block(const U *src, size_t srs, size_t scs, T *dst, size_t drs, size_t rows, size_t cols)
+        {
+            while (rows > transpose_tile || cols > transpose_tile)
+            {
+                if (rows >= cols)
+                {
+                    const size_t half = rows / 2;
+                    transpose_block(src, srs, scs, dst, drs, half, cols);
+                    src += half * srs, dst += half * drs, rows -= half;
+                }
+                else
+                {
+                    const size_t half = cols / 2;
+                    transpose_block(src, srs, scs, dst, drs, rows, half);
+                    src += half * scs, dst += half, cols -= half;
+                }
+            }
+            for (size_t i = 0; i < rows; ++i)
+                for (size_t j = 0; j < cols; ++j)
+                    dst[i * drs + j] = T(src[i * srs + j * scs]);
+        }
+
+        /**
+         * @brief Copy the region described by `s` densely into `out`, in row-major order of its extents.
+         *        When the innermost axis of the output is not the one of smallest stride in the input, the two axes
+         *        are copied as blocked transpositions, so that both sides are accessed in cache-sized tiles.
+         *
+         */
+        template <size_t N, typename U, typename T>
+        void materialize_into(const Matrix_slice<N> &s, const U *base, T *out, const Execution_policy &policy)
+        {
+            const size_t a = N - 1; // innermost axis of the output
+            size_t b = a;           // axis of smallest stride in the input
+            for (size_t d = 0; d < N; ++d)
+                if (s.extents[d] > 1 && (s.extents[b] <= 1 || s.strides[d] < s.strides[b]))
+                    b = d;
+            if (s.size == 0 || b == a || s.extents[a] <= 1 || s.strides[a] <= s.strides[b])
+            {
+                gather(s, base, out); // already read in runs along the output
+                return;
+            }
+
+            const Matrix_slice<N> dense(s.extents);
+            size_t outer = 1;
+            for (size_t d = 0; d < N; ++d)
+                if (d != a && d != b)
+                    outer *= s.extents[d];
+            const size_t bands = (s.extents[b] + transpose_band - 1) / transpose_band;
+
+            auto body = [&](size_t first, size_t last)
+            {
+                for (size_t t = first; t < last; ++t)
+                {
+                    // decode the index of the other axes, and the band of `b`
+                    size_t o = t / bands, src = s.start, dst = 0;
+                    for (size_t d = N; d-- > 0;)
+                        if (d != a && d != b)
+                        {
+                            const size_t i = o % s.extents[d];
+                            o /= s.extents[d];
+                            src += i * s.strides[d], dst += i * dense.strides[d];
+                        }
+                    const size_t row = t % bands * transpose_band;
+                    const size_t rows = std::min(transpose_band, s.extents[b] - row);
+                    src += row * s.strides[b], dst += row * dense.strides[b];
+                    transpose_block(base + src, s.strides[b], s.strides[a], out + dst, dense.strides[b], rows, s.extents[a]);
+                }
+            };
+            if (policy.kind == Execution_policy::sequenced || s.size <= policy.grain)
+                body(0, outer * bands);
+            else
+                parallel_chunks(policy.grained(1), outer * bands, body);
+        }
+    };
+
+    /**
+     * @brief A view of `m` with its axes reordered: axis `d` of the result is axis `axes[d]` of `m`. No element is
+     *        moved, the extents and strides of the descriptor are permuted.
+     *
+     */
+    template <typename T, size_t N>
+    Matrix_ref<T, N> permute(Matrix_base<T, N> &m, const std::array<size_t, N> &axes)
+    {
+        const Matrix_slice<N> &src = m.descriptor();
+        Matrix_slice<N> d;
+        std::array<bool, N> seen{};
+        for (size_t i = 0; i < N; ++i)
+        {
+            assert(axes[i] < N && !seen[axes[i]]);
+            seen[axes[i]] = true;
+            d.extents[i] = src.extents[axes[i]];
+            d.strides[i] = src.strides[axes[i]];
+        }
+        d.start = src.start;
+        d.recalc_size();
+        MAT_TELEMETRY_SCOPE(slice, d, sizeof(T));
+        return Matrix_ref<T, N>(d, m.data());
+    }
+
+    template <typename T, size_t N>
+    Matrix_ref<T, N> permute(Matrix_ref<T, N> &&m, const std::array<size_t, N> &axes)
+    {
+        return permute(static_cast<Matrix_base<T, N> &>(m), axes);
+    }
+
+    /**
+     * @brief A view of the transpose of `m`, swapping its extents and strides.
+     *
+     */
+    template <typename T>
+    Matrix_ref<T, 2> transpose(Matrix_base<T, 2> &m)
+    {
+        return permute(m, {1, 0});
+    }
+
+    template <typename T>
+    Matrix_ref<T, 2> transpose(Matrix_ref<T, 2> &&m)
+    {
+        return permute(static_cast<Matrix_base<T, 2> &>(m), {1, 0});
+    }
+
+    /**
+     * @brief Copy the elements of `m`, which may be any view, into a new contiguous `Matrix` of the same extents.
+     *        Transposed and permuted views are copied in cache-sized tiles.
+     *
+     */
+    template <typename T, size_t N>
+    Matrix<T, N> materialize(const Matrix_base<T, N> &m, const Execution_policy &policy = execution::par)
+    {
+        MAT_TELEMETRY_SCOPE(copy_from_ref, m.descriptor(), sizeof(T));
+        Matrix<T, N> out(m.descriptor().extents);
+        Matrix_impl::materialize_into(m.descriptor(), m.data(), out.data(), policy);
+        return out;
+    }
+};
+
+#endif
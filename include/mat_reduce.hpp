@@ -0,0 +1,557 @@
+/**
+ * @file mat_reduce.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the reductions of `Matrix` and `Matrix_ref`: `sum`, `prod`, `min`, `max`, `argmin`,
+ *        `argmax`, `mean`, `variance` and `norm`, over all the elements or along one axis.
+ *        Contiguous runs are folded by the multi-accumulator SIMD kernels of `mat_simd.hpp`. The elements are split
+ *        into chunks of `Execution_policy::grain` whose partial results are combined as a tree in a fixed order, so a
+ *        floating-point result does not depend on the number of threads.
+ *        `min`, `max`, `argmin` and `argmax` skip NaNs, unless all the elements searched are NaN: the result is then
+ *        NaN, at the first position.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_REDUCE_H
+#define MAT_REDUCE_H
+
+#include "mat.hpp"
+
+#include <cmath>
+#include <limits>
+
+namespace utils
+{
+    enum class Norm
+    {
+        l1,  // sum of the absolute values
+        l2,  // square root of the sum of the squares
+        linf // largest absolute value
+    };
+
+    namespace Matrix_impl
+    {
+        constexpr size_t arg_block = 1024;   // elements scanned for the position of a better extremum at once
+        constexpr size_t axis_chunk = 2048; // least elements of the result per chunk when folding across slices
+
+        /**
+         * @brief The fold of `map` over the run of `n` elements from `p` with the given stride.
+         *
+         */
+        template <typename Fold, typename T, typename Map>
+        T reduce_run(const T *p, size_t n, size_t stride, const Map &map)
+        {
+            if (stride == 1)
+                return simd_reduce<Fold>(p, n, map);
+            T r = Fold::template identity<T>();
+            for (size_t i = 0; i < n; ++i)
+            {
+                T x = p[i * stride];
+                map(x);
+                Fold::run(r, x);
+            }
+            return r;
+        }
+
+        /**
+         * @brief Fold `q[j * stride]`, mapped, into `o[j]` for `j < n`.
+         *
+         */
+        template <typename Fold, typename T, typename Map>
+        void fold_into(T *o, const T *q, size_t n, size_t stride, const Map &map)
+        {
+            for (size_t j = 0; j < n; ++j)
+            {
+                T x = q[j * stride];
+                map(x);
+                Fold::run(o[j], x);
+            }
+        }
+
+        /**
+         * @brief Combine the partial results pairwise, `(0, 1), (2, 3), ...`, then `(0, 2), ...`, into `v[0]`.
+         *
+         */
+        template <typename Fold, typename T>
+        T tree_combine(std::vector<T> &v)
+        {
+            for (size_t w = 1; w < v.size(); w *= 2)
+                for (size_t i = 0; i + w < v.size(); i += 2 * w)
+                    Fold::run(v[i], v[i + w]);
+            return v.empty() ? Fold::template identity<T>() : v[0];
+        }
+
+        /**
+         * @brief The fold of `map` over the elements described by `s`, one partial result per `policy.grain`
+         *        elements, also when run sequentially.
+         *
+         */
+        template <typename Fold, size_t N, typename T, typename Map>
+        T reduce_all(const Matrix_slice<N> &s, const T *base, const Map &map, const Execution_policy &policy)
+        {
+            MAT_TELEMETRY_SCOPE(reduce, s, sizeof(T));
+            const Segments<N> g(s);
+            const size_t grain = std::max(policy.grain, size_t(1));
+            std::vector<T> partials((s.size + grain - 1) / grain);
+            parallel_chunks(policy, s.size, [&](size_t first, size_t last)
+                            {
+                                for (size_t c = first; c < last; c += grain)
+                                {
+                                    T acc = Fold::template identity<T>();
+                                    for_each_run(g, base, c, std::min(last, c + grain), [&](const T *q, size_t len, size_t stride)
+                                                 { Fold::run(acc, reduce_run<Fold>(q, len, stride, map)); });
+                                    partials[c / grain] = acc;
+                                } });
+            return tree_combine<Fold>(partials);
+        }
+
+        /**
+         * @brief Whether `a` is strictly better than `b` for `Fold` (`Simd_min` or `Simd_max`). A NaN is worse than
+         *        any other value, so that NaNs are skipped.
+         *
+         */
+        template <typename Fold, typename T>
+        bool better(const T &a, const T &b)
+        {
+            if (a != a)
+                return false;
+            if (b != b)
+                return true;
+            T x = b;
+            Fold::run(x, a);
+            return x != b;
+        }
+
+        /**
+         * @brief Fold the run of `n` elements from `p`, at positions `pos, pos + 1, ...`, into the extremum `best` at
+         *        position `index` (`size_t(-1)` before the first element). The first of equal extrema is kept, and
+         *        the first element is kept if all are NaN.
+         *        Contiguous runs are searched block by block with the SIMD kernels, and only a block holding a better
+         *        value is scanned again for its position.
+         *
+         */
+        template <typename Fold, typename T>
+        void arg_run(const T *p, size_t n, size_t stride, size_t pos, T &best, size_t &index)
+        {
+            if (stride != 1)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    if (index == size_t(-1) || better<Fold>(p[i * stride], best))
+                        best = p[i * stride], index = pos + i;
+                return;
+            }
+            for (size_t i = 0; i < n; i += arg_block)
+            {
+                const size_t len = std::min(arg_block, n - i);
+                const T v = simd_reduce<Fold>(p + i, len, Simd_identity());
+                if (index == size_t(-1) || better<Fold>(v, best))
+                {
+                    const size_t at = size_t(std::find(p + i, p + i + len, v) - (p + i));
+                    if (at < len)
+                        best = v, index = pos + i + at;
+                    else if (index == size_t(-1)) // the block is all NaN, which the kernels skip
+                        best = p[i], index = pos + i;
+                }
+            }
+        }
+
+        /**
+         * @brief The position, in row-major order, of the first extremum of the elements described by `s`.
+         *
+         */
+        template <typename Fold, size_t N, typename T>
+        size_t arg_all(const Matrix_slice<N> &s, const T *base, const Execution_policy &policy)
+        {
+            MAT_TELEMETRY_SCOPE(reduce, s, sizeof(T));
+            const Segments<N> g(s);
+            const size_t grain = std::max(policy.grain, size_t(1));
+            std::vector<std::pair<T, size_t>> partials((s.size + grain - 1) / grain);
+            parallel_chunks(policy, s.size, [&](size_t first, size_t last)
+                            {
+                                for (size_t c = first; c < last; c += grain)
+                                {
+                                    T best = Fold::template identity<T>();
+                                    size_t index = size_t(-1), pos = c;
+                                    for_each_run(g, base, c, std::min(last, c + grain), [&](const T *q, size_t len, size_t stride)
+                                                 { arg_run<Fold>(q, len, stride, pos, best, index); pos += len; });
+                                    partials[c / grain] = {best, index};
+                                } });
+            // in order, so that the first of equal extrema wins
+            std::pair<T, size_t> r{Fold::template identity<T>(), size_t(-1)};
+            for (auto &p : partials)
+                if (p.second != size_t(-1) && (r.second == size_t(-1) || better<Fold>(p.first, r.first)))
+                    r = p;
+            return r.second;
+        }
+
+        /**
+         * @brief The extremum of the elements described by `s`. The SIMD kernels skip NaNs and return the identity
+         *        of `Fold` for all NaN, so that result is checked against the element found by `arg_all`.
+         *
+         */
+        template <typename Fold, size_t N, typename T>
+        T extremum_all(const Matrix_slice<N> &s, const T *base, const Execution_policy &policy)
+        {
+            const T r = reduce_all<Fold>(s, base, Simd_identity(), policy);
+            if (!std::numeric_limits<T>::has_quiet_NaN || r != Fold::template identity<T>())
+                return r;
+            const size_t at = arg_all<Fold>(s, base, policy);
+            T x = r;
+            for_each_run(s, base, at, at + 1, [&](const T *q, size_t, size_t)
+                         { x = *q; });
+            return x;
+        }
+
+        /**
+         * @brief The slice of `s` without dimension `axis`.
+         *
+         */
+        template <size_t N>
+        Matrix_slice<N - 1> drop_axis(const Matrix_slice<N> &s, size_t axis)
+        {
+            Matrix_slice<N - 1> r;
+            for (size_t d = 0, e = 0; d < N; ++d)
+                if (d != axis)
+                    r.extents[e] = s.extents[d], r.strides[e] = s.strides[d], ++e;
+            r.start = s.start;
+            r.recalc_size();
+            return r;
+        }
+
+        /**
+         * @brief Whether `axis` has the smallest stride of `s`, so that reducing along it reads runs of elements.
+         *
+         */
+        template <size_t N>
+        bool is_inner_axis(const Matrix_slice<N> &s, size_t axis)
+        {
+            for (size_t d = 0; d < N; ++d)
+                if (d != axis && s.extents[d] > 1 && s.strides[d] < s.strides[axis])
+                    return false;
+            return true;
+        }
+
+        /**
+         * @brief Reduce the elements described by `s` along `axis` into a new `Matrix<R, N - 1>`.
+         *        If `axis` is the innermost one, `out[i] = along(p, len, step, i)` reduces the `len` elements from `p`
+         *        with stride `step`. Otherwise `out` is filled with `init`, and `across(o, q, n, stride, i, k)` folds the
+         *        run of `n` elements of the `k`-th slice along `axis` into `o = out + i`, one slice at a time over a
+         *        chunk of `out` that stays in cache, so the input is still read in runs.
+         *
+         */
+        template <typename R, size_t N, typename T, typename Along, typename Across>
+        Matrix<R, N - 1> reduce_axis_with(const Matrix_slice<N> &s, const T *base, size_t axis, const R &init,
+                                          Along along, Across across, const Execution_policy &policy)
+        {
+            static_assert(N > 1, "reduce_axis_with: reduce a vector as a whole instead.");
+            assert(axis < N);
+            MAT_TELEMETRY_SCOPE(reduce, s, sizeof(T));
+            const Matrix_slice<N - 1> rest = drop_axis(s, axis);
+            Matrix<R, N - 1> out(rest.extents);
+            R *o = out.data();
+            const size_t len = s.extents[axis], step = s.strides[axis];
+            const Segments<N - 1> g(rest);
+            const size_t per_output = std::max<size_t>(policy.grain / std::max<size_t>(len, 1), 1);
+
+            if (is_inner_axis(s, axis))
+                parallel_chunks(policy.grained(per_output), rest.size, [&](size_t first, size_t last)
+                                {
+                                    size_t i = first;
+                                    for_each_run(g, base, first, last, [&](const T *q, size_t n, size_t stride)
+                                                 {
+                                                     for (size_t j = 0; j < n; ++j, ++i)
+                                                         o[i] = along(q + j * stride, len, step, i); }); });
+            else // chunks of `out` wide enough to amortize the walk over each slice
+                parallel_chunks(policy.grained(std::max(per_output, axis_chunk)), rest.size, [&](size_t first, size_t last)
+                                {
+                                    std::fill(o + first, o + last, init);
+                                    Segments<N - 1> gk = g;
+                                    for (size_t k = 0; k < len; ++k, gk.start += step)
+                                    {
+                                        size_t i = first;
+                                        for_each_run(gk, base, first, last, [&](const T *q, size_t n, size_t stride)
+                                                     { across(o + i, q, n, stride, i, k); i += n; });
+                                    } });
+            return out;
+        }
+
+        template <typename Fold, size_t N, typename T, typename Map>
+        Matrix<T, N - 1> reduce_axis(const Matrix_slice<N> &s, const T *base, size_t axis, const Map &map,
+                                     const Execution_policy &policy)
+        {
+            return reduce_axis_with<T>(
+                s, base, axis, Fold::template identity<T>(),
+                [&](const T *p, size_t len, size_t step, size_t)
+                { return reduce_run<Fold>(p, len, step, map); },
+                [&](T *o, const T *q, size_t n, size_t stride, size_t, size_t)
+                { fold_into<Fold>(o, q, n, stride, map); },
+                policy);
+        }
+
+        template <typename Fold, size_t N, typename T>
+        Matrix<size_t, N - 1> arg_axis(const Matrix_slice<N> &s, const T *base, size_t axis, const Execution_policy &policy)
+        {
+            assert(axis < N && s.extents[axis] > 0);
+            std::vector<T> best(is_inner_axis(s, axis) ? 0 : s.size / s.extents[axis]);
+            return reduce_axis_with<size_t>(
+                s, base, axis, size_t(-1),
+                [&](const T *p, size_t len, size_t step, size_t)
+                {
+                    T v = Fold::template identity<T>();
+                    size_t index = size_t(-1);
+                    arg_run<Fold>(p, len, step, 0, v, index);
+                    return index;
+                },
+                [&](size_t *o, const T *q, size_t n, size_t stride, size_t i, size_t k)
+                {
+                    for (size_t j = 0; j < n; ++j)
+                        if (o[j] == size_t(-1) || better<Fold>(q[j * stride], best[i + j]))
+                            best[i + j] = q[j * stride], o[j] = k;
+                },
+                policy);
+        }
+
+        /**
+         * @brief The extrema along `axis`, like `extremum_all`: the lines left at the identity of `Fold` take their
+         *        element found by `arg_axis`.
+         *
+         */
+        template <typename Fold, size_t N, typename T>
+        Matrix<T, N - 1> extremum_axis(const Matrix_slice<N> &s, const T *base, size_t axis, const Execution_policy &policy)
+        {
+            Matrix<T, N - 1> r = reduce_axis<Fold>(s, base, axis, Simd_identity(), policy);
+            T *o = r.data();
+            const T id = Fold::template identity<T>();
+            if (!std::numeric_limits<T>::has_quiet_NaN || std::find(o, o + r.size(), id) == o + r.size())
+                return r;
+            const Matrix<size_t, N - 1> at = arg_axis<Fold>(s, base, axis, policy);
+            const Matrix_slice<N - 1> rest = drop_axis(s, axis);
+            for (size_t i = 0; i < r.size(); ++i)
+                if (o[i] == id)
+                    for_each_run(rest, base, i, i + 1, [&](const T *q, size_t, size_t)
+                                 { o[i] = q[at.data()[i] * s.strides[axis]]; });
+            return r;
+        }
+    };
+
+    /**
+     * @brief The sum of the elements of `m`.
+     *
+     */
+    template <typename T, size_t N>
+    T sum(const Matrix_base<T, N> &m, const Execution_policy &policy = execution::par)
+    {
+        return Matrix_impl::reduce_all<Matrix_impl::Simd_sum>(m.descriptor(), m.data(), Matrix_impl::Simd_identity(), policy);
+    }
+
+    /**
+     * @brief The product of the elements of `m`.
+     *
+     */
+    template <typename T, size_t N>
+    T prod(const Matrix_base<T, N> &m, const Execution_policy &policy = execution::par)
+    {
+        return Matrix_impl::reduce_all<Matrix_impl::Simd_prod>(m.descriptor(), m.data(), Matrix_impl::Simd_identity(), policy);
+    }
+
+    /**
+     * @brief The smallest element of a non-empty `m`, skipping NaNs; NaN if all the elements are.
+     *
+     */
+    template <typename T, size_t N>
+    T min(const Matrix_base<T, N> &m, const Execution_policy &policy = execution::par)
+    {
+        assert(m.size() > 0);
+        return Matrix_impl::extremum_all<Matrix_impl::Simd_min>(m.descriptor(), m.data(), policy);
+    }
+
+    /**
+     * @brief The largest element of a non-empty `m`, skipping NaNs; NaN if all the elements are.
+     *
+     */
+    template <typename T, size_t N>
+    T max(const Matrix_base<T, N> &m, const Execution_policy &policy = execution::par)
+    {
+        assert(m.size() > 0);
+        return Matrix_impl::extremum_all<Matrix_impl::Simd_max>(m.descriptor(), m.data(), policy);
+    }
+
+    /**
+     * @brief The position, in row-major order, of the first smallest element of a non-empty `m`, skipping NaNs;
+     *        0 if all the elements are NaN.
+     *
+     */
+    template <typename T, size_t N>
+    size_t argmin(const Matrix_base<T, N> &m, const Execution_policy &policy = execution::par)
+    {
+        assert(m.size() > 0);
+        return Matrix_impl::arg_all<Matrix_impl::Simd_min>(m.descriptor(), m.data(), policy);
+    }
+
+    /**
+     * @brief The position, in row-major order, of the first largest element of a non-empty `m`, skipping NaNs;
+     *        0 if all the elements are NaN.
+     *
+     */
+    template <typename T, size_t N>
+    size_t argmax(const Matrix_base<T, N> &m, const Execution_policy &policy = execution::par)
+    {
+        assert(m.size() > 0);
+        return Matrix_impl::arg_all<Matrix_impl::Simd_max>(m.descriptor(), m.data(), policy);
+    }
+
+    /**
+     * @brief The mean of the elements of a non-empty `m`, computed in `T`.
+     *
+     */
+    template <typename T, size_t N>
+    T mean(const Matrix_base<T, N> &m, const Execution_policy &policy = execution::par)
+    {
+        assert(m.size() > 0);
+        return sum(m, policy) / T(m.size());
+    }
+
+    /**
+     * @brief The population variance of the elements of a non-empty `m`: the mean squared deviation from the mean,
+     *        computed in two passes.
+     *
+     */
+    template <typename T, size_t N>
+    T variance(const Matrix_base<T, N> &m, const Execution_policy &policy = execution::par)
+    {
+        const T center = mean(m, policy);
+        return Matrix_impl::reduce_all<Matrix_impl::Simd_sum>(m.descriptor(), m.data(), Matrix_impl::Simd_square_dev<T>{center}, policy) /
+               T(m.size());
+    }
+
+    /**
+     * @brief The L1, L2 or L-infinity norm of the elements of `m`.
+     *
+     */
+    template <typename T, size_t N>
+    T norm(const Matrix_base<T, N> &m, Norm kind = Norm::l2, const Execution_policy &policy = execution::par)
+    {
+        using namespace Matrix_impl;
+        switch (kind)
+        {
+        case Norm::l1:
+            return reduce_all<Simd_sum>(m.descriptor(), m.data(), Simd_abs(), policy);
+        case Norm::linf:
+            return m.size() == 0 ? T(0) : reduce_all<Simd_max>(m.descriptor(), m.data(), Simd_abs(), policy);
+        default:
+            return T(std::sqrt(reduce_all<Simd_sum>(m.descriptor(), m.data(), Simd_square(), policy)));
+        }
+    }
+
+    // Reductions along one axis, into a `Matrix` of the other axes.
+
+    template <typename T, size_t N>
+    Matrix<T, N - 1> sum(const Matrix_base<T, N> &m, size_t axis, const Execution_policy &policy = execution::par)
+    {
+        return Matrix_impl::reduce_axis<Matrix_impl::Simd_sum>(m.descriptor(), m.data(), axis, Matrix_impl::Simd_identity(), policy);
+    }
+
+    template <typename T, size_t N>
+    Matrix<T, N - 1> prod(const Matrix_base<T, N> &m, size_t axis, const Execution_policy &policy = execution::par)
+    {
+        return Matrix_impl::reduce_axis<Matrix_impl::Simd_prod>(m.descriptor(), m.data(), axis, Matrix_impl::Simd_identity(), policy);
+    }
+
+    template <typename T, size_t N>
+    Matrix<T, N - 1> min(const Matrix_base<T, N> &m, size_t axis, const Execution_policy &policy = execution::par)
+    {
+        assert(axis < N && m.descriptor().extents[axis] > 0);
+        return Matrix_impl::extremum_axis<Matrix_impl::Simd_min>(m.descriptor(), m.data(), axis, policy);
+    }
+
+    template <typename T, size_t N>
+    Matrix<T, N - 1> max(const Matrix_base<T, N> &m, size_t axis, const Execution_policy &policy = execution::par)
+    {
+        assert(axis < N && m.descriptor().extents[axis] > 0);
+        return Matrix_impl::extremum_axis<Matrix_impl::Simd_max>(m.descriptor(), m.data(), axis, policy);
+    }
+
+    /**
+     * @brief The index along `axis` of the first smallest element of each line of `m` along it, skipping NaNs;
+     *        0 for a line of NaNs.
+     *
+     */
+    template <typename T, size_t N>
+    Matrix<size_t, N - 1> argmin(const Matrix_base<T, N> &m, size_t axis, const Execution_policy &policy = execution::par)
+    {
+        return Matrix_impl::arg_axis<Matrix_impl::Simd_min>(m.descriptor(), m.data(), axis, policy);
+    }
+
+    /**
+     * @brief The index along `axis` of the first largest element of each line of `m` along it, skipping NaNs;
+     *        0 for a line of NaNs.
+     *
+     */
+    template <typename T, size_t N>
+    Matrix<size_t, N - 1> argmax(const Matrix_base<T, N> &m, size_t axis, const Execution_policy &policy = execution::par)
+    {
+        return Matrix_impl::arg_axis<Matrix_impl::Simd_max>(m.descriptor(), m.data(), axis, policy);
+    }
+
+    template <typename T, size_t N>
+    Matrix<T, N - 1> mean(const Matrix_base<T, N> &m, size_t axis, const Execution_policy &policy = execution::par)
+    {
+        assert(axis < N && m.descriptor().extents[axis] > 0);
+        Matrix<T, N - 1> r = sum(m, axis, policy);
+        r /= T(m.descriptor().extents[axis]);
+        return r;
+    }
+
+    template <typename T, size_t N>
+    Matrix<T, N - 1> variance(const Matrix_base<T, N> &m, size_t axis, const Execution_policy &policy = execution::par)
+    {
+        const Matrix<T, N - 1> centers = mean(m, axis, policy);
+        const T *c = centers.data();
+        Matrix<T, N - 1> r = Matrix_impl::reduce_axis_with<T>(
+            m.descriptor(), m.data(), axis, T(0),
+            [&](const T *p, size_t len, size_t step, size_t i)
+            { return Matrix_impl::reduce_run<Matrix_impl::Simd_sum>(p, len, step, Matrix_impl::Simd_square_dev<T>{c[i]}); },
+            [&](T *o, const T *q, size_t n, size_t stride, size_t i, size_t)
+            {
+                for (size_t j = 0; j < n; ++j)
+                {
+                    const T d = q[j * stride] - c[i + j];
+                    o[j] += d * d;
+                }
+            },
+            policy);
+        r /= T(m.descriptor().extents[axis]);
+        return r;
+    }
+
+    template <typename T, size_t N>
+    Matrix<T, N - 1> norm(const Matrix_base<T, N> &m, size_t axis, Norm kind = Norm::l2,
+                          const Execution_policy &policy = execution::par)
+    {
+        using namespace Matrix_impl;
+        switch (kind)
+        {
+        case Norm::l1:
+            return reduce_axis<Simd_sum>(m.descriptor(), m.data(), axis, Simd_abs(), policy);
+        case Norm::linf:
+        {
+            Matrix<T, N - 1> r = reduce_axis<Simd_max>(m.descriptor(), m.data(), axis, Simd_abs(), policy);
+            if (m.descriptor().extents[axis] == 0)
+                r.apply([](T &x)
+                        { x = T(0); });
+            return r;
+        }
+        default:
+        {
+            Matrix<T, N - 1> r = reduce_axis<Simd_sum>(m.descriptor(), m.data(), axis, Simd_square(), policy);
+            r.apply([](T &x)
+                    { x = T(std::sqrt(x)); });
+            return r;
+        }
+        }
+    }
+};
+
+#endif
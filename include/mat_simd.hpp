@@ -0,0 +1,479 @@
+/**
+ * @file mat_simd.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the explicit SIMD kernels used by the element-wise arithmetic of `Matrix` and `Matrix_ref`.
+ *        Every kernel is compiled once per instruction set (SSE2, AVX2, AVX-512) and the best one supported by the
+ *        running CPU is picked at runtime, so that a single binary runs on every x86-64 machine.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_SIMD_H
+#define MAT_SIMD_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MAT_SIMD_X86 1
+#endif
+
+namespace utils
+{
+    namespace Matrix_impl
+    {
+        enum class Simd_isa
+        {
+            scalar,
+            sse2,
+            avx2,
+            avx512
+        };
+
+        inline Simd_isa simd_detect_isa()
+        {
+#ifdef MAT_SIMD_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+                return Simd_isa::avx512;
+            if (__builtin_cpu_supports("avx2"))
+                return Simd_isa::avx2;
+            return Simd_isa::sse2; // baseline of x86-64
+#else
+            return Simd_isa::scalar;
+#endif
+        }
+
+        inline Simd_isa &simd_isa_state()
+        {
+            static Simd_isa isa = simd_detect_isa();
+            return isa;
+        }
+
+        /**
+         * @brief The instruction set the kernels currently dispatch to.
+         *
+         */
+        inline Simd_isa simd_isa() { return simd_isa_state(); }
+
+        /**
+         * @brief Restrict dispatching to at most `isa`, e.g. to compare kernels. Not thread-safe.
+         *
+         */
+        inline void simd_limit_isa(Simd_isa isa) { simd_isa_state() = std::min(isa, simd_detect_isa()); }
+
+        /**
+         * @brief The types that have SIMD kernels: `float`, `double` and the 32/64-bit integers.
+         *
+         */
+        template <typename T>
+        struct Simd_supported
+            : std::integral_constant<bool, std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+                                               (sizeof(T) == 4 || sizeof(T) == 8)>
+        {
+        };
+
+        // In-place element-wise operations. `V` is either a vector or a scalar, `S` is always the scalar operand.
+        struct Simd_add
+        {
+            template <typename V, typename S>
+            __attribute__((always_inline)) static inline void run(V &a, const S &b) { a = a + b; }
+        };
+        struct Simd_sub
+        {
+            template <typename V, typename S>
+            __attribute__((always_inline)) static inline void run(V &a, const S &b) { a = a - b; }
+        };
+        struct Simd_mul
+        {
+            template <typename V, typename S>
+            __attribute__((always_inline)) static inline void run(V &a, const S &b) { a = a * b; }
+        };
+        struct Simd_div
+        {
+            template <typename V, typename S>
+            __attribute__((always_inline)) static inline void run(V &a, const S &b) { a = a / b; }
+        };
+
+        template <typename T, size_t Bytes>
+        struct Simd_vector
+        {
+            typedef T type __attribute__((vector_size(Bytes)));
+        };
+
+        /**
+         * @brief `p[i] = op(p[i], val)` with vectors of `Bytes` bytes, unrolled by four, and a scalar tail.
+         *        It is inlined into each target-specific kernel below and compiled for that instruction set.
+         *
+         */
+        template <size_t Bytes, typename Op, typename T>
+        __attribute__((always_inline)) inline void simd_loop(T *p, size_t n, T val)
+        {
+            using V = typename Simd_vector<T, Bytes>::type;
+            constexpr size_t L = Bytes / sizeof(T);
+            size_t i = 0;
+            for (; i + 4 * L <= n; i += 4 * L)
+            {
+                V v0, v1, v2, v3;
+                std::memcpy(&v0, p + i, Bytes);
+                std::memcpy(&v1, p + i + L, Bytes);
+                std::memcpy(&v2, p + i + 2 * L, Bytes);
+                std::memcpy(&v3, p + i + 3 * L, Bytes);
+                Op::run(v0, val);
+                Op::run(v1, val);
+                Op::run(v2, val);
+                Op::run(v3, val);
+                std::memcpy(p + i, &v0, Bytes);
+                std::memcpy(p + i + L, &v1, Bytes);
+                std::memcpy(p + i + 2 * L, &v2, Bytes);
+                std::memcpy(p + i + 3 * L, &v3, Bytes);
+            }
+            for (; i + L <= n; i += L)
+            {
+                V v;
+                std::memcpy(&v, p + i, Bytes);
+                Op::run(v, val);
+                std::memcpy(p + i, &v, Bytes);
+            }
+            for (; i < n; ++i)
+                Op::run(p[i], val);
+        }
+
+#ifdef MAT_SIMD_X86
+        template <typename Op, typename T>
+        __attribute__((target("avx512f,avx512dq"))) void simd_scalar_op_avx512(T *p, size_t n, T val)
+        {
+            simd_loop<64, Op>(p, n, val);
+        }
+
+        template <typename Op, typename T>
+        __attribute__((target("avx2"))) void simd_scalar_op_avx2(T *p, size_t n, T val)
+        {
+            simd_loop<32, Op>(p, n, val);
+        }
+
+        template <typename Op, typename T>
+        __attribute__((target("sse2"))) void simd_scalar_op_sse2(T *p, size_t n, T val)
+        {
+            simd_loop<16, Op>(p, n, val);
+        }
+#endif
+
+        template <typename Op, typename T>
+        void simd_scalar_op(T *p, size_t n, const T &val, std::false_type)
+        {
+            for (size_t i = 0; i < n; ++i)
+                Op::run(p[i], val);
+        }
+
+        template <typename Op, typename T>
+        void simd_scalar_op(T *p, size_t n, const T &val, std::true_type)
+        {
+            switch (simd_isa())
+            {
+#ifdef MAT_SIMD_X86
+            case Simd_isa::avx512:
+                return simd_scalar_op_avx512<Op>(p, n, val);
+            case Simd_isa::avx2:
+                return simd_scalar_op_avx2<Op>(p, n, val);
+            case Simd_isa::sse2:
+                return simd_scalar_op_sse2<Op>(p, n, val);
+#endif
+            default:
+                return simd_scalar_op<Op>(p, n, val, std::false_type());
+            }
+        }
+
+        /**
+         * @brief `p[i] = op(p[i], val)` over `n` contiguous elements, through the best available kernel.
+         *
+         */
+        template <typename Op, typename T>
+        void simd_scalar_op(T *p, size_t n, const T &val)
+        {
+            simd_scalar_op<Op>(p, n, val, Simd_supported<T>());
+        }
+
+        // Reductions. `Fold::run(acc, x)` folds `x` into `acc`, starting from `Fold::identity<T>()`. A map transforms
+        // every element in place before it is folded. Both work on vectors and on scalars.
+        struct Simd_sum
+        {
+            template <typename T>
+            static constexpr T identity() { return T(0); }
+            template <typename V>
+            __attribute__((always_inline)) static inline void run(V &a, const V &b) { a = a + b; }
+        };
+        struct Simd_prod
+        {
+            template <typename T>
+            static constexpr T identity() { return T(1); }
+            template <typename V>
+            __attribute__((always_inline)) static inline void run(V &a, const V &b) { a = a * b; }
+        };
+        struct Simd_min
+        {
+            template <typename T>
+            static constexpr T identity()
+            {
+                return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+            }
+            template <typename V>
+            __attribute__((always_inline)) static inline void run(V &a, const V &b) { a = b < a ? b : a; }
+        };
+        struct Simd_max
+        {
+            template <typename T>
+            static constexpr T identity()
+            {
+                return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+            }
+            template <typename V>
+            __attribute__((always_inline)) static inline void run(V &a, const V &b) { a = a < b ? b : a; }
+        };
+
+        struct Simd_identity
+        {
+            template <typename V>
+            __attribute__((always_inline)) inline void operator()(V &) const {}
+        };
+        struct Simd_abs
+        {
+            template <typename V>
+            __attribute__((always_inline)) inline void operator()(V &x) const { x = x < 0 ? -x : x; }
+        };
+        struct Simd_square
+        {
+            template <typename V>
+            __attribute__((always_inline)) inline void operator()(V &x) const { x = x * x; }
+        };
+        template <typename T>
+        struct Simd_square_dev // squared deviation from `center`
+        {
+            T center;
+            template <typename V>
+            __attribute__((always_inline)) inline void operator()(V &x) const
+            {
+                x = x - center;
+                x = x * x;
+            }
+        };
+
+        /**
+         * @brief `y[i] += a * x[i]` with vectors of `Bytes` bytes, unrolled by four, and a scalar tail.
+         *
+         */
+        template <size_t Bytes, typename T>
+        __attribute__((always_inline)) inline void simd_axpy_loop(T *y, const T *x, size_t n, T a)
+        {
+            using V = typename Simd_vector<T, Bytes>::type;
+            constexpr size_t L = Bytes / sizeof(T);
+            size_t i = 0;
+            for (; i + 4 * L <= n; i += 4 * L)
+            {
+                V x0, x1, x2, x3, y0, y1, y2, y3;
+                std::memcpy(&x0, x + i, Bytes);
+                std::memcpy(&x1, x + i + L, Bytes);
+                std::memcpy(&x2, x + i + 2 * L, Bytes);
+                std::memcpy(&x3, x + i + 3 * L, Bytes);
+                std::memcpy(&y0, y + i, Bytes);
+                std::memcpy(&y1, y + i + L, Bytes);
+                std::memcpy(&y2, y + i + 2 * L, Bytes);
+                std::memcpy(&y3, y + i + 3 * L, Bytes);
+                y0 += a * x0;
+                y1 += a * x1;
+                y2 += a * x2;
+                y3 += a * x3;
+                std::memcpy(y + i, &y0, Bytes);
+                std::memcpy(y + i + L, &y1, Bytes);
+                std::memcpy(y + i + 2 * L, &y2, Bytes);
+                std::memcpy(y + i + 3 * L, &y3, Bytes);
+            }
+            for (; i + L <= n; i += L)
+            {
+                V xv, yv;
+                std::memcpy(&xv, x + i, Bytes);
+                std::memcpy(&yv, y + i, Bytes);
+                yv += a * xv;
+                std::memcpy(y + i, &yv, Bytes);
+            }
+            for (; i < n; ++i)
+                y[i] += a * x[i];
+        }
+
+#ifdef MAT_SIMD_X86
+        template <typename T>
+        __attribute__((target("avx512f,avx512dq"))) void simd_axpy_avx512(T *y, const T *x, size_t n, T a)
+        {
+            simd_axpy_loop<64>(y, x, n, a);
+        }
+
+        template <typename T>
+        __attribute__((target("avx2"))) void simd_axpy_avx2(T *y, const T *x, size_t n, T a)
+        {
+            simd_axpy_loop<32>(y, x, n, a);
+        }
+
+        template <typename T>
+        __attribute__((target("sse2"))) void simd_axpy_sse2(T *y, const T *x, size_t n, T a)
+        {
+            simd_axpy_loop<16>(y, x, n, a);
+        }
+#endif
+
+        template <typename T>
+        void simd_axpy(T *y, const T *x, size_t n, const T &a, std::false_type)
+        {
+            for (size_t i = 0; i < n; ++i)
+                y[i] += a * x[i];
+        }
+
+        template <typename T>
+        void simd_axpy(T *y, const T *x, size_t n, const T &a, std::true_type)
+        {
+            switch (simd_isa())
+            {
+#ifdef MAT_SIMD_X86
+            case Simd_isa::avx512:
+                return simd_axpy_avx512(y, x, n, a);
+            case Simd_isa::avx2:
+                return simd_axpy_avx2(y, x, n, a);
+            case Simd_isa::sse2:
+                return simd_axpy_sse2(y, x, n, a);
+#endif
+            default:
+                return simd_axpy(y, x, n, a, std::false_type());
+            }
+        }
+
+        /**
+         * @brief `y[i] += a * x[i]` over `n` contiguous elements, through the best available kernel.
+         *
+         */
+        template <typename T>
+        void simd_axpy(T *y, const T *x, size_t n, const T &a)
+        {
+            simd_axpy(y, x, n, a, Simd_supported<T>());
+        }
+
+        /**
+         * @brief Fold `map(p[i])` over `n` elements with vectors of `Bytes` bytes into four independent accumulators,
+         *        which hide the latency of the fold and are combined as a tree at the end.
+         *
+         */
+        template <size_t Bytes, typename Fold, typename T, typename Map>
+        __attribute__((always_inline)) inline T simd_reduce_loop(const T *p, size_t n, const Map &map)
+        {
+            using V = typename Simd_vector<T, Bytes>::type;
+            constexpr size_t L = Bytes / sizeof(T);
+            V a0, a1, a2, a3;
+            for (size_t l = 0; l < L; ++l)
+                a0[l] = Fold::template identity<T>();
+            a1 = a2 = a3 = a0;
+            size_t i = 0;
+            for (; i + 4 * L <= n; i += 4 * L)
+            {
+                V v0, v1, v2, v3;
+                std::memcpy(&v0, p + i, Bytes);
+                std::memcpy(&v1, p + i + L, Bytes);
+                std::memcpy(&v2, p + i + 2 * L, Bytes);
+                std::memcpy(&v3, p + i + 3 * L, Bytes);
+                map(v0);
+                map(v1);
+                map(v2);
+                map(v3);
+                Fold::run(a0, v0);
+                Fold::run(a1, v1);
+                Fold::run(a2, v2);
+                Fold::run(a3, v3);
+            }
+            for (; i + L <= n; i += L)
+            {
+                V v;
+                std::memcpy(&v, p + i, Bytes);
+                map(v);
+                Fold::run(a0, v);
+            }
+            Fold::run(a0, a1);
+            Fold::run(a2, a3);
+            Fold::run(a0, a2);
+            T r = Fold::template identity<T>();
+            for (size_t l = 0; l < L; ++l)
+                Fold::run(r, T(a0[l]));
+            for (; i < n; ++i)
+            {
+                T x = p[i];
+                map(x);
+                Fold::run(r, x);
+            }
+            return r;
+        }
+
+#ifdef MAT_SIMD_X86
+        template <typename Fold, typename T, typename Map>
+        __attribute__((target("avx512f,avx512dq"))) T simd_reduce_avx512(const T *p, size_t n, Map map)
+        {
+            return simd_reduce_loop<64, Fold>(p, n, map);
+        }
+
+        template <typename Fold, typename T, typename Map>
+        __attribute__((target("avx2"))) T simd_reduce_avx2(const T *p, size_t n, Map map)
+        {
+            return simd_reduce_loop<32, Fold>(p, n, map);
+        }
+
+        template <typename Fold, typename T, typename Map>
+        __attribute__((target("sse2"))) T simd_reduce_sse2(const T *p, size_t n, Map map)
+        {
+            return simd_reduce_loop<16, Fold>(p, n, map);
+        }
+#endif
+
+        template <typename Fold, typename T, typename Map>
+        T simd_reduce(const T *p, size_t n, const Map &map, std::false_type)
+        {
+            T r = Fold::template identity<T>();
+            for (size_t i = 0; i < n; ++i)
+            {
+                T x = p[i];
+                map(x);
+                Fold::run(r, x);
+            }
+            return r;
+        }
+
+        template <typename Fold, typename T, typename Map>
+        T simd_reduce(const T *p, size_t n, const Map &map, std::true_type)
+        {
+            switch (simd_isa())
+            {
+#ifdef MAT_SIMD_X86
+            case Simd_isa::avx512:
+                return simd_reduce_avx512<Fold>(p, n, map);
+            case Simd_isa::avx2:
+                return simd_reduce_avx2<Fold>(p, n, map);
+            case Simd_isa::sse2:
+                return simd_reduce_sse2<Fold>(p, n, map);
+#endif
+            default:
+                return simd_reduce<Fold>(p, n, map, std::false_type());
+            }
+        }
+
+        /**
+         * @brief The fold of `map(p[i])` over `n` contiguous elements, through the best available kernel.
+         *
+         */
+        template <typename Fold, typename T, typename Map>
+        T simd_reduce(const T *p, size_t n, const Map &map)
+        {
+            return simd_reduce<Fold>(p, n, map, Simd_supported<T>());
+        }
+    };
+};
+
+#endif
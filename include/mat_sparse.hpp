@@ -0,0 +1,398 @@
+/**
+ * @file mat_sparse.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains `Sparse_matrix`, a 2-dimensional matrix storing only its nonzero elements in compressed
+ *        sparse rows (CSR) or columns (CSC), built from coordinate (COO) entries or from a dense `Matrix<T, 2>`, and
+ *        its products with dense vectors (SpMV) and matrices (SpMM). The products with a CSR matrix are split across
+ *        threads by equal numbers of nonzeros, so that a few dense rows do not leave the other threads idle.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_SPARSE_H
+#define MAT_SPARSE_H
+
+#include "mat.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+    /**
+     * @brief An element of a sparse matrix in coordinate (COO) form.
+     *
+     */
+    template <typename T>
+    struct Sparse_entry
+    {
+        size_t row;
+        size_t column;
+        T value;
+    };
+
+    /**
+     * @brief The compressed axis of a `Sparse_matrix`: `csr` stores each row contiguously, `csc` each column.
+     *
+     */
+    enum class Sparse_format
+    {
+        csr,
+        csc
+    };
+
+    /**
+     * @brief A 2-dimensional matrix of which only the nonzero elements are stored. The nonzeros of the outer slice
+     *        `i` (a row in CSR, a column in CSC) are `values()[p]` at inner index `indices()[p]` for `p` in
+     *        `[offsets()[i], offsets()[i + 1])`, sorted by inner index.
+     *
+     */
+    template <typename T>
+    class Sparse_matrix
+    {
+    public:
+        using value_type = T;
+
+        Sparse_matrix() : offs(1, 0) {}
+        Sparse_matrix(Sparse_matrix &&) = default;
+        Sparse_matrix &operator=(Sparse_matrix &&) = default;
+        Sparse_matrix(Sparse_matrix const &) = default;
+        Sparse_matrix &operator=(Sparse_matrix const &) = default;
+        ~Sparse_matrix() = default;
+
+        /**
+         * @brief An empty `rows * columns` matrix.
+         *
+         */
+        Sparse_matrix(size_t rows, size_t columns, Sparse_format format = Sparse_format::csr)
+            : nrows(rows), ncols(columns), fmt(format), offs(outer() + 1, 0) {}
+
+        /**
+         * @brief A `rows * columns` matrix of the COO `entries`, in any order. Repeated coordinates are summed.
+         *
+         */
+        Sparse_matrix(size_t rows, size_t columns, const std::vector<Sparse_entry<T>> &entries,
+                      Sparse_format format = Sparse_format::csr)
+            : nrows(rows), ncols(columns), fmt(format), offs(outer() + 1, 0)
+        {
+            const bool by_row = fmt == Sparse_format::csr;
+            for (const Sparse_entry<T> &e : entries)
+            {
+                assert(e.row < nrows && e.column < ncols);
+                ++offs[(by_row ? e.row : e.column) + 1];
+            }
+            std::partial_sum(offs.begin(), offs.end(), offs.begin());
+
+            // bucket by outer index, then sort and merge each bucket by inner index
+            std::vector<std::pair<size_t, T>> bucket(entries.size());
+            std::vector<size_t> next(offs.begin(), offs.end() - 1);
+            for (const Sparse_entry<T> &e : entries)
+                bucket[next[by_row ? e.row : e.column]++] = {by_row ? e.column : e.row, e.value};
+
+            idx.reserve(entries.size()), vals.reserve(entries.size());
+            size_t begin = 0;
+            for (size_t i = 0; i < outer(); ++i)
+            {
+                const size_t end = offs[i + 1];
+                std::sort(bucket.begin() + ptrdiff_t(begin), bucket.begin() + ptrdiff_t(end),
+                          [](const std::pair<size_t, T> &x, const std::pair<size_t, T> &y)
+                          { return x.first < y.first; });
+                for (size_t p = begin; p < end; ++p)
+                    if (p > begin && bucket[p].first == idx.back())
+                        vals.back() += bucket[p].second;
+                    else
+                        idx.push_back(bucket[p].first), vals.push_back(bucket[p].second);
+                begin = end;
+                offs[i + 1] = idx.size();
+            }
+        }
+
+        /**
+         * @brief The nonzero elements of the dense `m`.
+         *
+         */
+        explicit Sparse_matrix(const Matrix_base<T, 2> &m, Sparse_format format = Sparse_format::csr)
+            : nrows(m.rows()), ncols(m.columns()), fmt(Sparse_format::csr), offs(nrows + 1, 0)
+        {
+            const Matrix_slice<2> &s = m.descriptor();
+            const T *base = m.data() + s.start;
+            for (size_t i = 0; i < nrows; ++i)
+            {
+                for (size_t j = 0; j < ncols; ++j)
+                {
+                    const T &x = base[i * s.strides[0] + j * s.strides[1]];
+                    if (x != T())
+                        idx.push_back(j), vals.push_back(x);
+                }
+                offs[i + 1] = idx.size();
+            }
+            if (format != fmt)
+                *this = converted(format);
+        }
+
+        // properties
+        size_t rows() const { return nrows; }
+        size_t columns() const { return ncols; }
+        size_t nnz() const { return vals.size(); }
+        Sparse_format format() const { return fmt; }
+
+        // the compressed storage
+        const std::vector<size_t> &offsets() const { return offs; }
+        const std::vector<size_t> &indices() const { return idx; }
+        const std::vector<T> &values() const { return vals; }
+        std::vector<T> &values() { return vals; }
+
+        /**
+         * @brief Element `(i, j)`, zero if it is not stored. Logarithmic in the nonzeros of its row or column.
+         *
+         */
+        T operator()(size_t i, size_t j) const
+        {
+            assert(i < nrows && j < ncols);
+            if (fmt == Sparse_format::csc)
+                std::swap(i, j);
+            const auto first = idx.begin() + ptrdiff_t(offs[i]), last = idx.begin() + ptrdiff_t(offs[i + 1]);
+            const auto p = std::lower_bound(first, last, j);
+            return p != last && *p == j ? vals[size_t(p - idx.begin())] : T();
+        }
+
+        /**
+         * @brief The same matrix stored in `format`, converted in time linear in its size.
+         *
+         */
+        Sparse_matrix converted(Sparse_format format) const
+        {
+            if (format == fmt)
+                return *this;
+            // the inner slices of this are the outer slices of the result, filled in order of the outer index
+            Sparse_matrix res(nrows, ncols, format);
+            for (size_t i : idx)
+                ++res.offs[i + 1];
+            std::partial_sum(res.offs.begin(), res.offs.end(), res.offs.begin());
+            res.idx.resize(nnz()), res.vals.resize(nnz());
+            std::vector<size_t> next(res.offs.begin(), res.offs.end() - 1);
+            for (size_t i = 0; i < outer(); ++i)
+                for (size_t p = offs[i]; p < offs[i + 1]; ++p)
+                {
+                    const size_t q = next[idx[p]]++;
+                    res.idx[q] = i, res.vals[q] = vals[p];
+                }
+            return res;
+        }
+
+        /**
+         * @brief The transpose, which shares the compressed storage of this: a CSR matrix becomes a CSC one.
+         *
+         */
+        Sparse_matrix transposed() const
+        {
+            Sparse_matrix res(*this);
+            std::swap(res.nrows, res.ncols);
+            res.fmt = fmt == Sparse_format::csr ? Sparse_format::csc : Sparse_format::csr;
+            return res;
+        }
+
+        /**
+         * @brief The nonzero elements in COO form, ordered by outer then inner index.
+         *
+         */
+        std::vector<Sparse_entry<T>> entries() const
+        {
+            std::vector<Sparse_entry<T>> res;
+            res.reserve(nnz());
+            for (size_t i = 0; i < outer(); ++i)
+                for (size_t p = offs[i]; p < offs[i + 1]; ++p)
+                    res.push_back(fmt == Sparse_format::csr ? Sparse_entry<T>{i, idx[p], vals[p]}
+                                                            : Sparse_entry<T>{idx[p], i, vals[p]});
+            return res;
+        }
+
+        /**
+         * @brief A dense copy.
+         *
+         */
+        Matrix<T, 2> to_dense() const
+        {
+            Matrix<T, 2> res(nrows, ncols);
+            for (size_t i = 0; i < outer(); ++i)
+                for (size_t p = offs[i]; p < offs[i + 1]; ++p)
+                    (fmt == Sparse_format::csr ? res(i, idx[p]) : res(idx[p], i)) = vals[p];
+            return res;
+        }
+
+    private:
+        size_t nrows = 0;
+        size_t ncols = 0;
+        Sparse_format fmt = Sparse_format::csr;
+        std::vector<size_t> offs; // outer() + 1 offsets into `idx` and `vals`
+        std::vector<size_t> idx;
+        std::vector<T> vals;
+
+        size_t outer() const { return fmt == Sparse_format::csr ? nrows : ncols; }
+    };
+
+    namespace Matrix_impl
+    {
+        /**
+         * @brief Call `body(first, last)` on ranges of the rows of a CSR matrix holding about `policy.grain`
+         *        nonzeros each. A row belongs to the range holding its first nonzero, and the trailing empty rows to
+         *        the last range.
+         *
+         */
+        template <typename Body>
+        void parallel_rows_by_nnz(const Execution_policy &policy, const std::vector<size_t> &offsets, Body body)
+        {
+            const size_t rows = offsets.size() - 1, nnz = offsets.back();
+            parallel_chunks(policy, nnz, [&](size_t first, size_t last)
+                            {
+                                const size_t r0 = size_t(std::lower_bound(offsets.begin(), offsets.end() - 1, first) - offsets.begin());
+                                const size_t r1 = last == nnz ? rows : size_t(std::lower_bound(offsets.begin(), offsets.end() - 1, last) - offsets.begin());
+                                body(r0, r1); });
+        }
+    };
+
+    /**
+     * @brief Sparse matrix-vector product, `y = alpha * A * x + beta * y`. `y` is not read when `beta` is zero.
+     *        With a CSC matrix, the columns are scattered into `y` by a single thread.
+     *
+     */
+    template <typename T>
+    void spmv(const Non_deduced<T> &alpha, const Sparse_matrix<T> &a, const Matrix_base<T, 1> &x,
+              const Non_deduced<T> &beta, Matrix_base<T, 1> &y, const Execution_policy &policy = execution::par)
+    {
+        assert(x.size() == a.columns() && y.size() == a.rows());
+        MAT_TELEMETRY_SCOPE(spmm, {a.rows(), 1, a.columns(), a.nnz()}, a.rows(), (a.nnz() * 2 + x.size() + y.size()) * sizeof(T));
+        const std::vector<size_t> &off = a.offsets(), &idx = a.indices();
+        const std::vector<T> &val = a.values();
+        const T *px = x.data() + x.descriptor().start;
+        T *py = y.data() + y.descriptor().start;
+        const size_t xs = x.descriptor().strides[0], ys = y.descriptor().strides[0];
+
+        if (a.format() == Sparse_format::csr)
+        {
+            Matrix_impl::parallel_rows_by_nnz(policy, off, [&](size_t r0, size_t r1)
+                                              {
+                                                  for (size_t r = r0; r < r1; ++r)
+                                                  {
+                                                      T acc = T();
+                                                      for (size_t p = off[r]; p < off[r + 1]; ++p)
+                                                          acc += val[p] * px[idx[p] * xs];
+                                                      T &out = py[r * ys];
+                                                      out = beta == T(0) ? T(alpha) * acc : T(alpha) * acc + T(beta) * out;
+                                                  } });
+            return;
+        }
+        for (size_t r = 0; r < a.rows(); ++r)
+            py[r * ys] = beta == T(0) ? T() : T(beta) * py[r * ys];
+        for (size_t j = 0; j < a.columns(); ++j)
+        {
+            const T s = T(alpha) * px[j * xs];
+            for (size_t p = off[j]; p < off[j + 1]; ++p)
+                py[idx[p] * ys] += val[p] * s;
+        }
+    }
+
+    template <typename T>
+    void spmv(const Non_deduced<T> &alpha, const Sparse_matrix<T> &a, const Matrix_base<T, 1> &x,
+              const Non_deduced<T> &beta, Matrix_base<T, 1> &&y, const Execution_policy &policy = execution::par)
+    {
+        spmv(alpha, a, x, beta, y, policy);
+    }
+
+    /**
+     * @brief Sparse-dense matrix product, `C = alpha * A * B + beta * C`, computed as scaled rows of `B` added to
+     *        rows of `C`. A CSR `A` is split across threads by rows, a CSC one by columns of `B` and `C`.
+     *
+     */
+    template <typename T>
+    void spmm(const Non_deduced<T> &alpha, const Sparse_matrix<T> &a, const Matrix_base<T, 2> &b,
+              const Non_deduced<T> &beta, Matrix_base<T, 2> &c, const Execution_policy &policy = execution::par)
+    {
+        const size_t n = b.columns();
+        assert(b.rows() == a.columns() && c.rows() == a.rows() && c.columns() == n);
+        MAT_TELEMETRY_SCOPE(spmm, {a.rows(), n, a.columns(), a.nnz()}, c.size(), (a.nnz() * 2 + b.size() + c.size()) * sizeof(T));
+        const std::vector<size_t> &off = a.offsets(), &idx = a.indices();
+        const std::vector<T> &val = a.values();
+        const Matrix_slice<2> &db = b.descriptor(), &dc = c.descriptor();
+        const T *pb = b.data() + db.start;
+        T *pc = c.data() + dc.start;
+
+        // `C(i, [j0, j1)) = beta * C(i, [j0, j1))`, then `C(i, [j0, j1)) += s * B(k, [j0, j1))`
+        auto scale_row = [&](size_t i, size_t j0, size_t j1)
+        {
+            T *ci = pc + i * dc.strides[0];
+            for (size_t j = j0; j < j1; ++j)
+                ci[j * dc.strides[1]] = beta == T(0) ? T() : T(beta) * ci[j * dc.strides[1]];
+        };
+        auto add_row = [&](size_t i, size_t k, T s, size_t j0, size_t j1)
+        {
+            T *ci = pc + i * dc.strides[0];
+            const T *bk = pb + k * db.strides[0];
+            if (dc.strides[1] == 1 && db.strides[1] == 1)
+                for (size_t j = j0; j < j1; ++j)
+                    ci[j] += s * bk[j];
+            else
+                for (size_t j = j0; j < j1; ++j)
+                    ci[j * dc.strides[1]] += s * bk[j * db.strides[1]];
+        };
+
+        // the grain of the policy counts multiply-adds
+        if (a.format() == Sparse_format::csr)
+        {
+            Matrix_impl::parallel_rows_by_nnz(policy.grained(std::max<size_t>(policy.grain / std::max<size_t>(n, 1), 1)), off,
+                                              [&](size_t r0, size_t r1)
+                                              {
+                                                  for (size_t r = r0; r < r1; ++r)
+                                                  {
+                                                      scale_row(r, 0, n);
+                                                      for (size_t p = off[r]; p < off[r + 1]; ++p)
+                                                          add_row(r, idx[p], T(alpha) * val[p], 0, n);
+                                                  } });
+            return;
+        }
+        const size_t width = std::max<size_t>(policy.grain / std::max<size_t>(a.nnz(), 1), 16);
+        Matrix_impl::parallel_chunks(policy.grained(width), n, [&](size_t j0, size_t j1)
+                                     {
+                                         for (size_t r = 0; r < a.rows(); ++r)
+                                             scale_row(r, j0, j1);
+                                         for (size_t k = 0; k < a.columns(); ++k)
+                                             for (size_t p = off[k]; p < off[k + 1]; ++p)
+                                                 add_row(idx[p], k, T(alpha) * val[p], j0, j1); });
+    }
+
+    template <typename T>
+    void spmm(const Non_deduced<T> &alpha, const Sparse_matrix<T> &a, const Matrix_base<T, 2> &b,
+              const Non_deduced<T> &beta, Matrix_base<T, 2> &&c, const Execution_policy &policy = execution::par)
+    {
+        spmm(alpha, a, b, beta, c, policy);
+    }
+
+    /**
+     * @brief Sparse matrix-vector product, as a dense vector.
+     *
+     */
+    template <typename T>
+    Matrix<T, 1> operator*(const Sparse_matrix<T> &a, const Matrix_base<T, 1> &x)
+    {
+        Matrix<T, 1> res(a.rows());
+        spmv(T(1), a, x, T(0), res);
+        return res;
+    }
+
+    /**
+     * @brief Sparse-dense matrix product, as a dense matrix.
+     *
+     */
+    template <typename T>
+    Matrix<T, 2> operator*(const Sparse_matrix<T> &a, const Matrix_base<T, 2> &b)
+    {
+        Matrix<T, 2> res(a.rows(), b.columns());
+        spmm(T(1), a, b, T(0), res);
+        return res;
+    }
+};
+
+#endif
@@ -0,0 +1,292 @@
+/**
+ * @file mat_static.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains `Static_matrix`, a matrix whose extents are template constants. Its elements live inline
+ *        in a `std::array`, every stride is a compile-time constant, and the element-wise operations and the small
+ *        matrix product are unrolled, which suits the many 3x3/4x4 transforms of geometry code.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_STATIC_H
+#define MAT_STATIC_H
+
+#include "mat.hpp"
+
+#include <utility>
+
+namespace utils
+{
+    namespace Matrix_impl
+    {
+        template <size_t... Exts>
+        constexpr std::array<size_t, sizeof...(Exts)> static_strides()
+        {
+            std::array<size_t, sizeof...(Exts)> extents{Exts...}, strides{};
+            size_t s = 1;
+            for (size_t d = sizeof...(Exts); d-- > 0;)
+                strides[d] = s, s *= extents[d];
+            return strides;
+        }
+
+        /**
+         * @brief Call `f(std::integral_constant<size_t, I>())` for every `I` in `[0, n)`, fully unrolled.
+         *
+         */
+        template <typename F, size_t... I>
+        constexpr void unroll(F &&f, std::index_sequence<I...>)
+        {
+            (f(std::integral_constant<size_t, I>()), ...);
+        }
+
+        template <size_t n, typename F>
+        constexpr void unroll(F &&f)
+        {
+            unroll(f, std::make_index_sequence<n>());
+        }
+    };
+
+    /**
+     * @brief A matrix of compile-time extents, e.g. `Static_matrix<float, 4, 4>`, stored inline in row-major order.
+     *        Elements are zero-initialized unless given.
+     *
+     * @tparam T
+     * @tparam Exts
+     */
+    template <typename T, size_t... Exts>
+    class Static_matrix
+    {
+        static_assert(sizeof...(Exts) > 0, "Static_matrix: use a plain T for scalars.");
+
+    public:
+        using value_type = T;
+        using iterator = T *;
+        using const_iterator = const T *;
+
+        static constexpr size_t order = sizeof...(Exts);
+        static constexpr size_t size() { return (Exts * ...); }
+        static constexpr std::array<size_t, order> extents{Exts...};
+        static constexpr std::array<size_t, order> strides = Matrix_impl::static_strides<Exts...>();
+
+        constexpr Static_matrix() = default;
+
+        /**
+         * @brief Construct from the elements in row-major order, e.g. `Static_matrix<int, 2, 2>{1, 2, 3, 4}`.
+         *        Missing trailing elements are zero.
+         *
+         */
+        constexpr Static_matrix(std::initializer_list<T> init)
+        {
+            assert(init.size() <= size());
+            size_t i = 0;
+            for (const T &x : init)
+                elems[i++] = x;
+        }
+
+        /**
+         * @brief Copy a dynamic matrix or view of the same extents.
+         *
+         */
+        explicit Static_matrix(const Matrix_base<T, order> &m)
+        {
+            assert(m.descriptor().extents == extents);
+            Matrix_impl::gather(m.descriptor(), m.data(), elems.data());
+        }
+
+        Matrix<T, order> to_matrix() const
+        {
+            Matrix<T, order> m(Exts...);
+            std::copy(begin(), end(), m.data());
+            return m;
+        }
+
+        static constexpr Static_matrix filled(const T &val)
+        {
+            Static_matrix m;
+            Matrix_impl::unroll<size()>([&](auto i)
+                                      { m.elems[i] = val; });
+            return m;
+        }
+
+        template <size_t O = order, typename = Enable_if<O == 2 && extents[0] == extents[1], void>>
+        static constexpr Static_matrix identity()
+        {
+            Static_matrix m;
+            Matrix_impl::unroll<extents[0]>([&](auto i)
+                                            { m.elems[i * (extents[0] + 1)] = T(1); });
+            return m;
+        }
+
+        // properties
+
+        static constexpr size_t extent(size_t n) { return extents[n]; }
+        static constexpr size_t rows() { return extents[0]; }
+        static constexpr size_t columns() { return order == 1 ? 1 : extents[1 % order]; }
+
+        constexpr T *data() { return elems.data(); }
+        constexpr const T *data() const { return elems.data(); }
+
+        constexpr iterator begin() { return elems.data(); }
+        constexpr iterator end() { return elems.data() + size(); }
+        constexpr const_iterator begin() const { return elems.data(); }
+        constexpr const_iterator end() const { return elems.data() + size(); }
+
+        // element access: the offset folds to a constant whenever the indices are constants
+
+        template <typename... Idx>
+        static constexpr size_t offset(Idx... idx)
+        {
+            static_assert(sizeof...(Idx) == order, "Static_matrix: unmatched number of indices.");
+            const size_t index[]{size_t(idx)...};
+            size_t off = 0;
+            for (size_t d = 0; d < order; ++d)
+            {
+                assert(index[d] < extents[d]);
+                off += index[d] * strides[d];
+            }
+            return off;
+        }
+
+        template <typename... Idx>
+        constexpr T &operator()(Idx... idx) { return elems[offset(idx...)]; }
+
+        template <typename... Idx>
+        constexpr const T &operator()(Idx... idx) const { return elems[offset(idx...)]; }
+
+        constexpr T &operator[](size_t i) { return elems[i]; } // flat access
+        constexpr const T &operator[](size_t i) const { return elems[i]; }
+
+        // arithmetic, unrolled over every element
+
+        template <typename F>
+        constexpr Static_matrix &apply(F f)
+        {
+            Matrix_impl::unroll<size()>([&](auto i)
+                                      { f(elems[i]); });
+            return *this;
+        }
+
+        template <typename F>
+        constexpr Static_matrix &apply(const Static_matrix &m, F f)
+        {
+            Matrix_impl::unroll<size()>([&](auto i)
+                                      { f(elems[i], m.elems[i]); });
+            return *this;
+        }
+
+        constexpr Static_matrix &operator+=(const T &val)
+        {
+            return apply([&](T &a)
+                         { a += val; });
+        }
+        constexpr Static_matrix &operator-=(const T &val)
+        {
+            return apply([&](T &a)
+                         { a -= val; });
+        }
+        constexpr Static_matrix &operator*=(const T &val)
+        {
+            return apply([&](T &a)
+                         { a *= val; });
+        }
+        constexpr Static_matrix &operator/=(const T &val)
+        {
+            return apply([&](T &a)
+                         { a /= val; });
+        }
+        constexpr Static_matrix &operator%=(const T &val)
+        {
+            return apply([&](T &a)
+                         { a %= val; });
+        }
+        constexpr Static_matrix &operator+=(const Static_matrix &m)
+        {
+            return apply(m, [](T &a, const T &b)
+                         { a += b; });
+        }
+        constexpr Static_matrix &operator-=(const Static_matrix &m)
+        {
+            return apply(m, [](T &a, const T &b)
+                         { a -= b; });
+        }
+
+        friend constexpr Static_matrix operator+(Static_matrix a, const Static_matrix &b) { return a += b; }
+        friend constexpr Static_matrix operator-(Static_matrix a, const Static_matrix &b) { return a -= b; }
+        friend constexpr Static_matrix operator+(Static_matrix m, const T &val) { return m += val; }
+        friend constexpr Static_matrix operator+(const T &val, Static_matrix m) { return m += val; }
+        friend constexpr Static_matrix operator-(Static_matrix m, const T &val) { return m -= val; }
+        friend constexpr Static_matrix operator*(Static_matrix m, const T &val) { return m *= val; }
+        friend constexpr Static_matrix operator*(const T &val, Static_matrix m) { return m *= val; }
+        friend constexpr Static_matrix operator/(Static_matrix m, const T &val) { return m /= val; }
+        friend constexpr Static_matrix operator%(Static_matrix m, const T &val) { return m %= val; }
+        friend constexpr Static_matrix operator-(Static_matrix m)
+        {
+            return m.apply([](T &a)
+                           { a = -a; });
+        }
+
+        friend constexpr Static_matrix hadamard(Static_matrix a, const Static_matrix &b)
+        {
+            return a.apply(b, [](T &x, const T &y)
+                           { x *= y; });
+        }
+
+        friend constexpr bool operator==(const Static_matrix &a, const Static_matrix &b)
+        {
+            bool eq = true;
+            Matrix_impl::unroll<size()>([&](auto i)
+                                      { eq = eq && a.elems[i] == b.elems[i]; });
+            return eq;
+        }
+        friend constexpr bool operator!=(const Static_matrix &a, const Static_matrix &b) { return !(a == b); }
+
+    private:
+        std::array<T, (Exts * ...)> elems{};
+    };
+
+    template <typename T, size_t R, size_t C>
+    constexpr Static_matrix<T, C, R> transpose(const Static_matrix<T, R, C> &m)
+    {
+        Static_matrix<T, C, R> t;
+        Matrix_impl::unroll<R>([&](auto i)
+                               { Matrix_impl::unroll<C>([&](auto j)
+                                                        { t[j * R + i] = m[i * C + j]; }); });
+        return t;
+    }
+
+    /**
+     * @brief Matrix product of fixed-size matrices. The loops over the rows and the shared dimension are unrolled, and
+     *        the constant-length loop over a row of `b` is left to the vectorizer.
+     *
+     */
+    template <typename T, size_t M, size_t K, size_t N>
+    constexpr Static_matrix<T, M, N> operator*(const Static_matrix<T, M, K> &a, const Static_matrix<T, K, N> &b)
+    {
+        Static_matrix<T, M, N> c;
+        Matrix_impl::unroll<M>([&](auto i)
+                               { Matrix_impl::unroll<K>([&](auto k)
+                                                        {
+                                                            const T aik = a[i * K + k];
+                                                            for (size_t j = 0; j < N; ++j)
+                                                                c[i * N + j] += aik * b[k * N + j]; }); });
+        return c;
+    }
+
+    /**
+     * @brief Matrix-vector product of fixed-size operands.
+     *
+     */
+    template <typename T, size_t M, size_t K>
+    constexpr Static_matrix<T, M> operator*(const Static_matrix<T, M, K> &a, const Static_matrix<T, K> &x)
+    {
+        Static_matrix<T, M> y;
+        Matrix_impl::unroll<M>([&](auto i)
+                               { Matrix_impl::unroll<K>([&](auto k)
+                                                        { y[i] += a[i * K + k] * x[k]; }); });
+        return y;
+    }
+};
+
+#endif
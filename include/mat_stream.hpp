@@ -0,0 +1,209 @@
+/**
+ * @file mat_stream.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the out-of-core processing of tensor files (see mat_io.hpp) that may not fit in memory.
+ *        The file is processed in blocks of rows, each exposed as a `Matrix_ref`, while the next block is read and
+ *        the previous one written back on a second buffer, so that the I/O overlaps the computation.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_STREAM_H
+#define MAT_STREAM_H
+
+#include "mat.hpp"
+
+#include <future>
+
+#ifdef MAT_HAS_MMAP // POSIX
+namespace utils
+{
+    struct Stream_options
+    {
+        size_t chunk_bytes = size_t(64) << 20; // size of a block of rows; two are held in memory
+        size_t chunk_rows = 0;                 // rows per block, overriding `chunk_bytes` when not 0
+        bool prefetch = true;                  // overlap the I/O with the computation
+        Execution_policy policy = execution::par;
+    };
+
+    namespace Matrix_impl
+    {
+        inline void pread_all(int fd, void *buf, size_t bytes, size_t offset, const std::string &path)
+        {
+            for (char *p = static_cast<char *>(buf); bytes > 0;)
+            {
+                const ssize_t n = ::pread(fd, p, bytes, off_t(offset));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    mmap_error("cannot read", path);
+                p += n, offset += size_t(n), bytes -= size_t(n);
+            }
+        }
+
+        inline void pwrite_all(int fd, const void *buf, size_t bytes, size_t offset, const std::string &path)
+        {
+            for (const char *p = static_cast<const char *>(buf); bytes > 0;)
+            {
+                const ssize_t n = ::pwrite(fd, p, bytes, off_t(offset));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    mmap_error("cannot write", path);
+                p += n, offset += size_t(n), bytes -= size_t(n);
+            }
+        }
+
+        class File_descriptor
+        {
+        public:
+            File_descriptor(const std::string &path, int flags) : fd(::open(path.c_str(), flags, 0644))
+            {
+                if (fd < 0)
+                    mmap_error("cannot open", path);
+            }
+            File_descriptor(const File_descriptor &) = delete;
+            File_descriptor &operator=(const File_descriptor &) = delete;
+            ~File_descriptor() { ::close(fd); }
+            operator int() const { return fd; }
+
+        private:
+            int fd;
+        };
+    };
+
+    /**
+     * @brief Call `f(chunk, first_row)` for consecutive blocks of rows of the tensor file at `path`, where `chunk` is
+     *        a `Matrix_ref<T, N>` over the rows `[first_row, first_row + chunk.rows())`.
+     *        If `out_path` is empty the blocks are only read; if it is `path` they are written back in place;
+     *        otherwise they are written to a new tensor file of the same layout.
+     *
+     * @throw std::runtime_error on I/O errors, or if the file is not a dense tensor of `T` and order `N` in the native
+     *        byte order.
+     */
+    template <typename T, size_t N, typename F>
+    void stream_chunks(const std::string &path, const std::string &out_path, F f, const Stream_options &opt = {})
+    {
+        Tensor_header h;
+        Matrix_slice<N> s;
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+                Matrix_impl::tensor_error("cannot open", path);
+            if (Matrix_impl::read_tensor_header<T, N>(in, path, h, s))
+                Matrix_impl::tensor_error("written with the other byte order", path);
+        }
+        if (!Matrix_impl::is_contiguous(s))
+            Matrix_impl::tensor_error("streaming needs a dense payload", path);
+        const size_t rows = s.extents[0];
+        if (s.size == 0)
+            return;
+
+        const bool in_place = out_path == path, writing = !out_path.empty();
+        Matrix_impl::File_descriptor fd(path, in_place ? O_RDWR : O_RDONLY);
+        std::unique_ptr<Matrix_impl::File_descriptor> out;
+        if (writing && !in_place)
+        {
+            // same header and padding, then the payload block by block
+            out.reset(new Matrix_impl::File_descriptor(out_path, O_WRONLY | O_CREAT | O_TRUNC));
+            std::vector<char> prefix(h.payload_offset);
+            Matrix_impl::pread_all(fd, prefix.data(), prefix.size(), 0, path);
+            Matrix_impl::pwrite_all(*out, prefix.data(), prefix.size(), 0, out_path);
+            if (::ftruncate(*out, off_t(h.payload_offset + h.payload_bytes)) != 0)
+                Matrix_impl::mmap_error("cannot grow", out_path);
+        }
+        const int ofd = in_place ? int(fd) : out ? int(*out) : -1;
+
+        const size_t row_elems = s.size / rows, row_bytes = row_elems * sizeof(T);
+        const size_t chunk_rows = std::min(rows, opt.chunk_rows ? opt.chunk_rows : std::max<size_t>(opt.chunk_bytes / row_bytes, 1));
+        const size_t chunks = (rows + chunk_rows - 1) / chunk_rows;
+        const size_t payload = size_t(h.payload_offset) + s.start * sizeof(T);
+
+        auto rows_of = [&](size_t c)
+        { return std::min(chunk_rows, rows - c * chunk_rows); };
+        auto read = [&](size_t c, T *buf)
+        { Matrix_impl::pread_all(fd, buf, rows_of(c) * row_bytes, payload + c * chunk_rows * row_bytes, path); };
+        auto write = [&](size_t c, const T *buf)
+        {
+            if (writing)
+                Matrix_impl::pwrite_all(ofd, buf, rows_of(c) * row_bytes, payload + c * chunk_rows * row_bytes,
+                                        in_place ? path : out_path);
+        };
+
+        std::vector<T, Aligned_allocator<T>> buffers[2];
+        buffers[0].resize(chunk_rows * row_elems);
+        if (opt.prefetch && chunks > 1)
+            buffers[1].resize(chunk_rows * row_elems);
+        std::future<void> io; // destroyed, and so waited for, before the buffers
+
+        read(0, buffers[0].data());
+        for (size_t c = 0; c < chunks; ++c)
+        {
+            T *cur = buffers[opt.prefetch ? c % 2 : 0].data();
+            if (opt.prefetch)
+            {
+                if (io.valid())
+                    io.get(); // block `c` has arrived and block `c - 1` has been written
+                if (c + 1 < chunks)
+                    io = std::async(std::launch::async, [&, c]
+                                    {
+                                        T *other = buffers[(c + 1) % 2].data();
+                                        if (c > 0)
+                                            write(c - 1, other);
+                                        read(c + 1, other); });
+            }
+            else if (c > 0)
+            {
+                read(c, cur);
+            }
+
+            std::array<size_t, N> extents = s.extents;
+            extents[0] = rows_of(c);
+            Matrix_ref<T, N> chunk(Matrix_slice<N>(extents), cur);
+            f(chunk, c * chunk_rows);
+
+            if (!opt.prefetch)
+                write(c, cur);
+            else if (c + 1 == chunks)
+            {
+                if (io.valid())
+                    io.get();
+                if (c > 0)
+                    write(c - 1, buffers[(c - 1) % 2].data());
+                write(c, cur);
+            }
+        }
+        if (writing && ::fsync(ofd) != 0)
+            Matrix_impl::mmap_error("cannot sync", in_place ? path : out_path);
+    }
+
+    /**
+     * @brief Apply `f` to every element of the tensor file at `path` block by block, writing the results to
+     *        `out_path` (which may be `path` itself).
+     *
+     */
+    template <typename T, size_t N, typename F>
+    void stream_apply(const std::string &path, const std::string &out_path, F f, const Stream_options &opt = {})
+    {
+        assert(!out_path.empty());
+        stream_chunks<T, N>(path, out_path, [&](Matrix_ref<T, N> &chunk, size_t)
+                            { chunk.apply(opt.policy, f); }, opt);
+    }
+
+    /**
+     * @brief Fold the blocks of the tensor file at `path` into `init` with `acc = f(acc, chunk)`.
+     *
+     */
+    template <typename T, size_t N, typename Acc, typename F>
+    Acc stream_reduce(const std::string &path, Acc init, F f, const Stream_options &opt = {})
+    {
+        stream_chunks<T, N>(path, std::string(), [&](Matrix_ref<T, N> &chunk, size_t)
+                            { init = f(std::move(init), static_cast<const Matrix_ref<T, N> &>(chunk)); }, opt);
+        return init;
+    }
+};
+#endif
+
+#endif
@@ -0,0 +1,406 @@
+/**
+ * @file mat_telemetry.hpp
+ * @author IskXCr (IskXCr@outlook.com)
+ * @brief This file contains the opt-in counters of the operations of `Matrix`: calls, elements touched, elapsed time,
+ *        and the allocations made while each operation runs, as well as a timeline of the operations on each thread
+ *        that can be written in the Trace Event Format (chrome://tracing, Perfetto). Define `MAT_ENABLE_TELEMETRY`
+ *        before including "mat.hpp" to turn them on; otherwise the hooks expand to nothing and the snapshots stay empty.
+ * @version 0.1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022 IskXCr
+ *
+ */
+#ifndef MAT_TELEMETRY_H
+#define MAT_TELEMETRY_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <initializer_list>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+    /**
+     * @brief The kinds of operations that are counted. `other` collects the allocations made outside of any of them.
+     *
+     */
+    enum class Matrix_op
+    {
+        other,
+        construct,     // from extents or an initializer list
+        copy,          // deep copy of a `Matrix`
+        copy_from_ref, // deep copy of a `Matrix_ref`
+        apply,
+        scalar_op,
+        expr_eval,
+        gemm,
+        slice,
+        reduce,
+        einsum,        // a contraction of `einsum` or `contract`, whether it runs GEMMs or only sums
+        spmm,          // sparse-dense product, vectors included; shaped rows * columns * depth * nonzeros
+        conv,          // 2-D convolution or correlation, by any method; shaped as the output, then cin * kh * kw
+        factorize,     // LU or Cholesky factorization, in place
+        count
+    };
+
+    constexpr size_t matrix_op_count = size_t(Matrix_op::count);
+
+    inline const char *op_name(Matrix_op op)
+    {
+        static const char *const names[] = {"other", "construct", "copy", "copy_from_ref", "apply",
+                                            "scalar_op", "expr_eval", "gemm", "slice", "reduce",
+                                            "einsum", "spmm", "conv", "factorize"};
+        return op < Matrix_op::count ? names[size_t(op)] : "unknown";
+    }
+
+    struct Op_stats
+    {
+        uint64_t calls = 0;
+        uint64_t elements = 0;
+        uint64_t nanoseconds = 0;
+        uint64_t allocations = 0;
+        uint64_t bytes_allocated = 0;
+    };
+
+    struct Telemetry_snapshot
+    {
+        std::array<Op_stats, matrix_op_count> ops{};
+        uint64_t deallocations = 0;
+
+        const Op_stats &operator[](Matrix_op op) const { return ops[size_t(op)]; }
+
+        uint64_t deep_copies() const { return (*this)[Matrix_op::copy].calls + (*this)[Matrix_op::copy_from_ref].calls; }
+
+        uint64_t allocations() const
+        {
+            uint64_t n = 0;
+            for (auto &s : ops)
+                n += s.allocations;
+            return n;
+        }
+
+        uint64_t bytes_allocated() const
+        {
+            uint64_t n = 0;
+            for (auto &s : ops)
+                n += s.bytes_allocated;
+            return n;
+        }
+    };
+
+    constexpr bool telemetry_enabled()
+    {
+#ifdef MAT_ENABLE_TELEMETRY
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    namespace Matrix_impl
+    {
+        struct Telemetry_counters
+        {
+            std::atomic<uint64_t> calls{0}, elements{0}, nanoseconds{0}, allocations{0}, bytes_allocated{0};
+        };
+
+        struct Telemetry_state
+        {
+            std::array<Telemetry_counters, matrix_op_count> ops;
+            std::atomic<uint64_t> deallocations{0};
+        };
+
+        inline Telemetry_state &telemetry_state()
+        {
+            static Telemetry_state state;
+            return state;
+        }
+
+        // the outermost operation running on this thread
+        inline Matrix_op &telemetry_current()
+        {
+            thread_local Matrix_op op = Matrix_op::other;
+            return op;
+        }
+
+        inline void telemetry_allocation(size_t bytes)
+        {
+            auto &c = telemetry_state().ops[size_t(telemetry_current())];
+            c.allocations.fetch_add(1, std::memory_order_relaxed);
+            c.bytes_allocated.fetch_add(bytes, std::memory_order_relaxed);
+        }
+
+        inline void telemetry_deallocation() { telemetry_state().deallocations.fetch_add(1, std::memory_order_relaxed); }
+
+        constexpr size_t trace_max_order = 6; // dimensions of the shapes recorded in a trace
+
+        struct Trace_event
+        {
+            const char *name;
+            uint32_t thread;
+            uint64_t start;    // ns since `trace_start`
+            uint64_t duration; // ns
+            uint64_t elements;
+            uint64_t bytes;
+            std::array<size_t, trace_max_order> shape;
+            size_t order;
+        };
+
+        struct Trace_state
+        {
+            std::atomic<bool> recording{false};
+            std::mutex mutex;
+            std::vector<Trace_event> events;
+            std::chrono::steady_clock::time_point origin;
+        };
+
+        inline Trace_state &trace_state()
+        {
+            static Trace_state state;
+            return state;
+        }
+
+        inline bool trace_recording() { return trace_state().recording.load(std::memory_order_relaxed); }
+
+        // a small, stable id of the calling thread
+        inline uint32_t trace_thread()
+        {
+            static std::atomic<uint32_t> next{0};
+            thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+            return id;
+        }
+
+        inline void trace_record(Trace_event e, std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1)
+        {
+            auto &state = trace_state();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (!state.recording.load(std::memory_order_relaxed) || t0 < state.origin)
+                return;
+            e.thread = trace_thread();
+            e.start = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(t0 - state.origin).count());
+            e.duration = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            state.events.push_back(e);
+        }
+
+        /**
+         * @brief A span of the timeline without counters, e.g. the share of a parallel region run by one thread.
+         *
+         */
+        class Trace_span
+        {
+        public:
+            Trace_span(const char *name, size_t elements) : name(name), elements(elements), active(trace_recording())
+            {
+                if (active)
+                    t0 = std::chrono::steady_clock::now();
+            }
+            Trace_span(const Trace_span &) = delete;
+            Trace_span &operator=(const Trace_span &) = delete;
+            ~Trace_span()
+            {
+                if (active)
+                    trace_record(Trace_event{name, 0, 0, 0, elements, 0, {elements}, 1}, t0, std::chrono::steady_clock::now());
+            }
+
+        private:
+            const char *name;
+            size_t elements;
+            bool active;
+            std::chrono::steady_clock::time_point t0;
+        };
+
+        /**
+         * @brief Counts one call of `op` over `elements` elements and its duration. Only the outermost scope of a
+         *        thread counts, so an operation implemented with others is not counted twice, and the allocations made
+         *        inside are attributed to it. Every scope, nested or not, is recorded in a running trace.
+         *
+         */
+        class Telemetry_scope
+        {
+        public:
+            Telemetry_scope(Matrix_op op, size_t elements, size_t bytes = 0)
+                : op(op), elements(elements), bytes(bytes), shape{elements}, order(1)
+            {
+                start();
+            }
+
+            // the shape and size of a `Matrix_slice`
+            template <typename Slice>
+            Telemetry_scope(Matrix_op op, const Slice &s, size_t element_bytes)
+                : op(op), elements(s.size), bytes(s.size * element_bytes), order(std::min(s.extents.size(), trace_max_order))
+            {
+                std::copy(s.extents.begin(), s.extents.begin() + order, shape.begin());
+                start();
+            }
+
+            Telemetry_scope(Matrix_op op, std::initializer_list<size_t> dims, size_t elements, size_t bytes)
+                : op(op), elements(elements), bytes(bytes), order(std::min(dims.size(), trace_max_order))
+            {
+                std::copy(dims.begin(), dims.begin() + order, shape.begin());
+                start();
+            }
+
+            Telemetry_scope(const Telemetry_scope &) = delete;
+            Telemetry_scope &operator=(const Telemetry_scope &) = delete;
+            ~Telemetry_scope()
+            {
+                if (!counting && !tracing)
+                    return;
+                const auto t1 = std::chrono::steady_clock::now();
+                if (tracing)
+                    trace_record(Trace_event{op_name(op), 0, 0, 0, elements, bytes, shape, order}, t0, t1);
+                if (!counting)
+                    return;
+                auto &c = telemetry_state().ops[size_t(op)];
+                c.calls.fetch_add(1, std::memory_order_relaxed);
+                c.elements.fetch_add(elements, std::memory_order_relaxed);
+                c.nanoseconds.fetch_add(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()),
+                                        std::memory_order_relaxed);
+                telemetry_current() = Matrix_op::other;
+            }
+
+        private:
+            void start()
+            {
+                counting = telemetry_current() == Matrix_op::other;
+                tracing = trace_recording();
+                if (counting)
+                    telemetry_current() = op;
+                if (counting || tracing)
+                    t0 = std::chrono::steady_clock::now();
+            }
+
+            Matrix_op op;
+            size_t elements;
+            size_t bytes;
+            std::array<size_t, trace_max_order> shape{};
+            size_t order;
+            bool counting = false;
+            bool tracing = false;
+            std::chrono::steady_clock::time_point t0;
+        };
+    };
+
+    /**
+     * @brief The counters accumulated since the start of the program or the last `telemetry_reset`.
+     *
+     */
+    inline Telemetry_snapshot telemetry_snapshot()
+    {
+        Telemetry_snapshot s;
+        auto &state = Matrix_impl::telemetry_state();
+        for (size_t i = 0; i < matrix_op_count; ++i)
+        {
+            auto &c = state.ops[i];
+            s.ops[i] = Op_stats{c.calls.load(std::memory_order_relaxed), c.elements.load(std::memory_order_relaxed),
+                                c.nanoseconds.load(std::memory_order_relaxed), c.allocations.load(std::memory_order_relaxed),
+                                c.bytes_allocated.load(std::memory_order_relaxed)};
+        }
+        s.deallocations = state.deallocations.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    inline void telemetry_reset()
+    {
+        auto &state = Matrix_impl::telemetry_state();
+        for (auto &c : state.ops)
+        {
+            c.calls.store(0, std::memory_order_relaxed);
+            c.elements.store(0, std::memory_order_relaxed);
+            c.nanoseconds.store(0, std::memory_order_relaxed);
+            c.allocations.store(0, std::memory_order_relaxed);
+            c.bytes_allocated.store(0, std::memory_order_relaxed);
+        }
+        state.deallocations.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Start recording a timeline of the operations, discarding any previous one.
+     *
+     */
+    inline void trace_start()
+    {
+        auto &state = Matrix_impl::trace_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.events.clear();
+        state.origin = std::chrono::steady_clock::now();
+        state.recording.store(true, std::memory_order_relaxed);
+    }
+
+    inline void trace_stop() { Matrix_impl::trace_state().recording.store(false, std::memory_order_relaxed); }
+
+    inline size_t trace_event_count()
+    {
+        auto &state = Matrix_impl::trace_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return state.events.size();
+    }
+
+    /**
+     * @brief Write the recorded timeline as Trace Event Format JSON: one complete ("X") event per operation, on the
+     *        track of the thread that ran it, with its shape, element and byte counts as arguments.
+     *
+     */
+    inline void write_trace(std::ostream &os)
+    {
+        auto &state = Matrix_impl::trace_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        uint32_t threads = 0;
+        for (auto &e : state.events)
+            threads = std::max(threads, e.thread + 1);
+
+        auto us = [](uint64_t ns)
+        { return std::to_string(ns / 1000) + "." + std::to_string(ns % 1000 + 1000).substr(1); };
+
+        os << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+        os << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"matrix\"}}";
+        for (uint32_t t = 0; t < threads; ++t)
+            os << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t
+               << ", \"args\": {\"name\": \"thread " << t << "\"}}";
+        for (auto &e : state.events)
+        {
+            os << ",\n  {\"name\": \"" << e.name << "\", \"cat\": \"matrix\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+               << e.thread << ", \"ts\": " << us(e.start) << ", \"dur\": " << us(e.duration)
+               << ", \"args\": {\"shape\": [";
+            for (size_t d = 0; d < e.order; ++d)
+                os << (d ? ", " : "") << e.shape[d];
+            os << "], \"elements\": " << e.elements << ", \"bytes\": " << e.bytes << "}}";
+        }
+        os << "\n]}\n";
+    }
+
+    inline void write_trace(const std::string &path)
+    {
+        std::ofstream os(path);
+        if (!os)
+            throw std::runtime_error("write_trace: cannot open " + path);
+        write_trace(os);
+        if (!os)
+            throw std::runtime_error("write_trace: failed to write " + path);
+    }
+};
+
+#ifdef MAT_ENABLE_TELEMETRY
+#define MAT_TELEMETRY_SCOPE(op, ...) ::utils::Matrix_impl::Telemetry_scope mat_telemetry_scope_(::utils::Matrix_op::op, __VA_ARGS__)
+#define MAT_TRACE_SPAN(name, n) ::utils::Matrix_impl::Trace_span mat_trace_span_(name, (n))
+#define MAT_TELEMETRY_ALLOC(bytes) ::utils::Matrix_impl::telemetry_allocation(bytes)
+#define MAT_TELEMETRY_FREE() ::utils::Matrix_impl::telemetry_deallocation()
+#else
+#define MAT_TELEMETRY_SCOPE(op, ...) ((void)0)
+#define MAT_TRACE_SPAN(name, n) ((void)0)
+#define MAT_TELEMETRY_ALLOC(bytes) ((void)0)
+#define MAT_TELEMETRY_FREE() ((void)0)
+#endif
+
+#endif
@@ -1,13 +1,50 @@
 #include "mat.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
 using namespace std;
 using namespace utils;
 
 void test_template_constructors();
 void test_arithmetic_operations();
+void test_matrix_multiplication();
+void test_parallel_apply();
+void test_simd_kernels();
+void test_expression_templates();
+void test_rvalue_operators();
+void test_random_access_iterator();
+void test_segmented_traversal();
+void test_aligned_storage();
+void test_matrix_arena();
+void test_static_matrix();
+void test_telemetry();
+void test_trace_export();
+void test_mapped_matrix();
+void test_tensor_files();
+void test_streaming();
+void test_slicing();
+void test_permuted_views();
+void test_reductions();
+void test_broadcasting();
+void test_einsum();
+void test_batched_matmul();
+void test_sparse();
+void test_convolution();
+void test_factorizations();
 
 std::vector<void (*)()> funcs{
-    test_template_constructors, test_arithmetic_operations};
+    test_template_constructors, test_arithmetic_operations, test_matrix_multiplication, test_parallel_apply,
+    test_simd_kernels, test_expression_templates, test_rvalue_operators, test_random_access_iterator,
+    test_segmented_traversal, test_aligned_storage, test_matrix_arena,
+    test_static_matrix, test_telemetry, test_trace_export,
+    test_mapped_matrix, test_tensor_files, test_streaming, test_slicing,
+    test_permuted_views, test_reductions, test_broadcasting, test_einsum,
+    test_batched_matmul, test_sparse, test_convolution, test_factorizations};
 
 int main()
 {
@@ -127,4 +164,1186 @@ void test_arithmetic_operations()
     // cout << mat1() << endl;
     // mat1 += mat2;
     // cout << mat1() << endl;
-}
\ No newline at end of file
+}
+void test_matrix_multiplication()
+{
+    cout << "Test matrix multiplication\n";
+    auto naive = [](Matrix_base<double, 2> const &a, Matrix_base<double, 2> const &b, size_t i, size_t j)
+    {
+        auto da = a.descriptor(), db = b.descriptor();
+        double acc = 0;
+        for (size_t p = 0; p < da.extents[1]; ++p)
+            acc += a.data()[da(i, p)] * b.data()[db(p, j)];
+        return acc;
+    };
+
+    Matrix<double, 2> a(67, 45), b(45, 83);
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = double(i % 7) - 3;
+    for (size_t i = 0; i < b.size(); ++i)
+        b.data()[i] = double(i % 5) * 0.5;
+    Matrix<double, 2> c = a * b;
+    assert(c.rows() == 67 && c.columns() == 83);
+    for (size_t i = 0; i < c.rows(); ++i)
+        for (size_t j = 0; j < c.columns(); ++j)
+            assert(c(i, j) == naive(a, b, i, j));
+
+    // strided operands: a column of a 3-dimensional matrix is a 2-dimensional view with non-unit strides
+    Matrix<double, 3> t(45, 3, 37);
+    for (size_t i = 0; i < t.size(); ++i)
+        t.data()[i] = double(i % 11);
+    Matrix_ref<double, 2> bt = t.column(1);
+    Matrix<double, 2> d(67, 37);
+    d.apply([](double &x)
+            { x = 1; });
+    gemm(2.0, a, bt, 1.0, d);
+    for (size_t i = 0; i < d.rows(); ++i)
+        for (size_t j = 0; j < d.columns(); ++j)
+            assert(d(i, j) == 2 * naive(a, bt, i, j) + 1);
+    cout << "========>OK.\n";
+}
+
+void test_parallel_apply()
+{
+    cout << "Test parallel apply\n";
+    Matrix<int, 3> mat(5, 13, 7);
+    int k = 0;
+    mat.apply([&](int &a)
+              { a = k++; });
+
+    mat.apply(execution::par.grained(16), [](int &a)
+              { a *= 2; });
+    for (size_t i = 0; i < mat.size(); ++i)
+        assert(mat.data()[i] == int(2 * i));
+
+    // a strided region, split across threads in chunks that do not line up with its rows
+    mat.column(3).apply(execution::par.scheduled(Execution_policy::guided_schedule).grained(3), [](int &a)
+                        { a = -a; });
+    for (size_t i = 0; i < 5; ++i)
+        for (size_t j = 0; j < 13; ++j)
+            for (size_t l = 0; l < 7; ++l)
+                assert(mat(i, j, l) == (j == 3 ? -1 : 1) * int(2 * mat.descriptor()(i, j, l)));
+
+    Matrix<double, 1> vec(100000);
+    vec += 1.5;
+    vec *= 2;
+    for (auto &x : vec)
+        assert(x == 3);
+    cout << "========>OK.\n";
+}
+
+template <typename T>
+void check_simd_kernels()
+{
+    Matrix<T, 2> mat(9, 37); // rows that are not a multiple of any vector width
+    for (size_t i = 0; i < mat.size(); ++i)
+        mat.data()[i] = T(i % 19);
+    mat *= T(6);
+    mat += T(3);
+    mat -= T(1);
+    mat.row(4) /= T(2);
+    mat.column(5) *= T(3);
+    for (size_t i = 0; i < mat.rows(); ++i)
+        for (size_t j = 0; j < mat.columns(); ++j)
+        {
+            T x = T((i * 37 + j) % 19) * T(6) + T(3) - T(1);
+            if (i == 4)
+                x /= T(2);
+            if (j == 5)
+                x *= T(3);
+            assert(mat(i, j) == x);
+        }
+}
+
+void test_simd_kernels()
+{
+    cout << "Test SIMD kernels\n";
+    using Matrix_impl::Simd_isa;
+    for (Simd_isa isa : {Simd_isa::scalar, Simd_isa::sse2, Simd_isa::avx2, Simd_isa::avx512})
+    {
+        Matrix_impl::simd_limit_isa(isa);
+        check_simd_kernels<float>();
+        check_simd_kernels<double>();
+        check_simd_kernels<int32_t>();
+        check_simd_kernels<int64_t>();
+    }
+    cout << "========>OK.\n";
+}
+
+void test_expression_templates()
+{
+    cout << "Test expression templates\n";
+    Matrix<double, 2> a(4, 6), b(4, 6), c(4, 6);
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = double(i), b.data()[i] = double(i % 3), c.data()[i] = 1;
+
+    auto expr = a * 2.0 + b - c; // nothing is evaluated yet
+    Matrix<double, 2> r = expr;
+    for (size_t i = 0; i < r.size(); ++i)
+        assert(r.data()[i] == 2.0 * i + i % 3 - 1);
+
+    a += 1; // the expression reads the operands when it is evaluated
+    Matrix<double, 2> r2 = expr.eval();
+    assert(r2(3, 5) == 2.0 * 24 + 23 % 3 - 1);
+
+    // strided operands and destination
+    Matrix<double, 3> t(6, 4, 3);
+    for (size_t i = 0; i < t.size(); ++i)
+        t.data()[i] = double(i);
+    Matrix<double, 2> s(6, 3);
+    s = 10 - t.column(2) / 2.0 + hadamard(t.column(1), t.column(0));
+    for (size_t i = 0; i < 6; ++i)
+        for (size_t j = 0; j < 3; ++j)
+            assert(s(i, j) == 10 - t(i, 2, j) / 2.0 + t(i, 1, j) * t(i, 0, j));
+    t.column(3) = -t.column(0);
+    assert(t(5, 3, 2) == -t(5, 0, 2));
+
+    // a view of the destination with another layout is evaluated aside, the same layout in place
+    Matrix<double, 2> sq{{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+    sq = transpose(sq) + 0.0;
+    assert(sq(0, 1) == 4 && sq(1, 0) == 2 && sq(2, 0) == 3 && sq(1, 2) == 8 && sq(2, 2) == 9);
+    Matrix<double, 1> v{{1, 2, 3, 4, 5}};
+    v(Slice(1, 4)) = v(Slice(0, 4)) * 1.0;
+    assert(v(0) == 1 && v(1) == 1 && v(2) == 2 && v(3) == 3 && v(4) == 4);
+    telemetry_reset();
+    sq = sq * 2.0 + 1.0;
+    assert(telemetry_snapshot().allocations() == 0 && sq(0, 1) == 9);
+
+    Matrix<double, 2> p = (a + b) * Matrix<double, 2>(6, 2);
+    assert(p.rows() == 4 && p.columns() == 2);
+    cout << "========>OK.\n";
+}
+
+void test_rvalue_operators()
+{
+    cout << "Test operators on rvalues\n";
+    Matrix<int, 2> m{{1, 2, 3}, {4, 5, 6}}, n{{1, 1, 1}, {2, 2, 2}};
+    const int *buf = m.data();
+
+    Matrix<int, 2> r = 20 - (std::move(m) * 3 + 1); // the buffer of `m` is carried through the chain
+    assert(r.data() == buf);
+    assert(r(0, 0) == 16 && r(1, 2) == 1);
+
+    Matrix<int, 2> s = hadamard(std::move(r), n) - n.row(1)[0]; // mixed with a lvalue matrix and an element of a view
+    assert(s.data() == buf);
+    assert(s(0, 1) == 13 - 2 && s(1, 2) == 2 - 2);
+
+    Matrix<int, 2> t = Matrix<int, 2>(2, 3) + std::move(s);
+    assert(t(0, 1) == 11);
+
+    // the buffer is not reused when the other operand reads it with another layout
+    Matrix<int, 2> sq{{1, 2}, {3, 4}}, sq2{{1, 2}, {3, 4}};
+    Matrix<int, 2> h = hadamard(std::move(sq), transpose(sq));
+    Matrix<int, 2> u = std::move(sq2) - transpose(sq2);
+    assert(h(0, 0) == 1 && h(0, 1) == 6 && h(1, 0) == 6 && h(1, 1) == 16);
+    assert(u(0, 0) == 0 && u(0, 1) == -1 && u(1, 0) == 1 && u(1, 1) == 0);
+
+    double cell = 6; // the operators of the 0-D types return new values
+    Matrix_ref<double, 0> ref(Matrix_slice<0>(), &cell);
+    Matrix<double, 0> z(6.0);
+    assert((ref + 1.0)() == 7 && (ref - 2.0)() == 4 && (ref * 2.0)() == 12 && (ref / 2.0)() == 3 && cell == 6);
+    assert((z + 1.0)() == 7 && (z - 2.0)() == 4 && (z * 2.0)() == 12 && (z / 2.0)() == 3 && z() == 6);
+    cout << "========>OK.\n";
+}
+
+void test_random_access_iterator()
+{
+    cout << "Test random access iterator\n";
+    Matrix<int, 3> mat(4, 5, 6);
+    for (size_t i = 0; i < mat.size(); ++i)
+        mat.data()[i] = int((i * 37) % 101);
+
+    Matrix_ref<int, 2> roi = mat.column(2); // 4 * 6, strides 30 and 1
+    auto first = roi.begin(), last = roi.end();
+    assert(last - first == 24);
+    assert(first[7] == mat(1, 2, 1));
+    assert(*(last - 1) == mat(3, 2, 5));
+    assert(*--(first + 12) == mat(1, 2, 5));
+
+    size_t n = 0;
+    for (auto it = roi.cbegin(); it != roi.cend(); ++it, ++n)
+        assert(*it == mat(n / 6, 2, n % 6));
+
+    std::vector<int> expected(roi.cbegin(), roi.cend());
+    std::sort(expected.begin(), expected.end());
+    std::nth_element(roi.begin(), roi.begin() + 10, roi.end());
+    assert(roi.begin()[10] == expected[10]);
+    std::sort(roi.begin(), roi.end());
+    assert(std::equal(expected.begin(), expected.end(), roi.cbegin()));
+    assert(mat(2, 2, 0) == expected[12] && mat(2, 1, 0) == int(((2 * 30 + 6) * 37) % 101));
+    cout << "========>OK.\n";
+}
+
+void test_segmented_traversal()
+{
+    cout << "Test segmented traversal\n";
+    Matrix<int, 3> mat(3, 4, 5);
+    for (size_t i = 0; i < mat.size(); ++i)
+        mat.data()[i] = int(i);
+
+    Matrix_impl::Segments<2> row(mat.row(1).descriptor()); // one contiguous block
+    assert(row.contiguous() && row.run() == 20 && row.start == 20);
+
+    Matrix_impl::Segments<2> col(mat.column(2).descriptor()); // 3 runs of 5
+    assert(col.dims == 2 && col.run() == 5 && col.stride() == 1);
+
+    Matrix_impl::Segments<1> strided(mat.row(0).column(3).descriptor()); // 4 elements, 5 apart
+    assert(strided.dims == 1 && strided.run() == 4 && strided.stride() == 5 && !strided.contiguous());
+
+    Matrix<int, 2> copy = mat.column(2);
+    for (size_t i = 0; i < 3; ++i)
+        for (size_t j = 0; j < 5; ++j)
+            assert(copy(i, j) == mat(i, 2, j));
+
+    size_t runs = 0;
+    Matrix_impl::for_each_run(mat.column(2).descriptor(), mat.data(), 2, 13, [&](int *q, size_t len, size_t stride)
+                              { ++runs, assert(stride == 1 && len <= 5 && *q % 20 / 5 == 2); });
+    assert(runs == 3);
+
+    Matrix<int, 4> t(2, 3, 4, 5);
+    for (size_t i = 0; i < t.size(); ++i)
+        t.data()[i] = int(i);
+    Matrix_ref<int, 3> dst = t.column(1), src = t.column(2); // strides 60, 5 and 1: runs of 20
+    assert(Matrix_impl::Segments<3>(src.descriptor()).dims == 2);
+    dst = src * 2 + 1;
+    Matrix<int, 3> out(2, 4, 5); // contiguous, but evaluated in the runs of `src`
+    out = src - 1;
+    for (size_t i = 0; i < 2; ++i)
+        for (size_t j = 0; j < 4; ++j)
+            for (size_t k = 0; k < 5; ++k)
+                assert(t(i, 1, j, k) == 2 * t(i, 2, j, k) + 1 && out(i, j, k) == t(i, 2, j, k) - 1);
+    cout << "========>OK.\n";
+}
+
+void test_aligned_storage()
+{
+    cout << "Test aligned storage\n";
+    Matrix<double, 2> a(7, 3);
+    Matrix<float, 1> b(5);
+    assert(Matrix_impl::is_aligned(a.data(), MAT_DEFAULT_ALIGNMENT));
+    assert(Matrix_impl::is_aligned(b.data(), MAT_DEFAULT_ALIGNMENT));
+
+    Matrix<int, 2, Page_aligned_allocator<int>> p(3, 3);
+    assert(Matrix_impl::is_aligned(p.data(), 4096));
+    p += 2;
+    Matrix<int, 2, Page_aligned_allocator<int>> q = std::move(p) * 3; // reuses the page-aligned buffer
+    assert(Matrix_impl::is_aligned(q.data(), 4096) && q(2, 2) == 6);
+    Matrix<int, 2> r = q; // across allocators
+    assert(r(1, 1) == 6);
+
+    Matrix<double, 2, Huge_page_allocator<double>> h(512, 512);
+    assert(Matrix_impl::is_aligned(h.data(), Matrix_impl::huge_page_bytes));
+
+    const size_t ld = leading_dimension<double>(7);
+    assert(ld == 8);
+    Matrix<double, 2> storage(5, ld);
+    auto v = padded_view(storage, 7);
+    assert(v.rows() == 5 && v.columns() == 7 && v.size() == 35);
+    for (size_t i = 0; i < v.rows(); ++i)
+        assert(Matrix_impl::is_aligned(&v(i, 0), MAT_DEFAULT_ALIGNMENT));
+    v += 1.5;
+    assert(storage(4, 6) == 1.5 && storage(4, 7) == 0);
+    cout << "========>OK.\n";
+}
+
+void test_matrix_arena()
+{
+    cout << "Test matrix arena\n";
+    Matrix_arena arena(1 << 12);
+    assert(Matrix_arena::current() == nullptr);
+    for (int round = 0; round < 3; ++round)
+    {
+        Matrix_arena::Scope scope(arena);
+        assert(Matrix_arena::current() == &arena);
+        const double *first;
+        {
+            Arena_matrix<double, 2> a(4, 4);
+            first = a.data();
+            assert(Matrix_impl::is_aligned(first, MAT_DEFAULT_ALIGNMENT));
+        }
+        Arena_matrix<double, 2> b(4, 4); // reuses the storage just released
+        assert(b.data() == first);
+        b += 1;
+        Arena_matrix<double, 2> c = b + b * 2.0;
+        assert(c(3, 3) == 3);
+        Arena_matrix<double, 1> big(2048); // larger than a block
+        big += 1;
+        assert(big(2047) == 1 && Matrix_impl::is_aligned(big.data(), MAT_DEFAULT_ALIGNMENT));
+    }
+    assert(Matrix_arena::current() == nullptr);
+    const size_t reserved = arena.bytes_reserved();
+    {
+        Matrix_arena::Scope scope(arena);
+        Arena_matrix<double, 1> big(2048); // fits in the coalesced block
+        assert(arena.bytes_reserved() == reserved);
+    }
+    Arena_matrix<int, 2> heap(3, 3); // no arena installed
+    heap += 1;
+    assert(heap(2, 2) == 1 && arena.bytes_reserved() == reserved);
+    cout << "========>OK.\n";
+}
+
+void test_static_matrix()
+{
+    cout << "Test static matrix\n";
+    using Mat3 = Static_matrix<double, 3, 3>;
+    static_assert(Mat3::size() == 9 && Mat3::strides[0] == 3 && Mat3::offset(2, 1) == 7, "constexpr layout");
+    static_assert(sizeof(Mat3) == 9 * sizeof(double), "inline storage");
+
+    constexpr Static_matrix<int, 2, 2> a{1, 2, 3, 4};
+    constexpr auto sq = a * a;
+    static_assert(sq(0, 0) == 7 && sq(0, 1) == 10 && sq(1, 0) == 15 && sq(1, 1) == 22, "constexpr product");
+    static_assert(transpose(a)(0, 1) == 3, "constexpr transpose");
+
+    Mat3 r{0, -1, 0,
+           1, 0, 0,
+           0, 0, 1}; // rotation by 90 degrees around z
+    Static_matrix<double, 3> x{1, 2, 3};
+    auto y = r * x;
+    assert(y(0) == -2 && y(1) == 1 && y(2) == 3);
+    assert(r * transpose(r) == Mat3::identity());
+
+    Static_matrix<float, 2, 3> m = Static_matrix<float, 2, 3>::filled(2);
+    m = (m + 1.0f) * 2.0f - m;
+    assert(m(1, 2) == 4 && hadamard(m, m)(0, 0) == 16);
+
+    // agrees with the dynamic matrices
+    Matrix<double, 2> d(3, 3);
+    for (size_t i = 0; i < 9; ++i)
+        d.data()[i] = double(i);
+    Mat3 s(d);
+    Matrix<double, 2> prod = d * d;
+    Matrix<double, 2> sprod = (s * s).to_matrix();
+    for (size_t i = 0; i < 3; ++i)
+        for (size_t j = 0; j < 3; ++j)
+            assert(prod(i, j) == sprod(i, j));
+    Static_matrix<double, 3> col(d.column(1));
+    assert(col(2) == 7);
+
+    Static_matrix<float, 16, 16> big = Static_matrix<float, 16, 16>::identity() * 3.0f;
+    auto big2 = big * big;
+    assert(big2(5, 5) == 9 && big2(5, 6) == 0);
+    cout << "========>OK.\n";
+}
+
+void test_telemetry()
+{
+    cout << "Test telemetry\n";
+    assert(telemetry_enabled());
+    Matrix<double, 2> a(4, 5);
+    static_assert(std::is_reference<decltype(a.descriptor())>::value, "descriptor() must not copy");
+
+    telemetry_reset();
+    Matrix<double, 2> b(4, 5);
+    Matrix<double, 2> c = b;                 // deep copy
+    Matrix<double, 1> d(b.row(1));           // deep copy of a view
+    Matrix<double, 2> e = std::move(c);      // no copy
+    b += 1.0;                                // in place
+    Matrix<double, 2> f = a + b * 2.0;       // one pass, one allocation
+    Matrix<double, 2> g = f * 4.0 + 1.0;
+    Telemetry_snapshot s = telemetry_snapshot();
+
+    assert(s[Matrix_op::construct].calls == 1 && s[Matrix_op::construct].elements == 20);
+    assert(s[Matrix_op::construct].allocations == 1 && s[Matrix_op::construct].bytes_allocated >= 20 * sizeof(double));
+    assert(s[Matrix_op::copy].calls == 1 && s[Matrix_op::copy_from_ref].calls == 1 && s.deep_copies() == 2);
+    assert(s[Matrix_op::scalar_op].calls == 1 && s[Matrix_op::scalar_op].allocations == 0);
+    assert(s[Matrix_op::expr_eval].calls == 2 && s[Matrix_op::expr_eval].allocations == 2);
+    assert(s[Matrix_op::other].allocations == 0);
+    assert(s.allocations() == 5);
+
+    Matrix<double, 2> p(4, 5);
+    Matrix<double, 2> q(5, 3);
+    telemetry_reset();
+    Matrix<double, 2> r = p * q;
+    s = telemetry_snapshot();
+    assert(s[Matrix_op::gemm].calls == 1 && s[Matrix_op::gemm].elements == 12 && s[Matrix_op::gemm].allocations == 1);
+    assert(s[Matrix_op::construct].calls == 0); // counted as part of the product
+    assert(string(op_name(Matrix_op::copy_from_ref)) == "copy_from_ref");
+    cout << "========>OK.\n";
+}
+
+void test_trace_export()
+{
+    cout << "Test trace export\n";
+    Matrix<double, 2> a(300, 200);
+    trace_start();
+    a += 1.0;                                   // parallel: one chunk span per grain
+    a.apply([](double &x)
+            { x *= 2; });
+    Matrix<double, 1> c(a.column(3));
+    Matrix<double, 2> p = a * Matrix<double, 2>(200, 10);
+    trace_stop();
+    const size_t events = trace_event_count();
+    a += 1.0; // not recorded
+    assert(events >= 5 && trace_event_count() == events);
+
+    ostringstream os;
+    write_trace(os);
+    const string json = os.str();
+    assert(json.find("\"traceEvents\"") != string::npos && json.find("\"thread_name\"") != string::npos);
+    assert(json.find("\"name\": \"scalar_op\", \"cat\": \"matrix\", \"ph\": \"X\"") != string::npos);
+    assert(json.find("\"name\": \"apply\"") != string::npos);
+    assert(json.find("\"shape\": [300, 200], \"elements\": 60000, \"bytes\": 480000") != string::npos);
+    assert(json.find("\"name\": \"chunk\"") != string::npos);
+    assert(json.find("\"name\": \"slice\"") != string::npos && json.find("\"name\": \"copy_from_ref\"") != string::npos);
+    assert(json.find("\"name\": \"gemm\"") != string::npos && json.find("\"shape\": [300, 10, 200]") != string::npos);
+    assert(count(json.begin(), json.end(), '{') == count(json.begin(), json.end(), '}'));
+    cout << "========>OK.\n";
+}
+
+// a file in the temporary directory, named after the process so that concurrent runs of the tests do not share it
+string temp_path(const string &name)
+{
+    return (std::filesystem::temp_directory_path() / ("mat_test_" + to_string(::getpid()) + "_" + name)).string();
+}
+
+void test_mapped_matrix()
+{
+    cout << "Test mapped matrix\n";
+    const string path = temp_path("mapped.bin");
+    std::remove(path.c_str());
+    {
+        // a new file is created and grown by a read-write mapping
+        Mapped_matrix<double, 2> m(path, Map_mode::read_write, {3, 4}, 16, Access_pattern::sequential);
+        assert(m.rows() == 3 && m.columns() == 4 && std::filesystem::file_size(path) == 16 + 12 * sizeof(double));
+        for (size_t i = 0; i < 12; ++i)
+            m.data()[i] = double(i);
+        m.column(1) += 100;
+        m.sync();
+    }
+    {
+        ifstream in(path, ios::binary);
+        in.seekg(16 + 5 * sizeof(double));
+        double x;
+        in.read(reinterpret_cast<char *>(&x), sizeof(x));
+        assert(in && x == 105);
+    }
+    {
+        Mapped_matrix<double, 2> ro(path, Map_mode::read_only, {3, 4}, 16, Access_pattern::random);
+        assert(ro(2, 3) == 11 && ro.row(2)(1) == 109);
+        Matrix<double, 1> col(ro.column(1));
+        assert(col(0) == 101 && col(2) == 109);
+        double sum = 0;
+        for (double x : ro)
+            sum += x;
+        assert(sum == 366);
+
+        Mapped_matrix<double, 2> cow(path, Map_mode::copy_on_write, {3, 4}, 16);
+        cow.apply([](double &x)
+                  { x = -x; });
+        cow = cow * 2.0;
+        assert(cow(0, 0) == 0 && cow(1, 1) == -210 && ro(1, 1) == 105); // private to cow
+
+        Mapped_matrix<double, 2> moved = std::move(cow);
+        assert(moved(1, 1) == -210 && cow.data() == nullptr);
+
+        bool refused = false; // dropping the pages of a private mapping would lose its writes
+        try
+        {
+            moved.advise(Access_pattern::dont_need);
+        }
+        catch (const std::invalid_argument &)
+        {
+            refused = true;
+        }
+        assert(refused && moved(1, 1) == -210);
+        ro.advise(Access_pattern::dont_need);
+        assert(ro(1, 1) == 105);
+    }
+    bool thrown = false;
+    try
+    {
+        Mapped_matrix<double, 2> too_big(path, Map_mode::read_only, {30, 40});
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    std::remove(path.c_str());
+    cout << "========>OK.\n";
+}
+
+void test_tensor_files()
+{
+    cout << "Test tensor files\n";
+    const string path = temp_path("tensor.matx");
+    Matrix<double, 3> a(3, 4, 5);
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = double(i) * 0.5;
+
+    save(path, a);
+    assert(std::filesystem::file_size(path) == Matrix_impl::page_bytes + a.size() * sizeof(double));
+    Matrix<double, 3> b = load<double, 3>(path);
+    assert(b.descriptor().extents == a.descriptor().extents && std::equal(a.begin(), a.end(), b.begin()));
+
+    {
+        auto m = map_tensor<double, 3>(path, Map_mode::read_only, Access_pattern::sequential);
+        assert(Matrix_impl::is_aligned(m.data(), Matrix_impl::page_bytes));
+        assert(m(2, 3, 4) == a(2, 3, 4) && m.row(1)(2, 3) == a(1, 2, 3));
+    }
+
+    save(path, a.column(2), 64); // a strided view is written densely
+    Matrix<double, 2> c = load<double, 2>(path);
+    assert(c.rows() == 3 && c.columns() == 5 && c(2, 4) == a(2, 2, 4));
+
+    bool thrown = false;
+    try
+    {
+        load<float, 2>(path);
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // a file written on a machine of the other byte order is converted by load()
+    Matrix<int, 1> v{{1, 2, 0x01020304}};
+    save(path, v, 64);
+    vector<char> bytes(std::filesystem::file_size(path));
+    {
+        ifstream in(path, ios::binary);
+        in.read(bytes.data(), std::streamsize(bytes.size()));
+    }
+    Matrix_impl::byteswap_elements(bytes.data() + 4, 5, 4);  // version .. order
+    Matrix_impl::byteswap_elements(bytes.data() + 24, 4, 8); // alignment .. start
+    Matrix_impl::byteswap_elements(bytes.data() + 64, 2, 8); // extents, strides
+    Matrix_impl::byteswap_elements(bytes.data() + 128, 3, 4); // payload
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        out.write(bytes.data(), std::streamsize(bytes.size()));
+    }
+    Matrix<int, 1> w = load<int, 1>(path);
+    assert(w(0) == 1 && w(1) == 2 && w(2) == 0x01020304);
+    std::remove(path.c_str());
+    cout << "========>OK.\n";
+}
+
+void test_streaming()
+{
+    cout << "Test out-of-core streaming\n";
+    const string path = temp_path("stream.matx"), out = temp_path("stream_out.matx");
+    Matrix<double, 2> a(1000, 37);
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = double(i % 101);
+    save(path, a);
+
+    for (bool prefetch : {true, false})
+    {
+        Stream_options opt;
+        opt.chunk_rows = 64;
+        opt.prefetch = prefetch;
+
+        // blocks of rows arrive in order, the last one shorter
+        size_t next = 0;
+        stream_chunks<double, 2>(path, "", [&](Matrix_ref<double, 2> &chunk, size_t first)
+                                 {
+                                     assert(first == next && chunk.columns() == 37);
+                                     assert(chunk.rows() == std::min<size_t>(64, 1000 - first));
+                                     assert(chunk(0, 5) == a(first, 5));
+                                     next += chunk.rows(); }, opt);
+        assert(next == 1000);
+
+        const double sum = stream_reduce<double, 2>(path, 0.0, [](double acc, const Matrix_ref<double, 2> &chunk)
+                                                    {
+                                                        for (const double &x : chunk)
+                                                            acc += x;
+                                                        return acc; }, opt);
+        assert(sum == std::accumulate(a.begin(), a.end(), 0.0));
+
+        // to a new file, leaving the input alone
+        stream_apply<double, 2>(path, out, [](double &x)
+                                { x += 1; }, opt);
+        Matrix<double, 2> b = load<double, 2>(out);
+        assert(b.rows() == 1000 && b(999, 36) == a(999, 36) + 1 && b(0, 0) == 1);
+        assert((load<double, 2>(path)(999, 36) == a(999, 36)));
+    }
+
+    // in place, with blocks sized in bytes
+    Stream_options opt;
+    opt.chunk_bytes = 100 * 37 * sizeof(double) + 1;
+    stream_apply<double, 2>(path, path, [](double &x)
+                            { x *= 2; }, opt);
+    Matrix<double, 2> c = load<double, 2>(path);
+    for (size_t i = 0; i < c.size(); ++i)
+        assert(c.data()[i] == 2 * a.data()[i]);
+
+    std::remove(path.c_str());
+    std::remove(out.c_str());
+    cout << "========>OK.\n";
+}
+
+void test_slicing()
+{
+    cout << "Test N-D slicing\n";
+    Matrix<int, 3> a(4, 6, 5);
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = int(i);
+
+    // a view shares the elements, with the strides composed
+    auto v = a(Slice(0, 2, 2), Slice(1), 3);
+    assert(v.rows() == 2 && v.columns() == 5 && v.descriptor().extents[2] == 1 && v.size() == 10);
+    assert(v.data() == a.data() && v(1, 4, 0) == a(2, 5, 3));
+    v(0, 0, 0) = -1;
+    assert(a(0, 1, 3) == -1);
+
+    // slicing a view
+    auto w = v(Slice(1, 1), Slice(0, 2, 3), Slice());
+    assert(w.size() == 2 && w(0, 0, 0) == a(2, 1, 3) && w(0, 1, 0) == a(2, 4, 3));
+    w += 1000;
+    assert(a(2, 4, 3) == int(2 * 30 + 4 * 5 + 3) + 1000);
+
+    // a whole-dimension slice keeps everything, and the views are contiguous where the parent is
+    auto all = a(Slice(), Slice(), Slice());
+    assert(all.size() == a.size() && Matrix_impl::is_contiguous(all.descriptor()));
+    assert(!Matrix_impl::is_contiguous(a(Slice(), Slice(0, 3), Slice()).descriptor()));
+
+    // copying a strided view into a new matrix
+    Matrix<int, 2> m{{1, 2, 3, 4}, {5, 6, 7, 8}, {9, 10, 11, 12}};
+    Matrix<int, 2> corners(m(Slice(0, 2, 2), Slice(0, 2, 3)));
+    assert(corners(0, 0) == 1 && corners(0, 1) == 4 && corners(1, 0) == 9 && corners(1, 1) == 12);
+
+    Matrix<int, 1> x{{0, 1, 2, 3, 4, 5, 6}};
+    auto odd = x(Slice(1, 3, 2));
+    assert(odd.size() == 3 && odd(2) == 5);
+    auto tail = odd(Slice(1));
+    assert(tail.size() == 2 && tail(0) == 3);
+    cout << "========>OK.\n";
+}
+
+void test_permuted_views()
+{
+    cout << "Test transpose and permute views\n";
+    Matrix<int, 2> a(70, 45);
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = int(i);
+
+    auto t = transpose(a);
+    assert(t.rows() == 45 && t.columns() == 70 && t.data() == a.data());
+    assert(t(3, 60) == a(60, 3));
+    t(0, 1) = -5;
+    assert(a(1, 0) == -5);
+
+    for (auto policy : {execution::seq, execution::par.grained(64)})
+    {
+        Matrix<int, 2> m = materialize(t, policy);
+        assert(Matrix_impl::is_contiguous(m.descriptor()));
+        for (size_t i = 0; i < m.rows(); ++i)
+            for (size_t j = 0; j < m.columns(); ++j)
+                assert(m(i, j) == a(j, i));
+    }
+
+    // a transposed slice, and the transpose of the transpose
+    Matrix<int, 2> s = materialize(transpose(a(Slice(1, 40, 1), Slice(0, 20, 2))));
+    assert(s.rows() == 20 && s.columns() == 40 && s(19, 39) == a(40, 38));
+    assert(transpose(transpose(a))(69, 44) == a(69, 44));
+
+    Matrix<double, 3> b(5, 40, 37);
+    for (size_t i = 0; i < b.size(); ++i)
+        b.data()[i] = double(i);
+    auto p = permute(b, {2, 0, 1});
+    assert(p.descriptor().extents == (std::array<size_t, 3>{37, 5, 40}));
+    assert(p(36, 4, 39) == b(4, 39, 36));
+    Matrix<double, 3> q = materialize(p, execution::par.grained(1));
+    for (size_t i = 0; i < 37; ++i)
+        for (size_t j = 0; j < 5; ++j)
+            for (size_t k = 0; k < 40; ++k)
+                assert(q(i, j, k) == b(j, k, i));
+
+    // an axis order that keeps the innermost axis is copied in runs
+    Matrix<double, 3> r = materialize(permute(b, {1, 0, 2}));
+    assert(r(39, 4, 36) == b(4, 39, 36) && r(0, 1, 0) == b(1, 0, 0));
+    cout << "========>OK.\n";
+}
+
+void test_reductions()
+{
+    cout << "Test reductions\n";
+    Matrix<double, 2> a(300, 257);
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = double((i * 7919) % 1000) - 500.0;
+    a(123, 45) = -1000, a(200, 7) = 1000, a(250, 250) = 1000;
+
+    double total = 0, l1 = 0, l2 = 0;
+    for (double x : a)
+        total += x, l1 += std::abs(x), l2 += x * x;
+    for (auto policy : {execution::seq, execution::par.grained(1000)})
+    {
+        assert(std::abs(sum(a, policy) - total) < 1e-6);
+        assert(min(a, policy) == -1000 && max(a, policy) == 1000);
+        assert(argmin(a, policy) == 123 * 257 + 45 && argmax(a, policy) == 200 * 257 + 7);
+        assert(std::abs(norm(a, Norm::l1, policy) - l1) < 1e-6 && norm(a, Norm::linf, policy) == 1000);
+        assert(std::abs(norm(a, Norm::l2, policy) - std::sqrt(l2)) < 1e-6);
+    }
+    // the partial results are combined in the same order whatever the number of threads
+    assert(sum(a, execution::seq.grained(512)) == sum(a, execution::par.grained(512)));
+    const double mu = total / double(a.size());
+    double var = 0;
+    for (double x : a)
+        var += (x - mu) * (x - mu);
+    assert(std::abs(mean(a) - mu) < 1e-9 && std::abs(variance(a) - var / double(a.size())) < 1e-6);
+
+    // along each axis, of a matrix and of a strided view
+    for (size_t axis : {0, 1})
+    {
+        Matrix<double, 1> s = sum(a, axis), lo = min(a, axis), v = variance(a, axis, execution::par.grained(64));
+        Matrix<size_t, 1> hi = argmax(a, axis);
+        const size_t lines = axis == 0 ? a.columns() : a.rows(), len = a.descriptor().extents[axis];
+        assert(s.size() == lines && hi.size() == lines);
+        for (size_t i = 0; i < lines; ++i)
+        {
+            double t = 0, m = 1e9, q = 0;
+            size_t at = 0;
+            for (size_t k = 0; k < len; ++k)
+            {
+                const double x = axis == 0 ? a(k, i) : a(i, k);
+                t += x, m = std::min(m, x);
+                if (x > (axis == 0 ? a(at, i) : a(i, at)))
+                    at = k;
+            }
+            for (size_t k = 0; k < len; ++k)
+            {
+                const double d = (axis == 0 ? a(k, i) : a(i, k)) - t / double(len);
+                q += d * d;
+            }
+            assert(std::abs(s(i) - t) < 1e-6 && lo(i) == m && hi(i) == at);
+            assert(std::abs(v(i) - q / double(len)) < 1e-6);
+        }
+    }
+
+    Matrix<int, 3> b(4, 5, 6);
+    for (size_t i = 0; i < b.size(); ++i)
+        b.data()[i] = int(i % 11) - 3;
+    auto view = b(Slice(1, 3), Slice(0, 3, 2), Slice());
+    Matrix<int, 2> n1 = norm(view, 1, Norm::l1), p = prod(view, 2);
+    assert(n1.rows() == 3 && n1.columns() == 6);
+    assert(n1(2, 5) == std::abs(b(3, 0, 5)) + std::abs(b(3, 2, 5)) + std::abs(b(3, 4, 5)));
+    int expected = 1;
+    for (size_t k = 0; k < 6; ++k)
+        expected *= b(2, 4, k);
+    assert(p(1, 2) == expected);
+    assert(sum(view) == std::accumulate(view.begin(), view.end(), 0));
+    assert(max(transpose(a)) == 1000 && argmin(transpose(a)) == 45 * 300 + 123);
+
+    // NaNs are skipped on every path, and a search over NaNs only gives NaN at its first position
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    Matrix<double, 2> c(3, 2000);
+    for (size_t i = 0; i < c.size(); ++i)
+        c.data()[i] = nan;
+    c(1, 1500) = 4, c(1, 1700) = -2, c(2, 3) = 7;
+    for (auto policy : {execution::seq, execution::par.grained(700)})
+    {
+        assert(argmin(c, policy) == 2000 + 1700 && argmax(c, policy) == 2 * 2000 + 3);
+        assert(min(c, policy) == -2 && max(c, policy) == 7);
+        assert(argmax(c.row(0), policy) == 0 && std::isnan(min(c.row(0), policy)) && std::isnan(max(c.row(0), policy)));
+        assert(argmin(c.column(0), policy) == 0 && std::isnan(max(c.column(0), policy)) && argmax(c.column(3), policy) == 2);
+    }
+    Matrix<size_t, 1> across = argmin(c, 0), along = argmax(c, 1);
+    assert(across(0) == 0 && across(1500) == 1 && across(3) == 2 && along(0) == 0 && along(1) == 1500 && along(2) == 3);
+    Matrix<double, 1> mx = max(c, 0), mn = min(c, 1);
+    assert(std::isnan(mx(0)) && mx(1700) == -2 && std::isnan(mn(0)) && mn(1) == -2 && mn(2) == 7);
+    cout << "========>OK.\n";
+}
+
+void test_broadcasting()
+{
+    cout << "Test broadcasting\n";
+    Matrix<double, 2> a(3, 4);
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = double(i);
+    Matrix<double, 1> bias{{10, 20, 30, 40}};
+
+    // a vector added to every row, without copies of it
+    telemetry_reset();
+    Matrix<double, 2> b = a + bias;
+    assert(telemetry_snapshot().allocations() == 1);
+    assert(b.rows() == 3 && b.columns() == 4 && b(2, 3) == 11 + 40 && b(0, 0) == 10);
+    Matrix<double, 2> c = bias * 2.0 - a;
+    assert(c(1, 2) == 60 - 6);
+
+    // a column against a row gives the outer sum
+    Matrix<double, 2> col{{1}, {2}, {3}};
+    Matrix<double, 2> row{{100, 200, 300, 400}};
+    Matrix<double, 2> outer = col + row;
+    assert(outer.rows() == 3 && outer.columns() == 4 && outer(2, 1) == 203);
+    assert(eval(hadamard(col, row))(1, 3) == 800);
+
+    // a per-channel scale of an image, also through a view and in place
+    Matrix<float, 3> image(3, 5, 6);
+    image.apply([](float &x)
+                { x = 1; });
+    Matrix<float, 3> scale{{{0.5f}}, {{2.f}}, {{4.f}}};
+    image = hadamard(image, scale) + 1.f;
+    assert(image(0, 4, 5) == 1.5f && image(1, 0, 0) == 3.f && image(2, 2, 2) == 5.f);
+    image.row(2) = image.row(2) + scale.row(0);
+    assert(image(2, 3, 3) == 5.5f);
+
+    // the repeated view itself has zero strides
+    auto rep = broadcast_to<2>(bias, {5, 4});
+    assert(rep.rows() == 5 && rep.descriptor().strides[0] == 0 && rep(4, 2) == 30 && rep.data() == bias.data());
+    assert(sum(rep) == 5 * 100);
+
+    // an rvalue of the result's extents is reused, otherwise a new matrix is made
+    Matrix<double, 2> d = Matrix<double, 2>(a) + bias;
+    assert(d(1, 1) == 25);
+    Matrix<double, 2> e = Matrix<double, 2>(col) + row;
+    assert(e.rows() == 3 && e.columns() == 4 && e(0, 3) == 401);
+
+    // a broadcast of the destination's own elements is evaluated aside, as they are overwritten before reread
+    Matrix<double, 2> f(a), k(a);
+    f = f + f.row(0);
+    Matrix<double, 2> r = std::move(k) - k.row(2);
+    Matrix<double, 3> x(2, 3, 4);
+    for (size_t i = 0; i < x.size(); ++i)
+        x.data()[i] = double(i);
+    x.row(1) = x.row(1) * 2.0 + x.row(1).row(0);
+    for (size_t i = 0; i < 3; ++i)
+        for (size_t j = 0; j < 4; ++j)
+        {
+            assert(f(i, j) == a(i, j) + a(0, j) && r(i, j) == a(i, j) - a(2, j));
+            assert(x(1, i, j) == 2 * double(12 + 4 * i + j) + double(12 + j) && x(0, i, j) == double(4 * i + j));
+        }
+    cout << "========>OK.\n";
+}
+
+void test_einsum()
+{
+    cout << "Test einsum\n";
+    auto fill = [](auto &m, int seed)
+    {
+        for (size_t i = 0; i < m.size(); ++i)
+            m.data()[i] = double(int((i * 7 + seed) % 11) - 5);
+    };
+    auto same = [](const auto &x, const auto &y)
+    {
+        return x.size() == y.size() && std::equal(x.data(), x.data() + x.size(), y.data());
+    };
+    Matrix<double, 3> a(4, 5, 6);
+    Matrix<double, 2> b(6, 7);
+    fill(a, 1), fill(b, 2);
+
+    // a contraction over the last axis, as one GEMM
+    Matrix<double, 3> c = einsum<3>("ijk,kl->ijl", a, b);
+    assert(c.extent(0) == 4 && c.extent(1) == 5 && c.extent(2) == 7);
+    for (size_t i = 0; i < 4; ++i)
+        for (size_t j = 0; j < 5; ++j)
+            for (size_t l = 0; l < 7; ++l)
+            {
+                double x = 0;
+                for (size_t k = 0; k < 6; ++k)
+                    x += a(i, j, k) * b(k, l);
+                assert(c(i, j, l) == x);
+            }
+
+    // batched products, with a transposed result and through a permuted view
+    Matrix<double, 3> q(3, 8, 4), r(3, 9, 4);
+    fill(q, 3), fill(r, 4);
+    Matrix<double, 3> s = einsum<3>("bid,bjd->bji", q, r);
+    Matrix<double, 3> t = einsum<3>("bdj,bid->bij", permute(r, {0, 2, 1}), q);
+    for (size_t bt = 0; bt < 3; ++bt)
+        for (size_t i = 0; i < 8; ++i)
+            for (size_t j = 0; j < 9; ++j)
+            {
+                double x = 0;
+                for (size_t d = 0; d < 4; ++d)
+                    x += q(bt, i, d) * r(bt, j, d);
+                assert(s(bt, j, i) == x && t(bt, i, j) == x);
+            }
+
+    // summed axes of one side, diagonals, traces and the implicit result
+    Matrix<double, 2> sq(6, 6);
+    fill(sq, 5);
+    double trace = 0;
+    for (size_t i = 0; i < 6; ++i)
+        trace += sq(i, i);
+    telemetry_reset(); // counted as contractions, not as products
+    assert(einsum<0>("ii", sq)() == trace && einsum<0>("ii->", sq)() == trace);
+    assert(telemetry_snapshot()[Matrix_op::einsum].calls == 2 && telemetry_snapshot()[Matrix_op::gemm].calls == 0);
+    Matrix<double, 1> diag = einsum<1>("ii->i", sq);
+    assert(diag(3) == sq(3, 3));
+    Matrix<double, 2> bt = einsum<2>("ij", sq), tr = einsum<2>("ji", sq);
+    assert(bt(1, 4) == sq(1, 4) && tr(1, 4) == sq(4, 1));
+    Matrix<double, 1> rows = einsum<1>("ijk->i", a);
+    assert(rows(2) == sum(a.row(2)));
+    Matrix<double, 2> ab = einsum<2>("ijk,kl->il", a, b);
+    assert(ab(3, 6) == sum(c.row(3), 0)(6));
+
+    // three operands, contracted pairwise
+    Matrix<double, 2> u(7, 3), v(3, 2);
+    fill(u, 6), fill(v, 7);
+    Matrix<double, 2> chain = einsum<2>("ik,kl,lm->im", sq, b, u);
+    Matrix<double, 2> ref = sq * b * u;
+    assert(same(chain, ref));
+    Matrix<double, 2> w(2, 6);
+    fill(w, 8);
+    Matrix<double, 2> loop = b * u * v * w;
+    double loop_trace = 0;
+    for (size_t i = 0; i < 6; ++i)
+        loop_trace += loop(i, i);
+    assert(einsum<0>("ij,jk,kl,li->", b, u, v, w)() == loop_trace);
+
+    // contract is tensordot
+    Matrix<double, 2> ct = contract(a, a, std::array<size_t, 2>{0, 1}, std::array<size_t, 2>{0, 1});
+    assert(ct.rows() == 6 && ct.columns() == 6);
+    assert(same(ct, einsum<2>("ijk,ijl->kl", a, a)));
+    Matrix<double, 3> cb = contract(a, b, std::array<size_t, 1>{2}, std::array<size_t, 1>{0});
+    assert(same(cb, c));
+
+    // malformed subscripts are reported
+    bool thrown = false;
+    try
+    {
+        einsum<2>("ij,kl->il", a, b);
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    cout << "========>OK.\n";
+}
+
+void test_batched_matmul()
+{
+    cout << "Test batched matmul\n";
+    auto fill = [](auto &m, int seed)
+    {
+        for (size_t i = 0; i < m.size(); ++i)
+            m.data()[i] = float(int((i * 5 + seed) % 9) - 4);
+    };
+    // many small products, of sizes around the vector width
+    for (size_t n : {1, 7, 16, 37, 64})
+    {
+        Matrix<float, 3> a(50, n + 3, n), b(50, n, n + 1);
+        fill(a, 1), fill(b, 2);
+        Matrix<float, 3> c = batched_matmul(a, b);
+        assert(c.extent(0) == 50 && c.extent(1) == n + 3 && c.extent(2) == n + 1);
+        for (size_t i = 0; i < 50; i += 7)
+        {
+            Matrix<float, 2> ref = a.row(i) * b.row(i);
+            assert(std::equal(ref.data(), ref.data() + ref.size(), c.row(i).data() + c.row(i).descriptor().start));
+        }
+    }
+
+    // strided views: a transposed batch, and every other product of a larger one
+    Matrix<double, 3> x(8, 20, 12), y(16, 20, 24);
+    fill(x, 3), fill(y, 4);
+    Matrix_ref<double, 3> xt = permute(x, {0, 2, 1});
+    Matrix_ref<double, 3> ys = y(Slice(0, 8, 2), Slice(0), Slice(0));
+    Matrix<double, 3> z = batched_matmul(xt, ys, execution::seq);
+    assert(z.extent(1) == 12 && z.extent(2) == 24);
+    for (size_t i = 0; i < 8; ++i)
+        for (size_t r = 0; r < 12; r += 5)
+            for (size_t col = 0; col < 24; col += 7)
+            {
+                double acc = 0;
+                for (size_t p = 0; p < 20; ++p)
+                    acc += x(i, p, r) * y(2 * i, p, col);
+                assert(z(i, r, col) == acc);
+            }
+
+    // accumulation into an existing batch
+    Matrix<double, 3> w(z);
+    batched_gemm(1.0, xt, ys, 2.0, w);
+    assert(w(3, 4, 5) == 3 * z(3, 4, 5));
+    cout << "========>OK.\n";
+}
+
+void test_sparse()
+{
+    cout << "Test sparse matrices\n";
+    // COO entries in any order, with a repeated coordinate
+    Sparse_matrix<double> a(4, 5, {{2, 1, 3.0}, {0, 4, 1.0}, {3, 0, -2.0}, {2, 1, 1.5}, {0, 0, 5.0}, {2, 3, 7.0}});
+    assert(a.rows() == 4 && a.columns() == 5 && a.nnz() == 5);
+    assert(a(2, 1) == 4.5 && a(0, 4) == 1.0 && a(1, 1) == 0.0);
+    assert((a.offsets() == std::vector<size_t>{0, 2, 2, 4, 5}));
+    assert((a.indices() == std::vector<size_t>{0, 4, 1, 3, 0}));
+
+    // conversions keep the elements
+    Matrix<double, 2> d = a.to_dense();
+    assert(d(2, 3) == 7.0 && d(1, 2) == 0.0);
+    Sparse_matrix<double> c = a.converted(Sparse_format::csc);
+    assert(c.format() == Sparse_format::csc && c.nnz() == 5 && c(3, 0) == -2.0 && c(2, 3) == 7.0);
+    assert((c.offsets() == std::vector<size_t>{0, 2, 3, 3, 4, 5}));
+    Sparse_matrix<double> from_dense(d, Sparse_format::csc);
+    assert(from_dense.values() == c.values() && from_dense.indices() == c.indices());
+    Sparse_matrix<double> t = a.transposed();
+    assert(t.rows() == 5 && t(4, 0) == 1.0 && t(1, 2) == 4.5);
+    assert(Sparse_matrix<double>(4, 5, a.entries()).values() == a.values());
+
+    // products match the dense ones, through CSR and CSC
+    Matrix<double, 1> x{1, 2, 3, 4, 5};
+    telemetry_reset(); // counted apart from the dense products
+    Matrix<double, 1> y = a * x, yc = c * x;
+    assert(telemetry_snapshot()[Matrix_op::spmm].calls == 2 && telemetry_snapshot()[Matrix_op::gemm].calls == 0);
+    assert(y(0) == 10 && y(1) == 0 && y(2) == 4.5 * 2 + 7 * 4 && y(3) == -2);
+    assert(std::equal(y.begin(), y.end(), yc.begin()));
+    Matrix<double, 2> b(5, 3);
+    for (size_t i = 0; i < b.size(); ++i)
+        b.data()[i] = double(i % 7) - 3;
+    Matrix<double, 2> ref = d * b, p = a * b, pc = c * b;
+    assert(std::equal(ref.data(), ref.data() + ref.size(), p.data()));
+    assert(std::equal(ref.data(), ref.data() + ref.size(), pc.data()));
+
+    // a large random operator, split across threads by nonzeros, into a strided view
+    const size_t n = 3000;
+    std::vector<Sparse_entry<float>> entries;
+    for (size_t i = 0; i < 20 * n; ++i)
+        entries.push_back({(i * 7919) % n, (i * 104729 + i / 3) % n, float(i % 5) - 2});
+    for (size_t j = 0; j < n; ++j)
+        entries.push_back({17, j, 1.0f}); // one dense row
+    Sparse_matrix<float> big(n, n, entries);
+    Matrix<float, 2> v(n, 4);
+    for (size_t i = 0; i < v.size(); ++i)
+        v.data()[i] = float(i % 3);
+    Matrix<float, 2> out(n, 8);
+    spmm(1.0f, big, v, 0.0f, out(Slice(0), Slice(0, 4, 2)));
+    Matrix<float, 1> col = big * Matrix<float, 1>(v.column(1));
+    for (size_t i = 0; i < n; i += 37)
+        assert(out(i, 2) == col(i));
+    float dense_row = 0;
+    for (size_t j = 0; j < n; ++j)
+        dense_row += big(17, j) * v(j, 1);
+    assert(col(17) == dense_row);
+    cout << "========>OK.\n";
+}
+
+void test_convolution()
+{
+    cout << "Test convolution\n";
+    auto naive = [](Matrix<double, 3> &in, Matrix<double, 4> &k, size_t stride, size_t pad)
+    {
+        const size_t oh = (in.extent(1) + 2 * pad - k.extent(2)) / stride + 1;
+        const size_t ow = (in.extent(2) + 2 * pad - k.extent(3)) / stride + 1;
+        Matrix<double, 3> out(k.extent(0), oh, ow);
+        for (size_t o = 0; o < k.extent(0); ++o)
+            for (size_t y = 0; y < oh; ++y)
+                for (size_t x = 0; x < ow; ++x)
+                    for (size_t c = 0; c < k.extent(1); ++c)
+                        for (size_t i = 0; i < k.extent(2); ++i)
+                            for (size_t j = 0; j < k.extent(3); ++j)
+                            {
+                                const long iy = long(y * stride + i) - long(pad), ix = long(x * stride + j) - long(pad);
+                                if (iy >= 0 && ix >= 0 && iy < long(in.extent(1)) && ix < long(in.extent(2)))
+                                    out(o, y, x) += in(c, size_t(iy), size_t(ix)) * k(o, c, i, j);
+                            }
+        return out;
+    };
+    auto same = [](const Matrix<double, 3> &x, const Matrix<double, 3> &y)
+    {
+        for (size_t d = 0; d < 3; ++d)
+            if (x.extent(d) != y.extent(d))
+                return false;
+        return std::equal(x.data(), x.data() + x.size(), y.data());
+    };
+
+    // every method, with and without padding and stride
+    const size_t shapes[][6] = {{1, 1, 9, 3, 1, 1}, {3, 2, 11, 3, 2, 1}, {2, 20, 8, 5, 1, 2}, {4, 17, 10, 1, 3, 0}, {2, 3, 7, 7, 1, 4}};
+    for (auto &sh : shapes)
+    {
+        Matrix<double, 3> in(sh[0], sh[2], sh[2] + 3);
+        Matrix<double, 4> k(sh[1], sh[0], sh[3], sh[3]);
+        for (size_t i = 0; i < in.size(); ++i)
+            in.data()[i] = double(int(i * 7 % 13) - 6);
+        for (size_t i = 0; i < k.size(); ++i)
+            k.data()[i] = double(int(i * 5 % 7) - 3);
+        const Matrix<double, 3> ref = naive(in, k, sh[4], sh[5]);
+        telemetry_reset(); // counted as a convolution whatever the method
+        assert(same(correlate2d(in, k, sh[4], sh[5], Conv_method::direct), ref));
+        assert(telemetry_snapshot()[Matrix_op::conv].calls == 1 && telemetry_snapshot()[Matrix_op::gemm].calls == 0);
+        assert(same(correlate2d(in, k, sh[4], sh[5], Conv_method::im2col), ref));
+        assert(same(correlate2d(in, k, sh[4], sh[5]), ref));
+    }
+
+    // convolution flips the kernel; a view of the input is accepted
+    Matrix<double, 3> img(2, 6, 6);
+    for (size_t i = 0; i < img.size(); ++i)
+        img.data()[i] = double(i % 5);
+    Matrix<double, 4> k{{{{1, 2}, {3, 4}}, {{0, 0}, {0, 1}}}};
+    Matrix<double, 4> flipped{{{{4, 3}, {2, 1}}, {{1, 0}, {0, 0}}}};
+    assert(same(conv2d(img, k, 1, 1), correlate2d(img, flipped, 1, 1)));
+    Matrix<double, 3> odd = correlate2d(img(Slice(0), Slice(0, 3, 2), Slice(0)), flipped);
+    assert(odd.extent(1) == 2 && odd(0, 1, 0) == 4 * img(0, 2, 0) + 3 * img(0, 2, 1) + 2 * img(0, 4, 0) + img(0, 4, 1) + img(1, 2, 0));
+    cout << "========>OK.\n";
+}
+
+void test_factorizations()
+{
+    cout << "Test factorizations\n";
+    auto max_diff = [](const Matrix<double, 2> &x, const Matrix<double, 2> &y)
+    {
+        double d = 0;
+        for (size_t i = 0; i < x.size(); ++i)
+            d = std::max(d, std::abs(x.data()[i] - y.data()[i]));
+        return d;
+    };
+
+    // a small system that needs pivoting
+    Matrix<double, 2> s{{0, 2, 1}, {1, 1, 1}, {2, 1, 3}};
+    Lu_factorization<double> fs(s);
+    assert(fs.pivots()[0] == 2 && std::abs(fs.determinant() - -3) < 1e-12);
+    Matrix<double, 1> x = fs.solve(Matrix<double, 1>{3, 3, 6});
+    assert(std::abs(x(0) - 1) < 1e-12 && std::abs(x(1) - 1) < 1e-12 && std::abs(x(2) - 1) < 1e-12);
+
+    // P A = L U over several panels, the factors rebuilt with the permutation
+    const size_t n = 150;
+    Matrix<double, 2> a(n, n);
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = std::fmod(std::sin(double(i)) * 43758.5453, 1.0);
+    Matrix<double, 2> f(a);
+    telemetry_reset(); // counted as a factorization, not as the GEMMs of its trailing updates
+    std::vector<size_t> piv = lu(f);
+    assert(telemetry_snapshot()[Matrix_op::factorize].calls == 1 && telemetry_snapshot()[Matrix_op::gemm].calls == 0);
+    Matrix<double, 2> l(n, n), u(n, n), pa(a);
+    for (size_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < n; ++j)
+            (j < i ? l(i, j) : u(i, j)) = f(i, j), l(i, i) = 1;
+    for (size_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < n; ++j)
+            std::swap(pa(i, j), pa(piv[i], j));
+    assert(max_diff(l * u, pa) < 1e-10);
+
+    // many right-hand sides at once, and the factorization of a non-contiguous view
+    Matrix<double, 2> b(n, 70);
+    for (size_t i = 0; i < b.size(); ++i)
+        b.data()[i] = double(i % 13) - 6;
+    Lu_factorization<double> fa(a);
+    assert(max_diff(a * fa.solve(b), b) < 1e-9);
+    Matrix<double, 2> at(transpose(a)), ft(at);
+    std::vector<size_t> piv_t = lu(transpose(ft));
+    assert(piv_t == piv && max_diff(Matrix<double, 2>(transpose(ft)), f) == 0);
+
+    // Cholesky of A A^T + n I
+    Matrix<double, 2> spd = a * at;
+    for (size_t i = 0; i < n; ++i)
+        spd(i, i) += double(n);
+    Cholesky_factorization<double> fc(spd);
+    const Matrix<double, 2> &lc = fc.factor();
+    assert(lc.data()[1] == 0 && lc.data()[n - 1] == 0);
+    assert(max_diff(lc * Matrix<double, 2>(transpose(const_cast<Matrix<double, 2> &>(lc))), spd) < 1e-9);
+    assert(max_diff(spd * fc.solve(b), b) < 1e-9);
+
+    // errors
+    bool thrown = false;
+    try
+    {
+        Lu_factorization<double>(Matrix<double, 2>{{1, 2}, {2, 4}}).solve(Matrix<double, 1>{1, 1});
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    thrown = false;
+    try
+    {
+        Cholesky_factorization<double> bad(Matrix<double, 2>{{1, 2}, {2, 1}});
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    cout << "========>OK.\n";
+}